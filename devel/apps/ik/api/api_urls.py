@@ -1,5 +1,5 @@
 from django.conf.urls import url
-from .api_views import  auth, utils, profile, chat, telegram
+from .api_views import  auth, utils, profile, chat, telegram, upload, batch, websocket
 
 urlpatterns = [
     url(r'^auth/signup/$', auth.SignupMemberView.as_view()),
@@ -34,11 +34,18 @@ urlpatterns = [
 
     url(r'^contacts/(?P<messenger_id>[A-Z])/$', chat.ContactsListView.as_view()),
 
+    url(r'^batch/$', batch.BatchView.as_view()),
+    url(r'^ws/$', websocket.websocket_view),
+
+    url(r'^upload/$', upload.UploadSessionView.as_view()),
+    url(r'^upload/(?P<upload_id>[0-9a-f]{32})/$', upload.UploadChunkView.as_view()),
+
     url(r'^chat/send/$', chat.SendMessageView.as_view()),
     url(r'^chat/create/private/$', chat.ChatCreatePrivateView.as_view()),
     url(r'^chat/create/group/$', chat.ChatCreateGroupView.as_view()),
     url(r'^chat/search/(?P<messenger_id>[A-Z])/$', chat.SearchChatsView.as_view()),
     url(r'^chat/$', chat.ChatsListView.as_view()),
+    url(r'^chat/sync/$', chat.ChatsSyncView.as_view()),
     url(r'^chat/(?P<chat_id>[a-zA-Z0-9_-]+)/$', chat.ChatView.as_view()),
     url(r'^chat/(?P<chat_id>[a-zA-Z0-9_-]+)/forward/$', chat.ForwardMessage.as_view()),
     url(r'^chat/(?P<chat_id>[a-zA-Z0-9_-]+)/messages/$', chat.ChatConversationView.as_view(), name="chat_conversation"),
@@ -0,0 +1,60 @@
+import json
+import logging
+from django.test.client import RequestFactory
+from django.urls import resolve, Resolver404
+from rest_framework.exceptions import ValidationError
+from rest_framework.response import Response
+from rest_framework.views import APIView
+from ..permissions import IsAuthenticated
+from . import chat
+
+logger = logging.getLogger("cc")
+
+BATCH_MAX_CALLS = 20
+# small calls client joins in one round trip, all of them return short JSON and take no files
+BATCH_ALLOWED_VIEWS = (chat.ChatOpenView, chat.MarkSeenMessageView, chat.SendChatActionView, chat.ForwardMessage)
+
+_factory = RequestFactory()
+
+
+def run_api_call(request, call, allowed_views=BATCH_ALLOWED_VIEWS):
+    """ Runs one {"method", "path", "data"} call as request of same member and device,
+        returns {"status": http code, "body": response data} """
+    if not isinstance(call, dict):
+        return {"status": 400, "body": {"message": "Wrong call"}}
+    method = str(call.get('method', 'POST')).upper()
+    path = str(call.get('path', ''))
+    data = call.get('data') or {}
+    try:
+        match = resolve(path.split('?')[0], urlconf='ik.api.api_urls')
+    except Resolver404:
+        return {"status": 404, "body": {"message": "Resource not found"}}
+    if getattr(match.func, 'view_class', None) not in allowed_views or method not in ('GET', 'POST'):
+        return {"status": 400, "body": {"message": "Call can't be batched: {} {}".format(method, path)}}
+
+    sub_request = _factory.get(path, data) if method == 'GET' else _factory.post(path, data)
+    sub_request.user = request.user
+    sub_request.auth = request.auth
+    sub_request.LANGUAGE_CODE = getattr(request, 'LANGUAGE_CODE', None)
+    # outer request has passed CSRF check already
+    sub_request._dont_enforce_csrf_checks = True
+
+    response = match.func(sub_request, *match.args, **match.kwargs)
+    return {"status": response.status_code, "body": getattr(response, 'data', None)}
+
+
+class BatchView(APIView):
+    """ Runs several API calls in one request, result of each is {"status": http code, "body": response data} """
+    permission_classes = (IsAuthenticated,)
+
+    def post(self, request, *args, **kwargs):
+        calls = request.data.get('calls')
+        if isinstance(calls, str):
+            try:
+                calls = json.loads(calls)
+            except ValueError:
+                raise ValidationError("Field \"calls\" must be JSON array")
+        if not isinstance(calls, list) or len(calls) > BATCH_MAX_CALLS:
+            raise ValidationError("Field \"calls\" must be array of at most {} calls".format(BATCH_MAX_CALLS))
+
+        return Response({"results": [run_api_call(request, call) for call in calls]})
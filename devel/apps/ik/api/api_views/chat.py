@@ -2,18 +2,22 @@ import logging
 
 from PIL import Image
 from django.conf import settings
+from django.core.cache import cache
 from django.contrib.auth.signals import user_logged_in
 from django.core.files.storage import default_storage
 from django.urls import reverse
+from django.utils.http import http_date
 from django.utils.timezone import now
 from django.utils.translation import ugettext as _
 from django.http import QueryDict
+from rest_framework import status
 from rest_framework.exceptions import ValidationError
 from rest_framework.parsers import MultiPartParser, FormParser, JSONParser
 from rest_framework.renderers import JSONRenderer, TemplateHTMLRenderer
 from rest_framework.response import Response
 from rest_framework.views import APIView
 from ik.api.permissions import IsAuthenticated
+from ik.api.api_views.upload import get_completed_upload, remove_upload
 from ik.api.serializers.chat import SendMessageSerializer, CreatePrivateChatSerializer, CreateGroupChatSerializer, ForwardMessageSerializer
 from ik.messengers.client import get_chat_client
 from ik.messengers.chatcube.client import IKChatcubeClient
@@ -21,6 +25,7 @@ from ik.messengers.utils import split_messeger_id
 from ik.messengers.telegram.client import TelegramException
 from ik.models import Member
 from ik.models.chat import OpenedChat
+from ik.events import get_events_since_if_kept
 from ik.utils.site import build_absolute_uri
 from ik.constants import *
 from ik import constants
@@ -28,6 +33,8 @@ from ik import constants
 logger = logging.getLogger("cc")
 
 DEFAULT_LOAD_MESSAGES_LIMIT = 20
+# client resends queued message when answer was lost, same client_send_id within this time is sent once
+SEND_DEDUP_TIMEOUT = 24 * 3600
 
 class SendMessageView(APIView):
     PHOTO_MIN_WIDTH = 10
@@ -49,6 +56,9 @@ class SendMessageView(APIView):
         file = validated_data.get('file')
         file_name = validated_data.get('file_name')
         file_type = validated_data.get('file_type', 0)
+        upload_id = None if file else validated_data.get('upload_id')
+        if upload_id:
+            file = get_completed_upload(request.user, upload_id)
 
         if not chat_id and not recipient_id:
             raise ValidationError("You must set the 'chat_id' or 'recipient_id' fields")
@@ -99,17 +109,34 @@ class SendMessageView(APIView):
 
         client.check_send_permissions(chat)
 
-        if type == MESSAGE_TYPE_TEXT:
-            client.send_message_text(chat, text, reply_to_id=validated_data.get('reply_to_id'))
-        elif type == MESSAGE_TYPE_PHOTO:
-            client.send_message_photo(chat, file, caption=text, reply_to_id=validated_data.get('reply_to_id'))
-        elif type == MESSAGE_TYPE_FILE:
-            client.send_message_file(chat, file, caption=text, file_name=file_name, file_type=file_type, reply_to_id=validated_data.get('reply_to_id'))
-        elif type == MESSAGE_TYPE_STICKER:
-            client.send_message_sticker(chat, text, reply_to_id=validated_data.get('reply_to_id'))
-        else:
-            raise ValidationError("Unknown message type")
-
+        client_send_id = validated_data.get('client_send_id')
+        send_key = "sendmsg:{}:{}".format(me.id, client_send_id) if client_send_id else None
+        if send_key and not cache.add(send_key, 1, SEND_DEDUP_TIMEOUT):
+            logger.info("Member {} repeated send {}, already sent".format(me, client_send_id))
+            if upload_id:
+                file.close()
+                remove_upload(request.user, upload_id)
+            return Response({"result": "ok"})
+
+        try:
+            if type == MESSAGE_TYPE_TEXT:
+                client.send_message_text(chat, text, reply_to_id=validated_data.get('reply_to_id'))
+            elif type == MESSAGE_TYPE_PHOTO:
+                client.send_message_photo(chat, file, caption=text, reply_to_id=validated_data.get('reply_to_id'))
+            elif type == MESSAGE_TYPE_FILE:
+                client.send_message_file(chat, file, caption=text, file_name=file_name, file_type=file_type, reply_to_id=validated_data.get('reply_to_id'))
+            elif type == MESSAGE_TYPE_STICKER:
+                client.send_message_sticker(chat, text, reply_to_id=validated_data.get('reply_to_id'))
+            else:
+                raise ValidationError("Unknown message type")
+        except Exception:
+            if send_key:
+                cache.delete(send_key)
+            raise
+
+        if upload_id:
+            file.close()
+            remove_upload(request.user, upload_id)
         return Response({"result": "ok"})
 
 
@@ -149,6 +176,20 @@ class ChatsListView(APIView):
         return Response(chats)
 
 
+class ChatsSyncView(APIView):
+    """ Events since time of last event client has seen, to update chat list it saved.
+        410 when they are not kept for so long, client loads whole chat list then. """
+    permission_classes = (IsAuthenticated,)
+
+    def get(self, request, *args, **kwargs):
+        # taken before events are read, event published meanwhile is sent again by next sync
+        sync_time = http_date()
+        events = get_events_since_if_kept(request.user.push_channel, request.GET.get('since', ''))
+        if events is None:
+            return Response({"result": "resync"}, status=status.HTTP_410_GONE)
+        return Response({'events': events, 'time': sync_time})
+
+
 class ChatCreatePrivateView(APIView):
     permission_classes = (IsAuthenticated,)
 
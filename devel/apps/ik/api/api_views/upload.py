@@ -0,0 +1,119 @@
+import os
+import re
+import json
+import uuid
+import fcntl
+import logging
+from django.conf import settings
+from django.core.files import File
+from django.core.files.storage import default_storage
+from rest_framework.exceptions import ValidationError, NotFound
+from rest_framework.response import Response
+from rest_framework.views import APIView
+from ..permissions import IsAuthenticated
+
+logger = logging.getLogger("cc")
+
+# part size client sends in one PUT, each part is acknowledged with received byte count
+UPLOAD_CHUNK_SIZE = 64 * 1024
+UPLOAD_MAX_SIZE = 2000 * 1024 * 1024
+# same as in api_urls.py, upload_id becomes file name
+UPLOAD_ID_RE = re.compile(r'^[0-9a-f]{32}$')
+
+
+def _upload_path(member, upload_id):
+    if not isinstance(upload_id, str) or not UPLOAD_ID_RE.match(upload_id):
+        raise NotFound("Upload not found")
+    return default_storage.path(os.path.join(settings.FILE_UPLOAD_TEMP, str(member.id), "chunked", upload_id))
+
+
+def _load_upload_meta(member, upload_id):
+    path = _upload_path(member, upload_id)
+    try:
+        with open(path + ".json") as f:
+            meta = json.load(f)
+        meta['received'] = os.path.getsize(path)
+    except (IOError, OSError, ValueError):
+        raise NotFound("Upload not found")
+    meta['path'] = path
+    return meta
+
+
+def _upload_status(upload_id, meta):
+    return {"upload_id": upload_id,
+            "size": meta['size'],
+            "received": meta['received'],
+            "chunk_size": UPLOAD_CHUNK_SIZE}
+
+
+def get_completed_upload(member, upload_id):
+    """ File of fully received chunked upload to pass where request.FILES item is expected """
+    meta = _load_upload_meta(member, upload_id)
+    if meta['received'] != meta['size']:
+        raise ValidationError("Upload is not completed, received {} of {} bytes".format(meta['received'], meta['size']))
+    return File(open(meta['path'], "rb"), name=meta['file_name'])
+
+
+def remove_upload(member, upload_id):
+    path = _upload_path(member, upload_id)
+    for name in (path, path + ".json"):
+        try:
+            os.unlink(name)
+        except OSError:
+            pass
+
+
+class UploadSessionView(APIView):
+    permission_classes = (IsAuthenticated,)
+
+    def post(self, request, *args, **kwargs):
+        try:
+            size = int(request.data.get('size', ''))
+        except ValueError:
+            raise ValidationError("Field \"size\" must be integer")
+        file_name = os.path.basename(request.data.get('file_name', '')) or "file"
+        if size <= 0 or size > UPLOAD_MAX_SIZE:
+            raise ValidationError("Wrong upload size {}".format(size))
+
+        upload_id = uuid.uuid4().hex
+        path = _upload_path(request.user, upload_id)
+        os.makedirs(os.path.dirname(path), exist_ok=True)
+        with open(path + ".json", "w") as f:
+            json.dump({"size": size, "file_name": file_name}, f)
+        open(path, "wb").close()
+        logger.info("Member {} starts chunked upload {} of {}, {} bytes".format(request.user, upload_id, file_name, size))
+        return Response(_upload_status(upload_id, {"size": size, "received": 0}))
+
+
+class UploadChunkView(APIView):
+    permission_classes = (IsAuthenticated,)
+
+    def get(self, request, *args, **kwargs):
+        upload_id = kwargs['upload_id']
+        return Response(_upload_status(upload_id, _load_upload_meta(request.user, upload_id)))
+
+    def put(self, request, *args, **kwargs):
+        upload_id = kwargs['upload_id']
+        meta = _load_upload_meta(request.user, upload_id)
+        try:
+            offset = int(request.GET.get('offset', ''))
+        except ValueError:
+            raise ValidationError("Parameter \"offset\" must be integer")
+
+        data = request.body
+        if len(data) > UPLOAD_CHUNK_SIZE or offset + len(data) > meta['size']:
+            raise ValidationError("Upload part is too big")
+
+        # repeated or parallel PUT of same part must not append it twice, check and write under lock
+        with open(meta['path'], "r+b") as f:
+            fcntl.flock(f, fcntl.LOCK_EX)
+            try:
+                meta['received'] = os.fstat(f.fileno()).st_size
+                if offset != meta['received']:
+                    # part was sent twice or previous one was lost, client continues from what is received
+                    return Response(_upload_status(upload_id, meta), status=409)
+                os.pwrite(f.fileno(), data, offset)
+                meta['received'] = offset + len(data)
+            finally:
+                fcntl.flock(f, fcntl.LOCK_UN)
+        return Response(_upload_status(upload_id, meta))
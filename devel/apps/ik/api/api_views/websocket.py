@@ -0,0 +1,93 @@
+import json
+import logging
+import select
+import threading
+from django.conf import settings
+from django.http import HttpResponse
+from ik.api.renderer import json_dumps
+from ik.events import websocket_events_channel, get_websocket_events_since
+from django_redis import get_redis_connection
+from .batch import run_api_call, BATCH_ALLOWED_VIEWS
+from . import chat
+
+try:
+    import uwsgi
+except ImportError:
+    uwsgi = None
+
+logger = logging.getLogger("cc")
+
+# upstream calls accepted over websocket, send is safe to repeat as client marks it with client_send_id
+WEBSOCKET_ALLOWED_VIEWS = BATCH_ALLOWED_VIEWS + (chat.SendMessageView,)
+# uWSGI sends ping from websocket_recv_nb() only, loop wakes up at least this often (websocket-ping-freq)
+WEBSOCKET_PING_SECONDS_DEFAULT = 30
+# each connection holds a thread, over the limit client is refused and stays on SSE
+_websocket_slots = threading.BoundedSemaphore(settings.WEBSOCKET_MAX_PER_PROCESS)
+
+
+def _run_websocket_call(request, frame):
+    """ {"call": id, "method", "path", "data"} -> {"reply": id, "status", "body"} """
+    try:
+        call = json.loads(frame.decode('utf-8'))
+    except ValueError:
+        return None
+    if not isinstance(call, dict) or 'call' not in call:
+        return None
+    try:
+        result = run_api_call(request, call, WEBSOCKET_ALLOWED_VIEWS)
+    except Exception as ex:
+        logger.exception("Websocket call {} {} failed".format(call.get('method'), call.get('path')))
+        result = {"status": 500, "body": {"message": str(ex)}}
+    result['reply'] = call['call']
+    return json_dumps(result)
+
+
+def websocket_view(request):
+    """ Events of member channel downstream in same framing as SSE, small API calls upstream.
+        Runs on uWSGI native websockets in own instance (conf/uwsgi-ws-*.ini), each connection holds
+        one worker thread there, so REST API threads are not taken by open connections. """
+    if uwsgi is None or 'HTTP_SEC_WEBSOCKET_KEY' not in request.META:
+        return HttpResponse("Websocket upgrade expected", status=400)
+    if not getattr(request, 'auth', None):
+        return HttpResponse("Authorization required", status=401)
+
+    if not _websocket_slots.acquire(blocking=False):
+        logger.warning(u"Websocket of member {} refused, {} connections open".format(request.user, settings.WEBSOCKET_MAX_PER_PROCESS))
+        return HttpResponse("Too many websocket connections", status=503)
+    try:
+        return _run_websocket(request)
+    finally:
+        _websocket_slots.release()
+
+
+def _run_websocket(request):
+    me = request.user
+    pubsub = get_redis_connection("default").pubsub(ignore_subscribe_messages=True)
+    # subscribed before replay, so event published in between is not lost (it may come twice)
+    pubsub.subscribe(websocket_events_channel(me.push_channel))
+    uwsgi.websocket_handshake(request.META['HTTP_SEC_WEBSOCKET_KEY'], request.META.get('HTTP_ORIGIN', ''))
+    logger.info(u"Member {} connected by websocket".format(me))
+    try:
+        for envelope in get_websocket_events_since(me.push_channel, request.GET.get('time')):
+            uwsgi.websocket_send(envelope)
+        ping_seconds = int(uwsgi.opt.get('websocket-ping-freq', WEBSOCKET_PING_SECONDS_DEFAULT))
+        client_fd = uwsgi.connection_fd()
+        redis_conn = pubsub.connection
+        while True:
+            # both sides may hold already read data in own buffers, select sees only what is left in socket
+            frame = uwsgi.websocket_recv_nb()
+            while frame:
+                reply = _run_websocket_call(request, frame)
+                if reply:
+                    uwsgi.websocket_send(reply)
+                frame = uwsgi.websocket_recv_nb()
+            while redis_conn.can_read(timeout=0):
+                ev = pubsub.get_message()
+                if ev and ev['type'] == 'message':
+                    uwsgi.websocket_send(ev['data'])
+            select.select([client_fd, redis_conn._sock], [], [], ping_seconds)
+    except IOError:
+        logger.info(u"Member {} websocket closed".format(me))
+    finally:
+        pubsub.close()
+    return HttpResponse()
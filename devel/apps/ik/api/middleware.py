@@ -1,6 +1,10 @@
+import zlib
 import logging
+from io import BytesIO
 
 from django import http
+from django.conf import settings
+from django.core.exceptions import RequestDataTooBig
 from django.utils import timezone
 from django.utils.cache import patch_vary_headers
 from rest_framework.authentication import get_authorization_header
@@ -10,6 +14,37 @@ from ik.signals import ip_addess_changed
 
 logger = logging.getLogger("cc")
 
+class GzipRequestBodyMiddleware(object):
+    # client sends big POST bodies (feedback with logs) with Content-Encoding: gzip
+    def __init__(self, get_response):
+        self.get_response = get_response
+
+    def __call__(self, request):
+        if request.META.get('HTTP_CONTENT_ENCODING', '').lower() == 'gzip':
+            # runs before auth, inflated size is limited as for plain bodies
+            max_size = settings.DATA_UPLOAD_MAX_MEMORY_SIZE or 2621440
+            try:
+                inflater = zlib.decompressobj(16 + zlib.MAX_WBITS)
+                body = inflater.decompress(request.body, max_size + 1)
+                if len(body) > max_size or inflater.unconsumed_tail:
+                    logger.warning(u'Gzipped request body inflates over {} bytes'.format(max_size))
+                    return http.HttpResponse(status=413)
+                body += inflater.flush()
+                if not inflater.eof:
+                    raise zlib.error("truncated data")
+            except RequestDataTooBig:
+                logger.warning(u'Gzipped request body is over {} bytes'.format(max_size))
+                return http.HttpResponse(status=413)
+            except zlib.error as ex:
+                logger.warning(u'Broken gzipped request body: {}'.format(ex))
+                return http.HttpResponseBadRequest()
+            request._body = body
+            request._stream = BytesIO(body)
+            request.META['CONTENT_LENGTH'] = str(len(body))
+            del request.META['HTTP_CONTENT_ENCODING']
+        return self.get_response(request)
+
+
 class IKAPIMiddleware(object):
     # DatingAPITokenAuthMiddleware must be placed BEFORE AuthenticationMiddleware
     keyword = 'Token'
@@ -6,9 +6,11 @@ class SendMessageSerializer(serializers.Serializer):
     type = serializers.IntegerField(required=True)
     text = serializers.CharField(required=False, trim_whitespace=False)
     file = serializers.FileField(required=False)
+    upload_id = serializers.RegexField(r'^[0-9a-f]{32}$', required=False)  # completed chunked upload instead of file
     file_type = serializers.IntegerField(required=False)
     file_name = serializers.CharField(required=False)
     reply_to_id = serializers.IntegerField(required=False)
+    client_send_id = serializers.CharField(required=False)  # same for repeated sends of one queued message
 
 
 class CreateGroupChatSerializer(serializers.Serializer):
@@ -1,7 +1,10 @@
 import logging
 import json
+import time
 import requests
 from django.conf import settings
+from django.utils.http import http_date, parse_http_date_safe
+from django_redis import get_redis_connection
 from ik.api.renderer import json_dumps
 
 from ik.models import Member
@@ -46,3 +49,72 @@ class Event(object):
         r = requests.post(url, post_data, headers={'host': settings.API_DOMAIN})
         if r.status_code != 200:
             logger.warn(u"Push event failed. Member: {} Data:{} Status:{} Result:{}".format(to.id, serialized_data, r.status_code, r.text))
+        if settings.WEBSOCKET_EVENTS:
+            try:
+                publish_websocket_event(to.push_channel, ev_data)
+            except Exception as ex:
+                logger.warn(u"Websocket event publish failed. Member: {} Error: {}".format(to.id, ex))
+
+
+def websocket_events_channel(push_channel):
+    return "ws:ch:{}".format(push_channel)
+
+
+def _websocket_events_log(push_channel):
+    return "ws:log:{}".format(push_channel)
+
+
+def publish_websocket_event(push_channel, ev_data):
+    """ Event wrapped same way as push stream sends it by SSE, so client parses both transports alike """
+    redis = get_redis_connection("default")
+    envelope = json_dumps({
+        'id': redis.incr("ws:seq:{}".format(push_channel)),
+        'channel': "m{}".format(push_channel),
+        'text': ev_data,
+        'tag': "",
+        'time': http_date(),
+        'eventid': "",
+    })
+    log_key = _websocket_events_log(push_channel)
+    pipe = redis.pipeline()
+    pipe.rpush(log_key, envelope)
+    pipe.ltrim(log_key, -settings.WEBSOCKET_EVENTS_KEEP, -1)
+    pipe.expire(log_key, settings.WEBSOCKET_EVENTS_KEEP_SECONDS)
+    pipe.expire("ws:seq:{}".format(push_channel), settings.WEBSOCKET_EVENTS_KEEP_SECONDS)
+    pipe.publish(websocket_events_channel(push_channel), envelope)
+    pipe.execute()
+
+
+def get_websocket_events_since(push_channel, since_time):
+    """ Kept events sent at since_time (HTTP date as in event "time") or later, like push stream ?time= replay """
+    since = parse_http_date_safe(since_time) if since_time else None
+    if since is None:
+        return []
+    redis = get_redis_connection("default")
+    events = []
+    for envelope in redis.lrange(_websocket_events_log(push_channel), 0, -1):
+        ev_time = parse_http_date_safe(json.loads(envelope.decode('utf-8')).get('time', ''))
+        if ev_time is not None and ev_time >= since:
+            events.append(envelope)
+    return events
+
+
+def get_events_since_if_kept(push_channel, since_time):
+    """ Events (without envelope) since since_time, or None when log may miss some of them:
+        events are not published to it, since_time is older than log keeps or log was trimmed after it """
+    since = parse_http_date_safe(since_time) if since_time else None
+    if not settings.WEBSOCKET_EVENTS or since is None or since < time.time() - settings.WEBSOCKET_EVENTS_KEEP_SECONDS:
+        return None
+    redis = get_redis_connection("default")
+    log = redis.lrange(_websocket_events_log(push_channel), 0, -1)
+    if len(log) >= settings.WEBSOCKET_EVENTS_KEEP:
+        first_time = parse_http_date_safe(json.loads(log[0].decode('utf-8')).get('time', ''))
+        if first_time is None or first_time > since:
+            return None
+    events = []
+    for envelope in log:
+        ev = json.loads(envelope.decode('utf-8'))
+        ev_time = parse_http_date_safe(ev.get('time', ''))
+        if ev_time is not None and ev_time >= since:
+            events.append(ev['text'])
+    return events
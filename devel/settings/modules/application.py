@@ -36,6 +36,9 @@ INSTALLED_APPS = (
 )
 
 MIDDLEWARE = (
+    'django.middleware.gzip.GZipMiddleware',
+    'django.middleware.http.ConditionalGetMiddleware',
+    'ik.api.middleware.GzipRequestBodyMiddleware',
     'django.contrib.sessions.middleware.SessionMiddleware',
     'django.middleware.locale.LocaleMiddleware',
     'django.middleware.common.CommonMiddleware',
@@ -70,3 +73,11 @@ IPV62LOCATION_DB = os.path.join(PROJECT_DIR, "var", "global", "IPV6-COUNTRY-REGI
 CACHE_VERSION_TAG = str(time())
 
 ADMIN_ROOT_URL = '/admin/'
+
+# events are also published to redis for members connected by websocket (/api/ws/), kept for replay after reconnect
+WEBSOCKET_EVENTS = True
+# same log serves /chat/sync/ delta after restart of client, so it is kept longer than reconnects need
+WEBSOCKET_EVENTS_KEEP = 500
+WEBSOCKET_EVENTS_KEEP_SECONDS = 6 * 3600
+# open websockets per uWSGI process of websocket instance (conf/uwsgi-ws-*.ini), keep below its threads
+WEBSOCKET_MAX_PER_PROCESS = 100
@@ -39,7 +39,7 @@ void on_logged_in(const AppEvents::LoggedIn& ev) {
         remove_recursive("<ChatCube$Dir>.updater");
         show_alert_info("ChatCube updated successfully!");
     }
-    g_app_data_model.load_chat_list(g_app_state.start_hidden);
+    g_app_data_model.sync_chat_list(g_app_state.start_hidden);
 }
 
 void on_login_required(const AppEvents::LoginRequired& ev) {
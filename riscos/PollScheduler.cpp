@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <cloverleaf/Logger.h>
+#include "PollScheduler.h"
+
+static const int poll_histogram_limits[POLL_HISTOGRAM_BUCKETS - 1] = {1, 2, 5, 10, 25};
+static const char* poll_reason_names[POLL_REASONS] = {"listen", "idle_task", "http", "typing", "wakeup"};
+
+void PollScheduler::tick_started() {
+    _in_tick = true;
+    _stats.ticks++;
+}
+
+void PollScheduler::begin(int longest_cs) {
+    _next_period = longest_cs;
+    _next_reason = POLL_REASON_LISTEN;
+}
+
+void PollScheduler::offer(int delay_cs, int reason) {
+    if (delay_cs < POLL_MIN_CS) {
+        delay_cs = POLL_MIN_CS;
+    }
+    if (delay_cs < _next_period) {
+        _next_period = delay_cs;
+        _next_reason = reason;
+    }
+}
+
+void PollScheduler::commit() {
+    _in_tick = false;
+    _stats.reasons[_next_reason]++;
+    _stats.total_period_cs += _next_period;
+    int bucket = 0;
+    while (bucket < POLL_HISTOGRAM_BUCKETS - 1 && _next_period > poll_histogram_limits[bucket]) {
+        bucket++;
+    }
+    _stats.histogram[bucket]++;
+    if (_next_period != _period) {
+        Logger::debug("PollScheduler period %d -> %d (%s)", _period, _next_period, poll_reason_names[_next_reason]);
+        _stats.period_changes++;
+        _period = _next_period;
+        _set_period(_period);
+    }
+}
+
+// tick will set period again when it ends, only work queued from Wimp events needs waking up
+void PollScheduler::wakeup() {
+    if (_in_tick || _period <= POLL_MIN_CS) {
+        return;
+    }
+    _stats.wakeups++;
+    _stats.reasons[POLL_REASON_WAKEUP]++;
+    _period = POLL_MIN_CS;
+    _set_period(_period);
+}
+
+bool PollScheduler::dump_stats(const char* file_name, const char* mode) {
+    FILE *f = fopen(file_name, mode);
+    if (!f) {
+        return false;
+    }
+    fprintf(f, "poll: ticks:%lu wakeups:%lu period_changes:%lu avg_period_cs:%lu reasons:",
+            _stats.ticks, _stats.wakeups, _stats.period_changes,
+            _stats.ticks ? (unsigned long) (_stats.total_period_cs / _stats.ticks) : 0);
+    for (int reason = 0; reason < POLL_REASONS; reason++) {
+        fprintf(f, " %s:%lu", poll_reason_names[reason], _stats.reasons[reason]);
+    }
+    fprintf(f, " periods_cs:");
+    for (int bucket = 0; bucket < POLL_HISTOGRAM_BUCKETS - 1; bucket++) {
+        fprintf(f, " <=%d:%lu", poll_histogram_limits[bucket], _stats.histogram[bucket]);
+    }
+    fprintf(f, " more:%lu\n", _stats.histogram[POLL_HISTOGRAM_BUCKETS - 1]);
+    fclose(f);
+    return true;
+}
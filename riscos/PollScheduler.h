@@ -0,0 +1,58 @@
+/*
+ * PollScheduler.h
+ *
+ * Picks period of the application poll timer. Each tick ends by offering delays after which
+ * some work becomes ready (idle tasks, curl timeouts, retries, typing timeout), timer is set
+ * to the shortest one. Sockets can't wake the task, so open connections are polled with
+ * listen period. Work queued between ticks wakes the timer at once.
+ */
+
+#ifndef ROCHAT_POLLSCHEDULER_H
+#define ROCHAT_POLLSCHEDULER_H
+
+#include <functional>
+
+#define POLL_MIN_CS             1
+#define POLL_LISTEN_CS          5   // main window shown and online: latency of incoming events
+#define POLL_MAX_CS             50  // hidden or offline
+
+// what decided the period
+#define POLL_REASON_LISTEN      0   // nothing due before listen period
+#define POLL_REASON_IDLE_TASK   1
+#define POLL_REASON_HTTP        2   // running transfers, curl timeout, retry or reconnect
+#define POLL_REASON_TYPING      3
+#define POLL_REASON_WAKEUP      4   // work queued between ticks
+#define POLL_REASONS            5
+
+#define POLL_HISTOGRAM_BUCKETS  6
+
+struct PollSchedulerStats {
+    unsigned long ticks = 0;
+    unsigned long wakeups = 0;          // timer brought forward by work queued between ticks
+    unsigned long period_changes = 0;
+    unsigned long long total_period_cs = 0;
+    unsigned long reasons[POLL_REASONS] = {0};
+    unsigned long histogram[POLL_HISTOGRAM_BUCKETS] = {0}; // chosen periods, see poll_histogram_limits
+};
+
+class PollScheduler {
+private:
+    std::function<void(int period)> _set_period;
+    int _period = 0;            // currently set
+    int _next_period = 0;       // being chosen by tick
+    int _next_reason = POLL_REASON_LISTEN;
+    bool _in_tick = false;
+    PollSchedulerStats _stats;
+public:
+    PollScheduler(std::function<void(int period)> set_period) : _set_period(set_period) {};
+    void tick_started();
+    void begin(int longest_cs);
+    void offer(int delay_cs, int reason);   // work of reason is ready in delay_cs
+    void commit();
+    void wakeup();
+    int get_period() { return _period; }
+    const PollSchedulerStats& get_stats() { return _stats; }
+    bool dump_stats(const char* file_name, const char* mode="w");
+};
+
+#endif //ROCHAT_POLLSCHEDULER_H
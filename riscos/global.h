@@ -32,6 +32,7 @@ struct AppState {
 extern AppState g_app_state;
 
 void set_app_poll_period(int period);
+void app_poll_wakeup();
 void g_hourglass_off();
 void g_hourglass_on();
 void g_hourglass_percentage(int percent);
@@ -11,9 +11,14 @@ class IdleTask {
 private:
     std::list<std::function<void()>> _on_next_idle_run_list;
 public:
+    std::function<void()> on_task_added; // lets the poll timer fire sooner than it planned
     void run_at_next_idle(std::function<void()> fun) {
         _on_next_idle_run_list.push_back(fun);
+        if (on_task_added) {
+            on_task_added();
+        }
     }
+    bool has_tasks() { return !_on_next_idle_run_list.empty(); }
     void process_tasks();
 };
 
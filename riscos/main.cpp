@@ -27,6 +27,7 @@
 #include "cloverleaf/CLImage.h"
 #include "cloverleaf/CLSound.h"
 #include "AppEventHandlers.h"
+#include "PollScheduler.h"
 #include "ui/AppMenu.h"
 #include "ui/AppIconbar.h"
 #include "ui/ChatMainUI.h"
@@ -72,6 +73,8 @@ public:
     }
 } my_uncaught_handler;
 
+PollScheduler g_poll_scheduler(set_app_poll_period);
+
 class AppTimer : public tbx::Timer {
 private:
     bool http_was_connected = true;
@@ -81,6 +84,7 @@ public:
 //        os_t t;
 //        xos_mouse(&x,&y,&b, &t);
 //        Logger::debug("AppTimer %d %x", elapsed, b);
+        g_poll_scheduler.tick_started();
         g_idle_task.process_tasks();
         g_http_service.process();
         bool now_connected = g_http_service.connected();
@@ -90,34 +94,36 @@ public:
             g_app_events.notify(AppEvents::ConnectionStateChanged{.connected = now_connected});
         }
 
-        os_t now = os_read_monotonic_time();
-        int period = 3;
-        if (g_app_state.startup_time > now) {
-            g_app_state.startup_time = 0;
-        }
-        if (now - g_app_state.startup_time < 1000) {
-            period = 3;
-        } else {
-            if (!g_app_state.is_main_window_shown) {
-                period = 50;
-            } else {
-                if (g_http_service.is_online) {
-                    period = 5;
-                } else {
-                    period = 50;
-                }
-            }
-        }
-        set_app_poll_period(period);
-
         // cancel typing notify on timeout
         if (ChatMainUI::instance) {
             ChatMainUI::instance->check_typing_notify_timeout();
         }
 
+        // sleep until the earliest work is due
+        int listen = (g_app_state.is_main_window_shown && g_http_service.is_online) ? POLL_LISTEN_CS : POLL_MAX_CS;
+        g_poll_scheduler.begin(listen);
+        if (g_idle_task.has_tasks()) {
+            g_poll_scheduler.offer(POLL_MIN_CS, POLL_REASON_IDLE_TASK);
+        }
+        g_poll_scheduler.offer(g_http_service.next_process_delay_cs(listen), POLL_REASON_HTTP);
+        int send_retry = g_app_data_model.process_send_queue_retries();
+        if (send_retry >= 0) {
+            g_poll_scheduler.offer(send_retry, POLL_REASON_HTTP);
+        }
+        if (ChatMainUI::instance) {
+            int typing_timeout = ChatMainUI::instance->typing_notify_timeout_cs();
+            if (typing_timeout >= 0) {
+                g_poll_scheduler.offer(typing_timeout, POLL_REASON_TYPING);
+            }
+        }
+        g_poll_scheduler.commit();
     }
 } app_poll_task;
 
+void app_poll_wakeup() {
+    g_poll_scheduler.wakeup();
+}
+
 class AppShowMainUICommand : public tbx::Command {
 public:
     void execute() override {
@@ -280,12 +286,14 @@ int main(int argc, char* argv[])
 
 
     IKConfig::start("<ChatCube$ChoicesDir>.config/ini");
+    CLDownloadFileRequest::expire_partials();
     g_app_state.start_hidden = IKConfig::get_value("general","start_hidden",0);
 
     init_images_cache(200);
     CLImage::detect_rgb_mode();
 
     set_app_poll_period(2);
+    g_idle_task.on_task_added = app_poll_wakeup;
 
     my_app.add_command(CMD_QUIT_APP, &app_quit_cmd);
     my_app.add_command(CMD_LOGOUT, &app_logout_cmd);
@@ -334,6 +342,15 @@ int main(int argc, char* argv[])
 
     my_app.run();
 
+    g_http_service.dump_stats("<ChatCube$ChoicesDir>.netstats");
+    g_app_data_model.get_send_queue().dump_stats("<ChatCube$ChoicesDir>.netstats", "ab");
+    g_app_data_model.get_api_batcher().dump_stats("<ChatCube$ChoicesDir>.netstats", "ab");
+    g_poll_scheduler.dump_stats("<ChatCube$ChoicesDir>.netstats", "ab");
+    g_app_data_model.get_message_store().flush();
+    g_app_data_model.get_message_store().dump_stats("<ChatCube$ChoicesDir>.netstats", "ab");
+    g_app_data_model.get_chat_sync().flush();
+    g_app_data_model.get_chat_sync().dump_stats("<ChatCube$ChoicesDir>.netstats", "ab");
+    g_app_data_model.dump_messages_stats("<ChatCube$ChoicesDir>.netstats", "ab");
     IKConfig::stop();
 
     remove_recursive("<ChatCube$ChoicesDir>.temp");
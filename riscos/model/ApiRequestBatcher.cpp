@@ -0,0 +1,152 @@
+#include <cloverleaf/Logger.h>
+#include <cloverleaf/IdleTask.h>
+#include "ApiRequestBatcher.h"
+#include "JsonData.h"
+#include "../utils.h"
+
+static char _batch_url[] = "/batch/";
+
+void ApiRequestBatcher::submit(CLChatApiRequest* req) {
+    _stats.calls++;
+    req->websocket_allowed = true;
+    if (_unsupported) {
+        _stats.single++;
+        g_http_service.submit(req);
+        return;
+    }
+    _queued.push_back(req);
+    _schedule_flush();
+}
+
+void ApiRequestBatcher::mark_seen(const std::string& chat_id, int64_t message_id) {
+    _stats.calls++;
+    auto found = _seen_by_chat.find(chat_id);
+    if (found != _seen_by_chat.end()) {
+        _stats.seen_collapsed++;
+        if (found->second >= message_id) {
+            return;
+        }
+    }
+    _seen_by_chat[chat_id] = message_id;
+    _schedule_flush();
+}
+
+void ApiRequestBatcher::clear() {
+    for (auto req : _queued) {
+        delete req;
+    }
+    _queued.clear();
+    _seen_by_chat.clear();
+}
+
+void ApiRequestBatcher::_schedule_flush() {
+    if (!_flush_scheduled) {
+        _flush_scheduled = true;
+        g_idle_task.run_at_next_idle([this]() {
+            _flush_scheduled = false;
+            _flush();
+        });
+    }
+}
+
+void ApiRequestBatcher::_flush() {
+    std::vector<CLChatApiRequest*> items;
+    items.swap(_queued);
+    for (auto &seen : _seen_by_chat) {
+        auto *req = new CLChatApiRequest("GET", "/chat/" + seen.first + "/messages/" + to_string(seen.second) + "/seen/");
+        req->websocket_allowed = true;
+        items.push_back(req);
+    }
+    _seen_by_chat.clear();
+
+    for (size_t start = 0; start < items.size(); start += API_BATCH_MAX_CALLS) {
+        size_t end = std::min(items.size(), start + API_BATCH_MAX_CALLS);
+        // over open websocket each call is just a message, joining them saves nothing
+        if (end - start == 1 || _unsupported || g_http_service.websocket_open()) {
+            for (size_t i = start; i < end; i++) {
+                _stats.single++;
+                g_http_service.submit(items[i]);
+            }
+        } else {
+            _send_batch(std::vector<CLChatApiRequest*>(items.begin() + start, items.begin() + end));
+        }
+    }
+}
+
+void ApiRequestBatcher::_send_batch(const std::vector<CLChatApiRequest*>& items) {
+    cJSON *calls = cJSON_CreateArray();
+    for (auto item : items) {
+        cJSON *call = cJSON_CreateObject();
+        cJSON_AddStringToObject(call, "method", item->method.c_str());
+        cJSON_AddStringToObject(call, "path", item->url.c_str());
+        cJSON *data = cJSON_AddObjectToObject(call, "data");
+        for (auto &field : item->post_data) {
+            cJSON_AddStringToObject(data, field.first.c_str(), field.second.c_str());
+        }
+        cJSON_AddItemToArray(calls, call);
+    }
+    char *calls_str = cJSON_PrintUnformatted(calls);
+    cJSON_Delete(calls);
+
+    auto on_success = [items](CLHTTPRequest* req) {
+        const cJSON *results = JsonData::get_json_array(req->response_json, "results");
+        for (size_t i = 0; i < items.size(); i++) {
+            const cJSON *result = results ? cJSON_GetArrayItem(results, i) : nullptr;
+            if (!result) {
+                _deliver(items[i], req, 0, "Missing result in batch response");
+                continue;
+            }
+            const cJSON *body = JsonData::get_json_object_or_null(result, "body");
+            std::string body_text;
+            if (body) {
+                char *str = cJSON_PrintUnformatted(body);
+                body_text = str;
+                free(str);
+            }
+            _deliver(items[i], req, JsonData::get_int_value(result, "status", 0), std::move(body_text));
+        }
+    };
+    auto on_fail = [this, items](const HttpRequestError& err) {
+        if (err.http_code == 404) {
+            Logger::warn("ApiRequestBatcher: server has no /batch/, calls are sent one by one");
+            _unsupported = true;
+            for (auto item : items) {
+                _stats.single++;
+                g_http_service.submit(item);
+            }
+            return true;
+        }
+        // each caller gets the failure as if its own request failed
+        for (auto item : items) {
+            _deliver(item, nullptr, err.http_code, err.error_message);
+        }
+        return true;
+    };
+    auto *req = new CLChatApiRequest("POST", "/batch/", on_success, on_fail);
+    req->post_data["calls"] = calls_str;
+    free(calls_str);
+    _stats.batches++;
+    _stats.batched_calls += items.size();
+    Logger::debug("ApiRequestBatcher: %u calls in one batch", (unsigned) items.size());
+    g_http_service.submit(req);
+}
+
+void ApiRequestBatcher::_deliver(CLChatApiRequest* item, CLHTTPRequest* batch_req, int response_code, std::string response_text) {
+    item->response_url = (batch_req && batch_req->response_url) ? batch_req->response_url : _batch_url;
+    item->response_code = response_code;
+    item->response_text = std::move(response_text);
+    item->process_response();
+    delete item;
+}
+
+bool ApiRequestBatcher::dump_stats(const char* file_name, const char* mode) {
+    FILE *f = fopen(file_name, mode);
+    if (!f) {
+        return false;
+    }
+    fprintf(f, "api batcher: calls:%lu seen_collapsed:%lu batches:%lu batched_calls:%lu single:%lu round_trips_saved:%lu%s\n",
+            _stats.calls, _stats.seen_collapsed, _stats.batches, _stats.batched_calls, _stats.single,
+            _stats.batched_calls - _stats.batches + _stats.seen_collapsed, _unsupported ? " (unsupported by server)" : "");
+    fclose(f);
+    return true;
+}
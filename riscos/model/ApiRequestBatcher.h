@@ -0,0 +1,48 @@
+/* ApiRequestBatcher.h
+
+   Small fire-and-forget API calls (chat open, mark seen, chat action, forward) made during one
+   pass of event loop are sent together as one POST /batch/ request. Result of each call is passed
+   to callbacks of its own request as if it was sent alone. Mark seen calls of one chat are
+   collapsed to the highest message id.
+
+ */
+
+#ifndef ROCHAT_APIREQUESTBATCHER_H
+#define ROCHAT_APIREQUESTBATCHER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include "NetworkRequests.h"
+
+#define API_BATCH_MAX_CALLS 20 // server limit of calls in one batch
+
+struct ApiRequestBatcherStats {
+    unsigned long calls = 0;            // requests passed to batcher
+    unsigned long seen_collapsed = 0;   // mark seen calls dropped in favour of newer message of same chat
+    unsigned long batches = 0;          // /batch/ requests sent
+    unsigned long batched_calls = 0;    // calls sent inside batches, batched_calls - batches round trips saved
+    unsigned long single = 0;           // sent alone as there was nothing to join
+};
+
+class ApiRequestBatcher {
+private:
+    std::vector<CLChatApiRequest*> _queued;
+    std::map<std::string, int64_t> _seen_by_chat;
+    bool _flush_scheduled = false;
+    bool _unsupported = false;          // server without /batch/, calls go one by one
+    ApiRequestBatcherStats _stats;
+    void _schedule_flush();
+    void _flush();
+    void _send_batch(const std::vector<CLChatApiRequest*>& items);
+    static void _deliver(CLChatApiRequest* item, CLHTTPRequest* batch_req, int response_code, std::string response_text);
+public:
+    void submit(CLChatApiRequest* req); // takes ownership, request must not need progress or files
+    void mark_seen(const std::string& chat_id, int64_t message_id);
+    void clear();
+    const ApiRequestBatcherStats& get_stats() { return _stats; }
+    bool dump_stats(const char* file_name, const char* mode="w");
+};
+
+#endif //ROCHAT_APIREQUESTBATCHER_H
@@ -14,6 +14,7 @@
 #include "AppDataModel.h"
 #include "AppEvents.h"
 #include "NetworkRequests.h"
+#include "FileChunkedUpload.h"
 #include "ChatData.h"
 #include "ChatMemberData.h"
 #include "MessageData.h"
@@ -37,6 +38,7 @@ void AppDataModel::init(const std::string& baseUrl, const std::string &lang, con
         g_app_events.listen<AppEvents::MemberChanged>(std::bind(&AppDataModel::on_member_changed, this, _1));
         g_app_events.listen<AppEvents::MemberLoaded>(std::bind(&AppDataModel::on_member_loaded, this, _1));
         g_app_events.listen<AppEvents::TelegramReady>(std::bind(&AppDataModel::on_telegram_ready, this, _1));
+        g_app_events.listen<AppEvents::ConnectionStateChanged>(std::bind(&AppDataModel::on_connection_state_changed, this, _1));
         initialized = true;
     }
 }
@@ -82,6 +84,7 @@ void AppDataModel::start() {
                 };
                 auto *req = new CLChatApiRequest("GET", "/profile/my/", on_my_profile_loaded);
                 req->set_url_parameters(getData);
+                req->set_response_cache(true);
                 req->needs_progress = true;
 
                 AppEvents::ProgressBarControl pbreq;
@@ -161,6 +164,7 @@ void AppDataModel::start() {
 
 
     auto *req = new CLChatApiRequest("GET", "/initial/", on_initial_data_load);
+    req->set_response_cache(true);
     req->needs_progress = true;
 
     AppEvents::ProgressBarControl pbreq;
@@ -199,6 +203,7 @@ void AppDataModel::upload_profile_image(const std::string& file_path, const char
     auto *req = new CLChatApiRequest("POST", "/profile/my/", success_callback);
     req->upload_files[field_name] = file_path;
     req->needs_progress = true;
+    req->set_priority(HTTP_PRIORITY_FOREGROUND_MEDIA);
     g_http_service.submit(req);
 }
 
@@ -218,107 +223,96 @@ ChatDataPtr AppDataModel::get_chat(const std::string& chat_id) {
     return nullptr;
 }
 
+void AppDataModel::set_chat_order_key(ChatData* chat) {
+    ChatOrderKey &key = chat->order_key;
+    key.group = 0;
+    key.has_last_message = false;
+    key.last_message_time = 0;
+    if (chats_list_ordering == CHATS_LIST_ORDERING_ONLINE) {
+        key.group = chat->is_online() ? 0 : (chat->is_member_active() ? 1 : 2);
+    } else if (chats_list_ordering == CHATS_LIST_ORDERING_MEMBER_NAME) {
+        key.group = chat->unread_count > 0 ? 0 : 1;
+    }
+    if (chats_list_ordering != CHATS_LIST_ORDERING_MEMBER_NAME && chat->last_message != nullptr) {
+        key.has_last_message = true;
+        key.last_message_time = chat->last_message->sendtime;
+    }
+    key.title_key = chat->title_key;
+}
+
+// chat will be placed again in chats list by next get_chats_list(), instead of sorting whole list
+void AppDataModel::reorder_chat(const ChatDataPtr& chat) {
+    if (chats_list_needs_reorder || chat->order_dirty) {
+        return;
+    }
+    chat->order_dirty = true;
+    _chats_reorder.push_back(chat);
+}
+
 std::vector<ChatDataPtr>& AppDataModel::get_chats_list() {
     if (_chats_list.empty()) {
         chats_list_needs_reorder = true;
     }
     if (chats_list_needs_reorder) {
+        for (auto &chat : _chats_reorder) {
+            chat->order_dirty = false;
+        }
+        _chats_reorder.clear();
         _chats_list.clear();
         _chats_list.reserve(_chats_map.size());
-        int i = 0;
-//        Logger::debug("size %d %d", _chats_map.size(), _chats_list.size());
         for(auto item: _chats_map) {
-//            Logger::debug("_chats_list.push_back chat %p key=%s %d", item.second.get(), item.first.c_str(), i);
             if (_chats_filter_title.empty()
                 || utf8casestr(item.second->title.c_str(), _chats_filter_title.c_str()) != NULL) {
+                set_chat_order_key(item.second.get());
                 _chats_list.push_back(item.second);
             }
-            i++;
         }
-        if (chats_list_ordering == CHATS_LIST_ORDERING_LAST_MESSAGE) {
-            std::sort(_chats_list.begin(), _chats_list.end(), [](const ChatDataPtr &a, const ChatDataPtr &b) -> bool {
-//                if (a == b) {
-//                    Logger::debug("SAME sort chat a=%p chat b=%p", a.get(), b.get());
-//                }
-                MessageDataPtr &a_msg = a->last_message;
-                MessageDataPtr &b_msg = b->last_message;
-                bool has_a = (a_msg != nullptr);
-                bool has_b = (b_msg != nullptr);
-                if (has_a && has_b) {
-                    return (a_msg->sendtime > b_msg->sendtime);
-                }
-                if (has_a) {
-                    return true;
-                }
-                if (has_b) {
-                    return false;
-                }
-//                if (a->unread_count > 0 && b->unread_count == 0) {
-//                    return true;
-//                }
-//                if (b->unread_count > 0 && a->unread_count == 0) {
-//                    return false;
-//                }
-                return (utf8casecmp(a->title.c_str(), b->title.c_str()) < 0);
-            });
-        } else if (chats_list_ordering == CHATS_LIST_ORDERING_ONLINE) {
-            std::sort(_chats_list.begin(), _chats_list.end(), [](const ChatDataPtr &a, const ChatDataPtr &b) -> bool {
-                //Logger::debug("a onl %d b onl %d", a->is_online(), b->is_online());
-                if (a == b) {
-                    Logger::debug("SAME sort chat a=%p chat b=%p", a.get(), b.get());
-                }
-                MessageDataPtr &a_msg = a->last_message;
-                MessageDataPtr &b_msg = b->last_message;
-                bool a_online = a->is_online();
-                bool b_online = b->is_online();
-                bool a_active = a->is_member_active();
-                bool b_active = b->is_member_active();
-                //Logger::debug("a1 onl %d b onl %d", a->is_online(), b->is_online());
-                if (a_online && !b_online) {
-//                    Logger::debug("%s online %s not online", a->title.c_str(), b->title.c_str());
-                    return true;
-                }
-                if (!a_online && b_online) {
-//                    Logger::debug("%s online %s not online", a->title.c_str(), b->title.c_str());
-                    return false;
-                }
-                if (a_active && !b_active) {
-                    return true;
-                }
-                if (!a_active && b_active) {
-//                    Logger::debug("%s online %s not online", a->title.c_str(), b->title.c_str());
-                    return false;
-                }
-                bool has_a_msg = (a_msg != nullptr);
-                bool has_b_msg = (b_msg != nullptr);
-                if (has_a_msg && has_b_msg) {
-                    return (a_msg->sendtime > b_msg->sendtime);
-                }
-                if (has_a_msg) {
-                    return true;
-                }
-                if (has_b_msg) {
-                    return false;
-                }
-                return (utf8casecmp(a->title.c_str(), b->title.c_str()) < 0);
-            });
-        } else if (chats_list_ordering == CHATS_LIST_ORDERING_MEMBER_NAME) {
-            std::sort(_chats_list.begin(), _chats_list.end(), [](const ChatDataPtr &a, const ChatDataPtr &b) -> bool {
-                if (a->unread_count > 0 && b->unread_count == 0) {
-                    return true;
-                }
-                if (a->unread_count == 0 && b->unread_count > 0) {
-                    return false;
-                }
-                return (utf8casecmp(a->title.c_str(), b->title.c_str()) < 0);
-            });
-        }
-
+        std::sort(_chats_list.begin(), _chats_list.end(), chat_order_less);
         chats_list_needs_reorder = false;
+    } else if (!_chats_reorder.empty()) {
+        for (auto &chat : _chats_reorder) {
+            chat->order_dirty = false;
+            // key of chat is still the one it was placed by, so it is found by binary search
+            auto pos = std::lower_bound(_chats_list.begin(), _chats_list.end(), chat, chat_order_less);
+            if (pos != _chats_list.end() && *pos == chat) {
+                _chats_list.erase(pos);
+            }
+            if (get_chat(chat->id) != chat) {
+                continue; // deleted
+            }
+            if (_chats_filter_title.empty()
+                || utf8casestr(chat->title.c_str(), _chats_filter_title.c_str()) != NULL) {
+                set_chat_order_key(chat.get());
+                _chats_list.insert(std::upper_bound(_chats_list.begin(), _chats_list.end(), chat, chat_order_less), chat);
+            }
+        }
+        _chats_reorder.clear();
     }
     return _chats_list;
 }
 
+bool AppDataModel::dump_messages_stats(const char* file_name, const char* mode) {
+    unsigned long count = 0, bytes = 0;
+    for (auto &item : _chats_map) {
+        ChatDataPtr &chat = item.second;
+        for (auto &msg : chat->messages) {
+            count++;
+            bytes += msg->get_memory_size();
+        }
+        if (chat->last_message && chat->messages.index_of(chat->last_message) < 0) {
+            count++;
+            bytes += chat->last_message->get_memory_size();
+        }
+    }
+    FILE *f = fopen(file_name, mode);
+    if (!f) {
+        return false;
+    }
+    fprintf(f, "messages: count:%lu bytes:%lu per_message:%lu\n", count, bytes, count ? bytes / count : 0);
+    fclose(f);
+    return true;
+}
+
 void AppDataModel::set_chats_list_ordering(int new_ordering) {
     chats_list_ordering = new_ordering;
     chats_list_needs_reorder = true;
@@ -340,7 +334,7 @@ void AppDataModel::filter_chats(const std::string& search_for) {
 }
 
 MessageDataPtr AppDataModel::make_instant_outgoing_message(int type, const std::string& text, int reply_to_id) {
-    MessageDataPtr msg = make_shared<MessageData>();
+    MessageDataPtr msg = make_message_data();
     msg->chat = currently_opened_chat;
     msg->flags = MESSAGE_FLAG_OUTGOING;
     msg->type = type;
@@ -351,71 +345,197 @@ MessageDataPtr AppDataModel::make_instant_outgoing_message(int type, const std::
     return msg;
 }
 
-void AppDataModel::send_message(const CLStringsMap& post_data, MessageDataPtr instant_nessage) {
-    auto on_send_callback = [this](CLHTTPRequest* req) {
-//        this->update_or_create_message_data(response_json, false);
-        if (currently_opened_chat->has_newer_messages()) { // if we in the muddle of history then load latest messages
-            load_messages_in_chat(currently_opened_chat, false, 0);
+MessageDataPtr AppDataModel::make_queued_instant_message(const ChatDataPtr chat, OutgoingMessage& om) {
+    int type = string_to_int(om.post_data["type"]);
+    MessageDataPtr msg = make_instant_outgoing_message(type, om.post_data["text"], string_to_int(om.post_data["reply_to_id"]));
+    msg->chat = chat;
+    msg->sendtime = om.queued_at;
+    if (type == MESSAGE_TYPE_STICKER) {
+        msg->text.clear();
+        msg->att_image = new AttachmentImage();
+        msg->att_image->url = om.post_data["text"];
+        msg->att_image->thumb_url_cached = om.thumb;
+        msg->att_image->thumb_height = msg_STICKER_THUMB_HEIGHT;
+        msg->att_image->thumb_width = msg_STICKER_THUMB_WIDTH;
+    } else if (type == MESSAGE_TYPE_PHOTO) {
+        msg->att_image = new AttachmentImage();
+        msg->att_image->size = get_filesize(om.file_path.c_str());
+        msg->text = "Photo";
+    } else if (type == MESSAGE_TYPE_FILE) {
+        msg->att_file = new AttachmentFile();
+        msg->att_file->name = om.post_data["file_name"];
+        msg->att_file->file_type = string_to_int(om.post_data["file_type"]);
+        msg->att_file->size = get_filesize(om.file_path.c_str());
+        msg->text = msg->att_file->name;
+    }
+    return msg;
+}
+
+// every message goes through send queue, it stays there on disk until server accepts it
+void AppDataModel::send_message(const CLStringsMap& post_data, MessageDataPtr instant_nessage, const std::string& file_path) {
+    restore_send_queue();
+    ChatDataPtr chat = currently_opened_chat;
+    std::string thumb;
+    if (instant_nessage->type == MESSAGE_TYPE_STICKER && instant_nessage->att_image) {
+        thumb = instant_nessage->att_image->thumb_url_cached;
+    }
+    auto queue_message = [this, chat, post_data, instant_nessage, file_path, thumb]() {
+        if (_send_queue.add(chat->id, post_data, file_path, thumb, instant_nessage) == nullptr) {
+            show_alert_error(("Can't send file " + file_path + ", it can't be read").c_str());
+            return;
         }
+        append_pending_outgoing_message(instant_nessage);
+        drain_send_queue();
     };
-    auto on_fail = [this, instant_nessage](const HttpRequestError& err) {
-        remove_pending_outgoing_message(instant_nessage);
-        return false;
-    };
-
-    auto *req = new CLChatApiRequest("POST", "/chat/send/", on_send_callback, on_fail);
-    req->post_data = post_data;
-    if (currently_opened_chat->has_newer_messages()) {
-        auto send_after_success_load = [this, req, instant_nessage]() {
-            g_http_service.submit(req);
-            append_pending_outgoing_message(instant_nessage);
-        };
-        auto clean_after_fail_load = [req]() {
-            delete req;
-        };
-        load_messages_in_chat(currently_opened_chat, 0, 0, send_after_success_load, clean_after_fail_load);
+    if (chat->has_newer_messages()) { // if we in the muddle of history then load latest messages first
+        load_messages_in_chat(chat, 0, 0, queue_message, [](){});
     } else {
-        g_http_service.submit(req);
-        append_pending_outgoing_message(instant_nessage);
+        queue_message();
+    }
+}
+
+// messages left unsent by previous run, shown as pending again and sent when chats are known
+void AppDataModel::restore_send_queue() {
+    if (_send_queue.is_loaded() || me == nullptr) {
+        return;
+    }
+    _send_queue.load(me->id);
+    for (auto &om : _send_queue.get_items()) {
+        ChatDataPtr chat = get_chat(om.chat_id);
+        if (chat != nullptr) {
+            om.instant_message = make_queued_instant_message(chat, om);
+            append_pending_outgoing_message(om.instant_message);
+        }
     }
 }
 
-void AppDataModel::send_message_upload_file(const CLStringsMap& post_data, const char* field_name, const std::string & file_name, MessageDataPtr instant_nessage) {
-    auto on_send_callback = [this](CLHTTPRequest* req) {
-        this->update_or_create_message_data(req->response_json, nullptr, false, true, false);
+void AppDataModel::drain_send_queue() {
+    if (!is_logged_in() || !is_chat_list_loaded || !_send_queue.is_loaded()) {
+        return;
+    }
+    for (OutgoingMessage *om : _send_queue.get_ready()) {
+        send_queued_message(om);
+    }
+}
+
+// each poll tick: sends messages whose retry delay is over, returns cs until next one is due or -1
+int AppDataModel::process_send_queue_retries() {
+    if (!is_logged_in() || !is_chat_list_loaded || !_send_queue.is_loaded()) {
+        return -1;
+    }
+    int delay = _send_queue.next_retry_delay_cs();
+    if (delay == 0) {
+        drain_send_queue();
+        delay = _send_queue.next_retry_delay_cs();
+    }
+    return delay;
+}
+
+void AppDataModel::send_queued_message(OutgoingMessage* om) {
+    // callbacks find message by seq, queue may be cleared by logout while request is running
+    unsigned long seq = om->seq;
+    bool with_file = !om->file_path.empty();
+    om->in_flight = true;
+    om->attempts++;
+
+    auto on_send_callback = [this, seq, with_file](CLHTTPRequest* req) {
+        _send_queue.remove(seq, true);
+        if (with_file) {
+            this->update_or_create_message_data(req->response_json, nullptr, false, true, false);
+        } else if (currently_opened_chat && currently_opened_chat->has_newer_messages()) {
+            load_messages_in_chat(currently_opened_chat, false, 0);
+        }
+        drain_send_queue();
     };
-    auto on_fail = [this, instant_nessage](const HttpRequestError& err) {
-        remove_pending_outgoing_message(instant_nessage);
-        return false;
+    auto on_fail = [this, seq](const HttpRequestError& err) {
+        return on_queued_message_failed(seq, err);
     };
     auto *req = new CLChatApiRequest("POST", "/chat/send/", on_send_callback, on_fail);
-    req->post_data = post_data;
-    req->upload_files[field_name] = file_name;
-    req->set_timeout(0);
-    req->set_lowspeed_limit(30,10);
-    req->needs_progress = true;
+    req->post_data = om->post_data;
+    if (!with_file) {
+        req->websocket_allowed = true;
+        g_http_service.submit(req);
+        return;
+    }
+    if (!om->upload_id.empty()) {
+        // file was uploaded by earlier attempt, only send failed
+        req->post_data["upload_id"] = om->upload_id;
+        req->set_priority(HTTP_PRIORITY_FOREGROUND_MEDIA);
+        g_http_service.submit(req);
+        return;
+    }
 
+    req->needs_progress = true;
+    req->set_priority(HTTP_PRIORITY_FOREGROUND_MEDIA);
     AppEvents::ProgressBarControl pbreq;
     pbreq.label = "Uploading file";
     pbreq.req = req;
     g_app_events.notify(pbreq);
 
-    if (currently_opened_chat->has_newer_messages()) {
-        auto send_after_success_load = [this, req, instant_nessage]() {
-            g_http_service.submit(req);
-            append_pending_outgoing_message(instant_nessage);
-        };
-        auto clean_after_fail_load = [req]() {
-            // hide progress bar as label is empty
-            AppEvents::ProgressBarControl pbreq;
-            pbreq.req = req;
-            g_app_events.notify(pbreq);
-            delete req;
-        };
-        load_messages_in_chat(currently_opened_chat, 0, 0, send_after_success_load, clean_after_fail_load);
-    } else {
+    // file goes in acknowledged parts first, message is sent with upload_id of completed upload
+    auto on_uploaded = [this, seq, req](const std::string& upload_id) {
+        // upload session is removed when completed, queue keeps its id for repeated sends
+        _send_queue.set_upload_id(seq, upload_id);
+        req->post_data["upload_id"] = upload_id;
         g_http_service.submit(req);
-        append_pending_outgoing_message(instant_nessage);
+    };
+    auto on_upload_fail = [this, seq, req](const HttpRequestError& err) {
+        // hide progress bar as label is empty
+        AppEvents::ProgressBarControl pbreq;
+        pbreq.req = req;
+        g_app_events.notify(pbreq);
+        delete req;
+        return on_queued_message_failed(seq, err);
+    };
+    auto *upload = new FileChunkedUpload(om->file_path, om->file_name, req, on_uploaded, on_upload_fail);
+    upload->start();
+}
+
+bool AppDataModel::on_queued_message_failed(unsigned long seq, const HttpRequestError& err) {
+    OutgoingMessage *om = _send_queue.find(seq);
+    if (om == nullptr) {
+        return true;
+    }
+    // local failure (queue copy of file is gone) won't go away by sending again
+    bool local_error = err.error_code == CHUNKED_UPLOAD_ERROR_NO_FILE || (!om->file_path.empty() && !is_file_exist(om->file_path));
+    bool may_retry = !local_error && om->attempts < SEND_QUEUE_MAX_ATTEMPTS;
+    if (err.http_code == 0 && may_retry) {
+        // no connection, message stays pending and goes again after reconnect
+        Logger::warn("AppDataModel send of queued message %lu postponed: %s", seq, err.error_message.c_str());
+        _send_queue.requeue(seq);
+        return true;
+    }
+    if ((err.http_code >= 500 || err.http_code == 429) && may_retry) {
+        // server restarting or overloaded, only 4xx means message itself is rejected
+        Logger::warn("AppDataModel send of queued message %lu retried later: HTTP %d", seq, err.http_code);
+        _send_queue.retry_later(seq);
+        return true;
+    }
+    if (err.http_code == 404 && !om->upload_id.empty() && may_retry) {
+        // completed upload expired on server before message was accepted, file is uploaded again
+        Logger::warn("AppDataModel upload %s of queued message %lu not found, uploading again", om->upload_id.c_str(), seq);
+        _send_queue.set_upload_id(seq, "");
+        _send_queue.retry_later(seq);
+        return true;
+    }
+    Logger::error("AppDataModel queued message %lu dropped after %d attempts: %s", seq, om->attempts, err.error_message.c_str());
+    if (om->instant_message) {
+        remove_pending_outgoing_message(om->instant_message);
+    }
+    _send_queue.remove(seq, false);
+    drain_send_queue();
+    if (err.http_code == 0 || err.http_code >= 500 || err.http_code == 429) {
+        // default handler would tell about connection problem
+        show_alert_error(("Message could not be sent: " + err.error_message).c_str());
+        return true;
+    }
+    return false;
+}
+
+void AppDataModel::on_connection_state_changed(const AppEvents::ConnectionStateChanged& ev) {
+    if (ev.connected) {
+        _send_queue.set_connected();
+        drain_send_queue();
     }
 }
 
@@ -467,7 +587,7 @@ void AppDataModel::send_message_photo(const std::string& photo_file, const std::
     msg->att_image = new AttachmentImage();
     msg->att_image->size = get_filesize(photo_file.c_str());
     msg->text = "Photo";
-    send_message_upload_file(postData, "file", photo_file, msg);
+    send_message(postData, msg, photo_file);
 }
 
 void AppDataModel::send_message_file(const std::string& file_path, const std::string& caption, const int file_type, int reply_to_id) {
@@ -493,7 +613,7 @@ void AppDataModel::send_message_file(const std::string& file_path, const std::st
     msg->att_file->size = get_filesize(file_path.c_str());
     msg->text = filename;
 
-    send_message_upload_file(postData, "file", file_path, msg);
+    send_message(postData, msg, file_path);
 }
 
 void AppDataModel::send_message_text_to_member(const string &member_id, const string& text) {
@@ -523,7 +643,7 @@ void AppDataModel::send_chat_action(int action) {
         req->post_data = {
                 {"action", to_string(action)}
         };
-        g_http_service.submit(req);
+        _api_batcher.submit(req);
     }
 }
 
@@ -566,7 +686,7 @@ void AppDataModel::mark_seen_last_message(const ChatDataPtr& chat) {
         for(int i = chat->messages.size() - 1; i >= 0; --i) {
 //            Logger::debug("chat->messages[%d].out = %d id=%lld", i, chat->messages[i]->is_outgoing(), chat->messages[i]->id);
             if (!chat->messages[i]->is_outgoing()) {
-                g_http_service.submit(new CLChatApiRequest("GET", "/chat/" + chat->id + "/messages/" + to_string(chat->messages[i]->id) + "/seen/"));
+                _api_batcher.mark_seen(chat->id, chat->messages[i]->id);
                 break;
             }
         }
@@ -575,24 +695,10 @@ void AppDataModel::mark_seen_last_message(const ChatDataPtr& chat) {
 
 void AppDataModel::mark_seen_message(const MessageDataPtr& msg) {
     ChatDataPtr chat = msg->get_chat();
-    // find latest incoming message and mark it as seen
+    // messages seen while scrolling are collapsed by batcher to the latest one of chat
     if (chat && !msg->is_outgoing() && chat->incoming_seen_message_id < msg->id) {
-        if (!marking_seen_msg || marking_seen_msg->id < msg->id) {
-            if (!marking_seen_msg) {
-                auto do_mark_seen = [this]() {
-                    if (this->marking_seen_msg) {
-                        ChatDataPtr chat = marking_seen_msg->get_chat();
-                        if (chat) {
-                            chat->incoming_seen_message_id = marking_seen_msg->id;
-                            g_http_service.submit(new CLChatApiRequest("GET", "/chat/" + chat->id + "/messages/" + to_string(marking_seen_msg->id) + "/seen/"));
-                        }
-                        marking_seen_msg = nullptr;
-                    }
-                };
-                g_idle_task.run_at_next_idle(do_mark_seen);
-            }
-            marking_seen_msg = msg;
-        }
+        chat->incoming_seen_message_id = msg->id;
+        _api_batcher.mark_seen(chat->id, msg->id);
     }
 }
 
@@ -642,14 +748,18 @@ void AppDataModel::on_member_changed(const AppEvents::MemberChanged& ev) {
             changes |= CHAT_CHANGES_PIC_SMALL;
         }
         if (ev.changes & MEMBER_CHANGES_PROFILE && chat->title != ev.mem->displayname) {
-            chat->title = ev.mem->displayname;
+            chat->set_title(ev.mem->displayname);
             changes |= CHAT_CHANGES_TITLE;
+            if (chats_list_ordering == CHATS_LIST_ORDERING_MEMBER_NAME) {
+                reorder_chat(chat);
+                ordering_changed = true;
+            }
         }
         if (ev.changes & MEMBER_CHANGES_ONLINE) {
             changes |= CHAT_CHANGES_ONLINE;
-            ordering_changed = (chats_list_ordering == CHATS_LIST_ORDERING_ONLINE);
-            if (ordering_changed) {
-                chats_list_needs_reorder = true;
+            if (chats_list_ordering == CHATS_LIST_ORDERING_ONLINE) {
+                reorder_chat(chat);
+                ordering_changed = true;
             }
         }
         if (changes) {
@@ -691,17 +801,14 @@ void AppDataModel::delete_messages(ChatDataPtr chat, const std::vector<MessageDa
         bool last_message_deleted = false;
 
         for(auto msg : msgs) {
-            for(int i = 0; i < chat->messages.size(); i++) {
-                if (msg == chat->messages[i]) {
-                    if (chat == currently_opened_chat) {
-                        g_app_events.notify<AppEvents::MessageDeleted>({.chat = chat, .msg = chat->messages[i]});
-                    }
-                    if (chat->last_message->id == msg->id) {
-                        last_message_deleted = true;
-                    }
-                    chat->messages.erase(chat->messages.begin() + i);
-                    break;
+            if (chat->messages.index_of(msg) >= 0) {
+                if (chat == currently_opened_chat) {
+                    g_app_events.notify<AppEvents::MessageDeleted>({.chat = chat, .msg = msg});
                 }
+                if (chat->last_message->id == msg->id) {
+                    last_message_deleted = true;
+                }
+                chat->messages.erase(msg);
             }
         }
         if (last_message_deleted) {
@@ -891,7 +998,7 @@ void AppDataModel::forward_message(const std::vector<ChatDataPtr> &chats, const
         {"chat_ids", forward_to_chat_ids},
         {"msg_id", to_string(msg->id)},
     };
-    g_http_service.submit(req);
+    _api_batcher.submit(req);
 }
 
 void AppDataModel::update_app() {
@@ -934,6 +1041,8 @@ void AppDataModel::update_app() {
     };
     auto *req = new CLDownloadFileRequest(url, on_success_download, on_fail_download);
     req->needs_progress = true;
+    req->set_resumable(true);
+    req->set_priority(HTTP_PRIORITY_BULK);
     g_http_service.submit(req);
 
     AppEvents::ProgressBarControl pbreq;
@@ -969,6 +1078,7 @@ void AppDataModel::set_chat_photo(const std::string& chat_id, const std::string&
     req->set_timeout(0);
     req->set_lowspeed_limit(30,10);
     req->needs_progress = true;
+    req->set_priority(HTTP_PRIORITY_FOREGROUND_MEDIA);
     g_http_service.submit(req);
 }
 
@@ -1013,14 +1123,14 @@ void AppDataModel::append_pending_outgoing_message(MessageDataPtr msg) {
         Logger::error("AppDataModel::append_pending_outgoing_message chat==null");
         return;
     }
-    chat->messages.push_back(msg);
+    chat->messages.insert(msg);
     chat->messages_pending_outgoing.push_back(msg);
     chat->last_message = msg;
     if (chats_list_ordering == CHATS_LIST_ORDERING_LAST_MESSAGE) {
-        chats_list_needs_reorder = true;
+        reorder_chat(chat);
     }
     g_app_events.notify(AppEvents::MessageAdded{.chat=msg->get_chat(), .msg=msg});
-    g_app_events.notify(AppEvents::ChatChanged{.chat=msg->get_chat(), .ordering_changed=chats_list_needs_reorder, .changes=CHAT_CHANGES_LAST_MSG});
+    g_app_events.notify(AppEvents::ChatChanged{.chat=msg->get_chat(), .ordering_changed=is_chats_list_reorder_pending(), .changes=CHAT_CHANGES_LAST_MSG});
 }
 
 
@@ -1031,7 +1141,7 @@ void AppDataModel::remove_pending_outgoing_message(MessageDataPtr msg) {
         return;
     }
     MessagesVector& messages_pending_outgoing = chat->messages_pending_outgoing;
-    MessagesVector& messages = chat->messages;
+    ChatMessages& messages = chat->messages;
 
     if (!messages_pending_outgoing.empty()) {
         for (size_t i = messages_pending_outgoing.size() - 1; i >= 0; --i) {
@@ -1041,13 +1151,9 @@ void AppDataModel::remove_pending_outgoing_message(MessageDataPtr msg) {
                 break;
             }
         }
-        for (size_t i = messages.size() - 1; i >= 0; --i) {
-            if (messages[i] == msg) {
-//                Logger::debug("Deleted messages message %s", msg->text.c_str());
-                messages.erase(messages.begin() + i);
-                g_app_events.notify(AppEvents::MessageDeleted { .chat = chat, .msg = msg });
-                break;
-            }
+        if (messages.erase(msg)) {
+//            Logger::debug("Deleted messages message %s", msg->text.c_str());
+            g_app_events.notify(AppEvents::MessageDeleted { .chat = chat, .msg = msg });
         }
     }
     if (chat->last_message == msg) {
@@ -1057,9 +1163,9 @@ void AppDataModel::remove_pending_outgoing_message(MessageDataPtr msg) {
             chat->last_message = nullptr;
         }
         if (chats_list_ordering == CHATS_LIST_ORDERING_LAST_MESSAGE) {
-            chats_list_needs_reorder = true;
+            reorder_chat(chat);
         }
-        g_app_events.notify(AppEvents::ChatChanged{.chat=msg->get_chat(), .ordering_changed=chats_list_needs_reorder, .changes=CHAT_CHANGES_LAST_MSG});
+        g_app_events.notify(AppEvents::ChatChanged{.chat=msg->get_chat(), .ordering_changed=is_chats_list_reorder_pending(), .changes=CHAT_CHANGES_LAST_MSG});
     }
 }
 
@@ -1074,7 +1180,7 @@ void AppDataModel::delete_account() {
 
 
 void AppDataModel::search_in_chat(ChatDataPtr chat, std::string query_utf8, int filter, int64_t starting_from_msg_id, const std::function<void(MessageDataPtr msg)> &callback) {
-    MessagesVector &messages = chat->messages;
+    ChatMessages &messages = chat->messages;
     int idx, starting_from_msg_index, messages_count = messages.size();
 
     if (messages_count == 0) {
@@ -1108,11 +1214,11 @@ void AppDataModel::search_in_chat(ChatDataPtr chat, std::string query_utf8, int
             callback(nullptr);
             return;
         }
-        chat->messages.clear();
+        reset_chat_messages(chat, false);
         append_loaded_messages(chat, response_json);
 
         int idx;
-        MessagesVector &messages = chat->messages;
+        ChatMessages &messages = chat->messages;
         int messages_count = messages.size();
         for(idx = messages_count - 1; idx >= 0; idx--) {
             if (messages[idx]->is_filter_and_query_matched(filter, query_utf8)) {
@@ -1156,6 +1262,7 @@ void AppDataModel::download_chat_history(ChatDataPtr chat, std::function<void(co
 
     auto *req = new CLDownloadFileRequest(url, success_callback);
     req->needs_progress = true;
+    req->set_priority(HTTP_PRIORITY_FOREGROUND_MEDIA);
     g_http_service.submit(req);
 }
 
@@ -1185,6 +1292,12 @@ void AppDataModel::upload_feedback(const std::string& message, const std::string
             fclose(in);
         }
         fclose(out);
+        g_http_service.dump_stats(log_path.c_str(), "ab");
+        _send_queue.dump_stats(log_path.c_str(), "ab");
+        _api_batcher.dump_stats(log_path.c_str(), "ab");
+        _message_store.dump_stats(log_path.c_str(), "ab");
+        _chat_sync.dump_stats(log_path.c_str(), "ab");
+        dump_messages_stats(log_path.c_str(), "ab");
     }
 
     std::string screenshoot_path;
@@ -1223,6 +1336,8 @@ void AppDataModel::upload_feedback(const std::string& message, const std::string
     req->set_timeout(0);
     req->set_lowspeed_limit(30,10);
     req->needs_progress = true;
+    req->compress_body = !log_path.empty(); // logs are plain text, screenshot alone is JPEG already
+    req->set_priority(HTTP_PRIORITY_BULK);
 
     AppEvents::ProgressBarControl pbreq;
     pbreq.label = "Uploading feedback";
@@ -22,6 +22,10 @@
 #include "MessageData.h"
 #include "StickerData.h"
 #include "NetworkRequests.h"
+#include "OutgoingMessageQueue.h"
+#include "ApiRequestBatcher.h"
+#include "MessageStore.h"
+#include "ChatListSync.h"
 
 #define CHATS_LIST_ORDERING_ONLINE 1
 #define CHATS_LIST_ORDERING_LAST_MESSAGE 2
@@ -37,6 +41,7 @@ private:
     std::vector<AvatarData> _avatars;
     std::vector<StickerGroupData> _stickers;
     std::vector<ChatDataPtr> _chats_list;
+    std::vector<ChatDataPtr> _chats_reorder;    // chats to be placed again in _chats_list
     std::map<std::string, ChatDataPtr> _chats_map;
     std::map<std::string, MemberDataPtr> _members_map;
     std::vector<std::string> _pending_updates;
@@ -46,7 +51,6 @@ private:
     std::string _app_version;
     std::string _chats_filter_title;
 
-    MessageDataPtr marking_seen_msg = nullptr;
     MyMemberDataPtr me = nullptr;
     bool initialized = false;
     bool loading_missing_authors = false;
@@ -56,14 +60,28 @@ private:
     int chats_list_ordering = CHATS_LIST_ORDERING_LAST_MESSAGE;
 
     ChatDataPtr currently_opened_chat = nullptr; // currently opened chat
+    OutgoingMessageQueue _send_queue;
+    ApiRequestBatcher _api_batcher;
+    MessageStore _message_store;
+    ChatListSync _chat_sync;
 
     std::string load_auth_token();
     void save_auth_token(std::string &token);
 
     void request_missing_author(std::string &author_id, MessageDataPtr msg);
+    void set_chat_order_key(ChatData* chat);
+    void reorder_chat(const ChatDataPtr& chat);
+    bool is_chats_list_reorder_pending() { return chats_list_needs_reorder || !_chats_reorder.empty(); }
     void set_or_download_message_thumbnail(const ChatDataPtr chat, const MessageDataPtr msg);
     void append_loaded_messages(const ChatDataPtr chat, const cJSON* json);
+    void set_messages_json_stream(CLHTTPRequest* req, const ChatDataPtr chat, bool clear_messages);
+    void reset_chat_messages(const ChatDataPtr chat, bool store_messages);
+    bool restore_stored_messages(const ChatDataPtr chat);
+    void load_messages_after_stored(const ChatDataPtr chat);
+    void store_message_json(const ChatDataPtr chat, const MessageDataPtr msg, const cJSON* json);
     void append_to_pending_updates(const cJSON* json);
+    bool is_chat_list_event(const std::string& evtype, const cJSON* json_data);
+    void finish_chat_list_load(os_t load_started);
     void process_pending_updates();
 
     void on_pushstream_message(const cJSON* json);
@@ -71,9 +89,15 @@ private:
     void on_member_changed(const AppEvents::MemberChanged& ev);
     void on_telegram_ready(const AppEvents::TelegramReady& ev);
 
-    void send_message(const CLStringsMap& post_data, MessageDataPtr instant_nessage);
-    void send_message_upload_file(const CLStringsMap& post_data, const char *field_name, const std::string & file_name, MessageDataPtr instant_nessage);
+    void on_connection_state_changed(const AppEvents::ConnectionStateChanged& ev);
+
+    void send_message(const CLStringsMap& post_data, MessageDataPtr instant_nessage, const std::string& file_path = "");
+    void restore_send_queue();
+    void drain_send_queue();
+    void send_queued_message(OutgoingMessage* om);
+    bool on_queued_message_failed(unsigned long seq, const HttpRequestError& err);
     MessageDataPtr make_instant_outgoing_message(int type, const std::string& text, int reply_to_id);
+    MessageDataPtr make_queued_instant_message(const ChatDataPtr chat, OutgoingMessage& om);
 
     std::shared_ptr<MyMemberData> update_my_member_data(const cJSON* json);
     MemberDataPtr update_or_create_member_data(const cJSON* json, bool do_send_update_event=true, bool cache_member=true);
@@ -82,6 +106,7 @@ private:
     void update_chat_outbox_data(const cJSON* json);
     void delete_chat_data(const cJSON* json, bool do_send_update_event=true);
     void delete_messages_data(const cJSON* json);
+    void clear_chat_data(const cJSON* json, bool do_send_update_event=true);
     void append_pending_outgoing_message(MessageDataPtr msg);
     void remove_pending_outgoing_message(MessageDataPtr msg);
 public:
@@ -89,6 +114,7 @@ public:
     void load_member(const std::string& member_id);
     void load_members(const vector<std::string>& member_ids);
     void load_chat_list(bool needs_progress = false);
+    void sync_chat_list(bool needs_progress = false); // delta from chat list of previous run, or load_chat_list()
 
     /* public methods */
     void init(const std::string& baseUrl, const std::string &lang, const std::string& _app_version);
@@ -100,6 +126,12 @@ public:
     bool is_logged_in() { return !g_http_service.get_auth_token().empty() && me != nullptr; }
     void login(const std::string& email, const std::string& password, bool save_auth, std::function<void()> on_success, RequestFailCallbackType on_fail);
     void logout();
+    OutgoingMessageQueue& get_send_queue() { return _send_queue; }
+    int process_send_queue_retries();
+    ApiRequestBatcher& get_api_batcher() { return _api_batcher; }
+    MessageStore& get_message_store() { return _message_store; }
+    ChatListSync& get_chat_sync() { return _chat_sync; }
+    bool dump_messages_stats(const char* file_name, const char* mode="w"); // memory taken by loaded messages
     void delete_account();
     void signup(const std::string& first_name, const std::string& last_name,
                 const std::string& userid, const std::string& email, const std::string& displayname,
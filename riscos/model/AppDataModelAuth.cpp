@@ -115,6 +115,7 @@ void AppDataModel::signup(const std::string &first_name, const std::string &last
 void AppDataModel::logout() {
     remove(saved_auth_path);
     _chats_list.clear();
+    _chats_reorder.clear();
     _chats_map.clear();
     _chats_filter_title.clear();
     _members_map.clear();
@@ -127,6 +128,10 @@ void AppDataModel::logout() {
     loading_messages_pending = false;
     chats_list_needs_reorder = true;
     loading_missing_authors = false;
+    _send_queue.clear();
+    _api_batcher.clear();
+    _message_store.clear();
+    _chat_sync.clear();
     g_http_service.set_auth_token("");
     g_http_service.stop_event_stream();
     g_app_events.notify(AppEvents::LoginRequired{});
@@ -25,33 +25,51 @@ void AppDataModel::load_me(MyMemberCallbackType callback) {
 }
 
 void AppDataModel::load_chat_list(bool needs_progress) {
-    auto on_chatlist_loaded = [this](CLHTTPRequest* req) {
+    os_t load_started = os_read_monotonic_time();
+    auto on_chatlist_loaded = [this, load_started](CLHTTPRequest* req) {
         cJSON *response_json = req->response_json;
+        _chat_sync.get_stats().startup_bytes += req->content_bytes_down;
         if (response_json && cJSON_IsArray(response_json)) {
-            cJSON *json_item;
-            ChatDataPtr chat;
-            this->_chats_map.clear();
-            for(json_item = response_json->child; json_item != nullptr; json_item = json_item->next) {
-                if (json_item && cJSON_IsObject(json_item))
-                {
-                    update_or_create_chat_data(json_item, false, false, true);
-//                    chat = std::make_shared<ChatData>(json_item);
-//                    this->_chats_map[chat->id] = chat;
-                } else {
-                    Logger::warn("parseChatList: array but not an objects");
-                }
+            // chats were added by json stream while downloading, response_json is empty array
+            if (req->json_stream->get_items_count() == 0) {
+                this->_chats_map.clear();
+                chats_list_needs_reorder = true;
             }
-            if (!_pending_updates.empty()) {
-                process_pending_updates();
+            _chat_sync.end_baseline(true);
+            if (_chat_sync.get_stats().mode == CHAT_SYNC_MODE_NONE) {
+                _chat_sync.get_stats().mode = CHAT_SYNC_MODE_FULL;
             }
-            is_chat_list_loaded = true;
+            finish_chat_list_load(load_started);
         } else {
+            _chat_sync.end_baseline(false);
             Logger::warn("parseChatList: not an array. resp=%s", req->response_text.c_str());
         }
         g_app_events.notify(AppEvents::ChatListLoaded {});
     };
+    auto on_chatlist_fail = [this](const HttpRequestError& err) {
+        _chat_sync.end_baseline(false);
+        return false;
+    };
+
+    auto on_chat_item = [this](cJSON* json_item, int index) {
+        if (index == 0) {
+            this->_chats_map.clear();
+            chats_list_needs_reorder = true;
+        }
+        if (cJSON_IsObject(json_item)) {
+            update_or_create_chat_data(json_item, false, false, true);
+            _chat_sync.baseline_chat(json_item);
+        } else {
+            Logger::warn("parseChatList: array but not an objects");
+        }
+    };
 
-    auto req = new CLChatApiRequest("GET", "/chat/", on_chatlist_loaded);
+    if (me != nullptr) {
+        _chat_sync.start_baseline(me->id, g_http_service.get_last_event_date());
+    }
+    auto req = new CLChatApiRequest("GET", "/chat/", on_chatlist_loaded, on_chatlist_fail);
+    req->set_response_cache(true);
+    req->set_json_stream("", on_chat_item);
     if (needs_progress) {
         req->needs_progress = true;
 
@@ -67,6 +85,100 @@ void AppDataModel::load_chat_list(bool needs_progress) {
     g_http_service.submit(req);
 }
 
+// chat list of previous run (baseline and journal) brought up to date by events server kept since then
+void AppDataModel::sync_chat_list(bool needs_progress) {
+    if (me == nullptr || !_chat_sync.can_sync(me->id)) {
+        load_chat_list(needs_progress);
+        return;
+    }
+    os_t load_started = os_read_monotonic_time();
+    auto on_synced = [this, load_started](CLHTTPRequest* req) {
+        ChatListSyncStats &stats = _chat_sync.get_stats();
+        stats.startup_bytes += req->content_bytes_down;
+        // saved and missed events go before ones which came while request was running
+        std::vector<std::string> live_updates;
+        live_updates.swap(_pending_updates);
+        _chats_map.clear();
+        chats_list_needs_reorder = true;
+        _chat_sync.load([this](const cJSON* json) {
+            update_or_create_chat_data(json, false, false, true);
+        }, [this](const cJSON* json) {
+            append_to_pending_updates(json);
+        });
+        cJSON *json_item;
+        cJSON_ArrayForEach(json_item, JsonData::get_json_array(req->response_json, "events")) {
+            append_to_pending_updates(json_item);
+            _chat_sync.journal(json_item);
+            stats.delta_events++;
+        }
+        for (auto &upd_str : live_updates) {
+            cJSON *json = cJSON_Parse(upd_str.c_str());
+            if (json) {
+                _chat_sync.journal(json);
+                cJSON_Delete(json);
+            }
+            _pending_updates.push_back(upd_str);
+        }
+        _chat_sync.set_cursor(JsonData::get_string_value(req->response_json, "time", ""));
+        stats.mode = CHAT_SYNC_MODE_DELTA;
+        Logger::info("Chat list synced: %lu chats, %lu saved events, %lu new events",
+                     stats.baseline_chats, stats.journal_events, stats.delta_events);
+        finish_chat_list_load(load_started);
+        g_app_events.notify(AppEvents::ChatListLoaded {});
+    };
+    auto on_sync_fail = [this, needs_progress](const HttpRequestError& err) {
+        if (err.http_code == 401) {
+            return false;
+        }
+        // 410: server has not kept events since cursor
+        Logger::info("Chat list sync refused (%d), loading whole chat list", err.http_code);
+        _chat_sync.invalidate();
+        _chat_sync.get_stats().mode = CHAT_SYNC_MODE_RESYNC;
+        load_chat_list(needs_progress);
+        return true;
+    };
+
+    CLStringsMap params = {
+            {"since", _chat_sync.get_cursor()}
+    };
+    auto req = new CLChatApiRequest("GET", "/chat/sync/", on_synced, on_sync_fail);
+    req->set_url_parameters(params);
+    if (needs_progress) {
+        req->needs_progress = true;
+
+        AppEvents::ProgressBarControl pbreq;
+        pbreq.label = "Updating chats list";
+        pbreq.percent_done = 70;
+        pbreq.req = req;
+        pbreq.estimated_progress = 20;
+        pbreq.estimated_time = 5;
+        g_app_events.notify(pbreq);
+    }
+
+    g_http_service.submit(req);
+}
+
+void AppDataModel::finish_chat_list_load(os_t load_started) {
+    if (me != nullptr) {
+        _message_store.open(me->id);
+    }
+    if (!_pending_updates.empty()) {
+        process_pending_updates();
+    }
+    is_chat_list_loaded = true;
+    restore_send_queue();
+    drain_send_queue();
+    ChatListSyncStats &stats = _chat_sync.get_stats();
+    if (stats.interactive_cs == 0) {
+        // first chat list of this run
+        os_t now = os_read_monotonic_time();
+        stats.load_cs = now - load_started;
+        stats.interactive_cs = now - g_app_state.startup_time;
+        Logger::info("Chat list ready in %lu cs (%lu cs after start), %lu bytes",
+                     stats.load_cs, stats.interactive_cs, stats.startup_bytes);
+    }
+}
+
 void AppDataModel::load_member(const string& member_id) {
     auto suceess_callback = [this, member_id](CLHTTPRequest* req) {
         _members_currently_loading.erase(member_id);
@@ -77,7 +189,8 @@ void AppDataModel::load_member(const string& member_id) {
         return false;
     };
     auto found = _members_currently_loading.find(member_id);
-    if (found != _members_currently_loading.end()) {
+    if (found == _members_currently_loading.end()) {
+        _members_currently_loading.insert(member_id);
         g_http_service.submit(new CLChatApiRequest("GET", "/profile/" + member_id + "/", suceess_callback, fail_callback));
     } else {
         Logger::debug("Member id %s already loading (load skipped).", member_id.c_str());
@@ -122,8 +235,82 @@ void AppDataModel::load_members(const vector<std::string>& member_ids) {
 }
 
 // append loaded messages.
+// messages page items are added to chat while downloading, append_loaded_messages() then gets page without items
+void AppDataModel::set_messages_json_stream(CLHTTPRequest* req, const ChatDataPtr chat, bool clear_messages) {
+    req->set_json_stream("items", [this, chat, clear_messages](cJSON* json_item, int index) {
+        if (index == 0 && clear_messages) {
+            reset_chat_messages(chat, true);
+        }
+        update_or_create_message_data(json_item, chat, false, false, false);
+    });
+}
+
+// messages list starts again. Stored messages are replaced by new list when it is stored,
+// otherwise (search results) they are kept as they were
+void AppDataModel::reset_chat_messages(const ChatDataPtr chat, bool store_messages) {
+    chat->messages.clear();
+    chat->messages_stored = store_messages && _message_store.is_open();
+    if (chat->messages_stored) {
+        _message_store.clear_chat(chat->id);
+    }
+}
+
+void AppDataModel::store_message_json(const ChatDataPtr chat, const MessageDataPtr msg, const cJSON* json) {
+    if (chat->messages_stored && chat->messages.index_of(msg) >= 0) {
+        _message_store.put(chat->id, json);
+    }
+}
+
+// fills chat with messages stored by previous opens, they are shown before anything is downloaded
+bool AppDataModel::restore_stored_messages(const ChatDataPtr chat) {
+    chat->messages.clear();
+    chat->messages_stored = false;
+    size_t count = _message_store.load(chat->id, [this, chat](const cJSON* json) {
+        update_or_create_message_data(json, chat, false, false, false);
+    });
+    if (count == 0 || chat->messages.empty()) {
+        return false;
+    }
+    chat->messages_stored = true;
+    chat->messages_was_loaded = true;
+    // messages around stored ones are loaded as usual pages, newer ones are there until
+    // load_messages_after_stored() tells otherwise
+    char url[256];
+    snprintf(url, sizeof(url), "/chat/%s/messages/?dir=o&from_message_id=%lld", chat->id.c_str(), chat->messages.front()->id);
+    chat->messages_load_older_url = url;
+    snprintf(url, sizeof(url), "/chat/%s/messages/?dir=n&from_message_id=%lld", chat->id.c_str(), chat->messages.back()->id);
+    chat->messages_load_newer_url = url;
+    return true;
+}
+
+// page around newest stored message: refreshes last stored ones and brings newer,
+// with link to more newer messages when there are more than a page of them
+void AppDataModel::load_messages_after_stored(const ChatDataPtr chat) {
+    if (loading_messages_pending || chat->messages.empty()) {
+        return;
+    }
+    std::string older_url = chat->messages_load_older_url;
+    auto success_callback = [this, chat, older_url](CLHTTPRequest* req) {
+        loading_messages_pending = false;
+        append_loaded_messages(chat, req->response_json);
+        // page starts in the middle of stored messages, older ones go on from the oldest stored
+        if (!chat->messages_load_older_url.empty()) {
+            chat->messages_load_older_url = older_url;
+        }
+    };
+    auto fail_callback = [this](const HttpRequestError& err) {
+        loading_messages_pending = false;
+        return false;
+    };
+    char url[256];
+    snprintf(url, sizeof(url), "/chat/%s/messages/?first_load=1&open=1&from_message_id=%lld", chat->id.c_str(), chat->messages.back()->id);
+    loading_messages_pending = true;
+    auto req = new CLChatApiRequest("GET", url, success_callback, fail_callback);
+    set_messages_json_stream(req, chat, false);
+    g_http_service.submit(req);
+}
+
 void AppDataModel::append_loaded_messages(const ChatDataPtr chat, const cJSON* json) {
-    MessagesVector messages;
     MemberDataPtr author;
     MessageDataPtr msg;
     std::set<std::string> authors_needs_be_loaded;
@@ -141,8 +328,6 @@ void AppDataModel::append_loaded_messages(const ChatDataPtr chat, const cJSON* j
     int is_first_load = JsonData::get_int_value(json, "first", 0);
     std::string next_url = JsonData::get_string_value(json, "next", "");
     std::string prev_url = JsonData::get_string_value(json, "prev", "");
-    Logger::debug("append_loaded_messages reordering");
-    chat->sort_messages();
     if (is_first_load) {
         chat->messages_load_older_url = next_url;
         chat->messages_load_newer_url = prev_url;
@@ -173,8 +358,11 @@ void AppDataModel::open_chat(const ChatDataPtr chat, bool force_reopen) {
         currently_opened_chat = chat;
         g_app_events.notify(AppEvents::OpenedChatChanged {.chat=chat });
         if (chat->messages_was_loaded && !chat->messages_filter) {
-            g_http_service.submit(new CLChatApiRequest("GET", "/chat/" + chat->id + "/open/"));
+            _api_batcher.submit(new CLChatApiRequest("GET", "/chat/" + chat->id + "/open/"));
             g_app_events.notify(AppEvents::MessagesLoaded {.chat=chat, .is_first_load=true });
+        } else if (!chat->messages_filter && restore_stored_messages(chat)) {
+            g_app_events.notify(AppEvents::MessagesLoaded {.chat=chat, .is_first_load=true });
+            load_messages_after_stored(chat);
         } else {
             load_messages_in_chat(chat, true,
                     (chat->unread_count == 0 ? 0 : chat->incoming_seen_message_id)
@@ -190,7 +378,9 @@ void AppDataModel::load_messages_in_chat(const ChatDataPtr chat, bool open_chat,
         auto success_callback = [this, chat, on_success_callback](CLHTTPRequest* req) {
             Logger::debug("loaded messages in chat=%s", chat->title.c_str());
             loading_messages_pending = false;
-            chat->messages.clear();
+            if (req->json_stream->get_items_count() == 0) {
+                reset_chat_messages(chat, true);
+            }
             append_loaded_messages(chat, req->response_json);
             on_success_callback();
             g_hourglass_off();
@@ -218,7 +408,9 @@ void AppDataModel::load_messages_in_chat(const ChatDataPtr chat, bool open_chat,
         }
         Logger::debug("loading messages in chat=%s", chat->title.c_str());
         loading_messages_pending = true;
-        g_http_service.submit(new CLChatApiRequest("GET", url, success_callback, fail_callback));
+        auto req = new CLChatApiRequest("GET", url, success_callback, fail_callback);
+        set_messages_json_stream(req, chat, true);
+        g_http_service.submit(req);
     }
 }
 
@@ -245,9 +437,11 @@ void AppDataModel::load_more_messages_in_chat(const ChatDataPtr chat, bool load_
             g_hourglass_off();
             return false;
         };
-        g_http_service.submit(new CLChatApiRequest("GET",
-                                                   (load_older ? chat->messages_load_older_url : chat->messages_load_newer_url),
-                                                   success_callback, fail_callback));
+        auto req = new CLChatApiRequest("GET",
+                                        (load_older ? chat->messages_load_older_url : chat->messages_load_newer_url),
+                                        success_callback, fail_callback);
+        set_messages_json_stream(req, chat, false);
+        g_http_service.submit(req);
     } else {
         if (chat != nullptr) {
             Logger::debug("AppDataModel::load_more_messages_in_chat chat [%s] have no more messages to load", chat->id.c_str());
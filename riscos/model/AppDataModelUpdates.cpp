@@ -127,9 +127,6 @@ MemberDataPtr AppDataModel::update_or_create_member_data(const cJSON* json, bool
     if (is_new_member && cache_member) {
         g_app_events.notify(AppEvents::MemberLoaded{.mem=mem});
     } else if (do_send_update_event) {
-        if (changes & MEMBER_CHANGES_PROFILE && chats_list_ordering == CHATS_LIST_ORDERING_MEMBER_NAME) {
-            chats_list_needs_reorder = true;
-        }
         g_app_events.notify(AppEvents::MemberChanged{.mem=mem, .changes=changes});
     }
 
@@ -156,7 +153,7 @@ ChatDataPtr AppDataModel::update_or_create_chat_data(const cJSON* json, bool onl
         chat = make_shared<ChatData>(json);
         if (add_to_chatlist) {
             _chats_map[id] = chat;
-            chats_list_needs_reorder = true;
+            reorder_chat(chat);
         }
     }
 //    debug_print_json(json);
@@ -167,7 +164,7 @@ ChatDataPtr AppDataModel::update_or_create_chat_data(const cJSON* json, bool onl
 
     if (JsonData::has_object_value(json, "last_msg")) {
         // update_or_create_message_data will append message to chat messages list and it become the last_message
-        chat->last_message = make_shared<MessageData>(JsonData::get_json_object(json, "last_msg"), chat);
+        chat->last_message = make_message_data(JsonData::get_json_object(json, "last_msg"), chat);
         set_or_download_message_thumbnail(chat, chat->last_message);
         changes |= CHAT_CHANGES_LAST_MSG;
     }
@@ -230,7 +227,8 @@ void AppDataModel::delete_chat_data(const cJSON* json, bool do_send_update_event
         return;
     }
     _chats_map.erase(id);
-    chats_list_needs_reorder = true;
+    _message_store.clear_chat(id);
+    reorder_chat(chat);
     if (currently_opened_chat == chat) {
         currently_opened_chat = nullptr;
     }
@@ -316,16 +314,21 @@ MessageDataPtr AppDataModel::update_or_create_message_data(const cJSON* json, Ch
     msg = chat->get_message(id);
 
     if (only_update_existing && msg == nullptr) {
+        // chat not opened in this run, its stored copy gets the update when it is opened
+        _message_store.update(chat->id, json);
         Logger::debug("update_or_create_message_data UPDATE message but message not found in chat, skipped. chat_id=%s msgid=%lld", chat->id.c_str(), id);
         return nullptr;
     }
 
     bool is_new_message = false;
     if (msg == nullptr) {
-        msg = std::make_shared<MessageData>(json, chat);
+        msg = make_message_data(json, chat);
         is_new_message = true;
     } else {
+        time_t old_sendtime = msg->sendtime;
+        int64_t old_id = msg->id;
         msg->update_from_json(json);
+        chat->messages.rekey(msg, old_sendtime, old_id);
     }
 
     if (msg->author == nullptr && !msg->author_id.empty()) {
@@ -365,27 +368,27 @@ MessageDataPtr AppDataModel::update_or_create_message_data(const cJSON* json, Ch
                         MessageDataPtr pending_msg = chat->messages_pending_outgoing[found_idx];
                         chat->messages_pending_outgoing.erase(chat->messages_pending_outgoing.begin() + found_idx);
 //                        Logger::debug("Erased pending=%d", found_idx);
-                        for (int i = chat->messages.size() - 1; i >= 0; --i) {
-//                            Logger::debug("Msg %p - %p", chat->messages[i].get(), pending_msg.get());
-                            if (chat->messages[i] == pending_msg) {
-//                                Logger::debug("found msg=%s", chat->messages[i]->text.c_str());
-                                chat->messages[i]->update_from_message(msg);
-                                msg = chat->messages[i];
-                                set_or_download_message_thumbnail(chat, msg);
-
-                                chat->last_message = msg;
-                                if (chats_list_ordering == CHATS_LIST_ORDERING_LAST_MESSAGE) {
-                                    chats_list_needs_reorder = true;
-                                }
-                                g_app_events.notify(AppEvents::ChatChanged {.chat=chat, .ordering_changed=chats_list_needs_reorder, .changes=CHAT_CHANGES_LAST_MSG});
-                                g_app_events.notify(AppEvents::MessageChanged {.chat=chat, .msg=msg});
-                                return msg;
+                        if (chat->messages.index_of(pending_msg) >= 0) {
+                            time_t old_sendtime = pending_msg->sendtime;
+                            int64_t old_id = pending_msg->id;
+                            pending_msg->update_from_message(msg);
+                            chat->messages.rekey(pending_msg, old_sendtime, old_id);
+                            msg = pending_msg;
+                            set_or_download_message_thumbnail(chat, msg);
+
+                            chat->last_message = msg;
+                            if (chats_list_ordering == CHATS_LIST_ORDERING_LAST_MESSAGE) {
+                                reorder_chat(chat);
                             }
+                            g_app_events.notify(AppEvents::ChatChanged {.chat=chat, .ordering_changed=is_chats_list_reorder_pending(), .changes=CHAT_CHANGES_LAST_MSG});
+                            g_app_events.notify(AppEvents::MessageChanged {.chat=chat, .msg=msg});
+                            store_message_json(chat, msg, json);
+                            return msg;
                         }
                     }
                 }
                 if (!coming_from_event || !chat->has_newer_messages()) {
-                    chat->messages.push_back(msg);
+                    chat->messages.insert(msg);
                 }
             } else {
                 if (chat->messenger() == MESSENGER_CHATCUBE && msg->id > chat->incoming_seen_message_id) {
@@ -393,7 +396,7 @@ MessageDataPtr AppDataModel::update_or_create_message_data(const cJSON* json, Ch
                     chat_changes |= CHAT_CHANGES_UNREAD_COUNT;
                 }
                 if (!coming_from_event || !chat->has_newer_messages()) {
-                    chat->messages.push_back(msg);
+                    chat->messages.insert(msg);
                 }
             }
             if (chat->last_message == nullptr || chat->last_message->id < msg->id) {
@@ -404,9 +407,9 @@ MessageDataPtr AppDataModel::update_or_create_message_data(const cJSON* json, Ch
             set_or_download_message_thumbnail(chat, msg);
             if (do_send_update_event) {
                 if (chats_list_ordering == CHATS_LIST_ORDERING_LAST_MESSAGE) {
-                    chats_list_needs_reorder = true;
+                    reorder_chat(chat);
                 }
-                g_app_events.notify(AppEvents::ChatChanged {.chat=chat, .ordering_changed=chats_list_needs_reorder, .changes=chat_changes});
+                g_app_events.notify(AppEvents::ChatChanged {.chat=chat, .ordering_changed=is_chats_list_reorder_pending(), .changes=chat_changes});
                 g_app_events.notify(AppEvents::MessageAdded {.chat=chat, .msg=msg});
             }
         }
@@ -416,6 +419,7 @@ MessageDataPtr AppDataModel::update_or_create_message_data(const cJSON* json, Ch
             g_app_events.notify(AppEvents::MessageChanged {.chat=chat, .msg=msg});
         }
     }
+    store_message_json(chat, msg, json);
     return msg;
 }
 
@@ -428,17 +432,16 @@ void AppDataModel::delete_messages_data(const cJSON* json_data) {
         const cJSON* msgids_json = JsonData::get_json_array(json_data, "message_ids");
         cJSON_ArrayForEach(json_item, msgids_json)
         {
-            for(int i = 0; i < chat->messages.size(); i++) {
-                if (json_item->valueint64 == chat->messages[i]->id) {
-                    if (chat == currently_opened_chat) {
-                        g_app_events.notify<AppEvents::MessageDeleted>({.chat = chat, .msg = chat->messages[i]});
-                    }
-                    if (chat->last_message->id == chat->messages[i]->id) {
-                        last_message_deleted = true;
-                    }
-                    chat->messages.erase(chat->messages.begin() + i);
-                    break;
+            _message_store.remove(chat->id, json_item->valueint64);
+            MessageDataPtr msg = chat->messages.find(json_item->valueint64);
+            if (msg != nullptr) {
+                if (chat == currently_opened_chat) {
+                    g_app_events.notify<AppEvents::MessageDeleted>({.chat = chat, .msg = msg});
+                }
+                if (chat->last_message != nullptr && chat->last_message->id == msg->id) {
+                    last_message_deleted = true;
                 }
+                chat->messages.erase(msg);
             }
         }
         if (last_message_deleted) {
@@ -474,7 +477,12 @@ void AppDataModel::process_pending_updates() {
             update_chat_outbox_data(json_data);
         } else if (evtype == "CHAT_DELETED") {
             delete_chat_data(json_data, false);
+        } else if (evtype == "MESSAGES_DELETED") {
+            delete_messages_data(json_data);
+        } else if (evtype == "CHAT_CLEARED") {
+            clear_chat_data(json_data, false);
         }
+        cJSON_Delete(json);
     }
     _pending_updates.clear();
 }
@@ -486,10 +494,44 @@ void AppDataModel::append_to_pending_updates(const cJSON* json) {
     free(str);
 }
 
+// events which change chat list go to journal of chat list sync
+bool AppDataModel::is_chat_list_event(const std::string& evtype, const cJSON* json_data) {
+    if (evtype == "MESSAGE_UPDATED") {
+        // only last message is seen in chat list, updates of other messages are not kept
+        ChatDataPtr chat = get_chat(JsonData::get_string_value(json_data, "chat_id", ""));
+        return chat != nullptr && chat->last_message != nullptr &&
+               chat->last_message->id == JsonData::get_int64_value(json_data, "id", 0);
+    }
+    return evtype == "MESSAGE_CREATED" || evtype == "MESSAGES_DELETED" || evtype == "CHAT_CREATED" ||
+           evtype == "CHAT_UPDATED" || evtype == "CHAT_UPDATED_OUTBOX" || evtype == "CHAT_DELETED" ||
+           evtype == "CHAT_CLEARED" || evtype == "MEMBER_UPDATED";
+}
+
+void AppDataModel::clear_chat_data(const cJSON* json_data, bool do_send_update_event) {
+    std::string chat_id = JsonData::get_string_value(json_data, "chat_id", "");
+    ChatDataPtr chat = get_chat(chat_id);
+    if (chat) {
+        chat->messages_was_loaded = false;
+        chat->messages.clear();
+        chat->messages_stored = false;
+        _message_store.clear_chat(chat_id);
+        chat->unread_count = 0;
+        chat->last_message = nullptr;
+        if (do_send_update_event) {
+            g_app_events.notify(AppEvents::ChatCleared {.chat=chat});
+        }
+    }
+}
+
 void AppDataModel::on_pushstream_message(const cJSON* json) {
     std::string evtype = JsonData::get_string_value(json, "type");
     cJSON *json_data = cJSON_GetObjectItemCaseSensitive(json, "data");
 
+    if (is_chat_list_event(evtype, json_data)) {
+        _chat_sync.journal(json);
+    }
+    _chat_sync.set_cursor(g_http_service.get_last_event_date());
+
     if (evtype == "MESSAGE_CREATED") {
         if (is_chat_list_loaded) {
             update_or_create_message_data(json_data, nullptr, false, true, true);
@@ -505,7 +547,11 @@ void AppDataModel::on_pushstream_message(const cJSON* json) {
             append_to_pending_updates(json);
         }
     } else if (evtype == "MESSAGES_DELETED") {
-        delete_messages_data(json_data);
+        if (is_chat_list_loaded) {
+            delete_messages_data(json_data);
+        } else {
+            append_to_pending_updates(json);
+        }
     } else if (evtype == "CHAT_CREATED") {
         if (is_chat_list_loaded) {
             update_or_create_chat_data(json_data, false, true, true);
@@ -572,14 +618,10 @@ void AppDataModel::on_pushstream_message(const cJSON* json) {
             }
         }
     } else if (evtype == "CHAT_CLEARED") {
-        std::string chat_id = JsonData::get_string_value(json_data, "chat_id", "");
-        ChatDataPtr chat = get_chat(chat_id);
-        if (chat) {
-            chat->messages_was_loaded = false;
-            chat->messages.clear();
-            chat->unread_count = 0;
-            chat->last_message = nullptr;
-            g_app_events.notify(AppEvents::ChatCleared {.chat=chat});
+        if (is_chat_list_loaded) {
+            clear_chat_data(json_data);
+        } else {
+            append_to_pending_updates(json);
         }
     } else if (evtype == "TELEGRAM_AUTH_CODE") {
         g_app_events.notify(AppEvents::TelegramAuthCode {.data = TelegramAuthCodeData(json_data)});
@@ -8,6 +8,7 @@
 #include "MessageData.h"
 #include "FileCacheDownloader.h"
 #include <cloverleaf/Logger.h>
+#include "../utils.h"
 //#include "../libs/drsl/drsl.h"
 
 unsigned int ChatData::update_from_json(const cJSON *json)
@@ -17,7 +18,9 @@ unsigned int ChatData::update_from_json(const cJSON *json)
     id = get_string_value(json, "id");
     type = get_int_value(json, "type", type);
 
-    if (get_set_value(json, "title", title)) {
+    std::string new_title = title;
+    if (get_set_value(json, "title", new_title)) {
+        set_title(new_title);
         changes |= CHAT_CHANGES_TITLE;
     }
 
@@ -47,6 +50,11 @@ unsigned int ChatData::update_from_json(const cJSON *json)
     return changes;
 }
 
+void ChatData::set_title(const std::string& new_title) {
+    title = new_title;
+    title_key = utf8_casefold_key(title);
+}
+
 bool ChatData::is_online() {
 //    Logger::debug("ChatData::is_online %s", title.c_str());
     if (member != nullptr) {
@@ -66,22 +74,11 @@ bool ChatData::is_member_active() {
 }
 
 MessageDataPtr ChatData::get_message(int64_t msg_id) {
-    for(auto m : messages) {
-        if (m->id == msg_id) {
-            return m;
-        }
-    }
-    return nullptr;
+    return messages.find(msg_id);
 }
 
 int ChatData::get_message_index(int64_t msg_id) {
-    int messages_count = messages.size();
-    for(int n = 0; n < messages_count; n++) {
-        if (messages[n]->id == msg_id) {
-            return n;
-        }
-    }
-    return -1;
+    return messages.index_of(msg_id);
 }
 
 std::string ChatData::get_last_message_text(int len) {
@@ -106,11 +103,106 @@ std::string ChatData::get_last_message_text(int len) {
     return txt;
 }
 
-void ChatData::sort_messages() {
-    std::sort(messages.begin(), messages.end(), [](const std::shared_ptr<MessageData> a, const std::shared_ptr<MessageData> b) {
-        if (a->sendtime == b->sendtime) {
-            return a->id < b->id;
+// pending instant messages (id 0) stay after all confirmed ones whatever their local sendtime is,
+// clock of this machine may be off, rekey() moves them to their place when server gives them id
+static inline bool message_key_less(time_t a_sendtime, int64_t a_id, time_t b_sendtime, int64_t b_id) {
+    if ((a_id == 0) != (b_id == 0)) {
+        return b_id == 0;
+    }
+    if (a_sendtime == b_sendtime) {
+        return a_id < b_id;
+    }
+    return a_sendtime < b_sendtime;
+}
+
+// msg stored under given key, end() if it is not there
+MessagesVector::iterator ChatMessages::_position_of(const MessageData* msg, time_t sendtime, int64_t id) {
+    auto it = std::lower_bound(_items.begin(), _items.end(), msg, [sendtime, id](const MessageDataPtr& item, const MessageData*) {
+        return message_key_less(item->sendtime, item->id, sendtime, id);
+    });
+    // instant messages may share the key, pointer tells them apart
+    for (; it != _items.end() && (*it)->sendtime == sendtime && (*it)->id == id; ++it) {
+        if (it->get() == msg) {
+            return it;
         }
-        return (a->sendtime < b->sendtime);
+    }
+    return _items.end();
+}
+
+MessageDataPtr ChatMessages::find(int64_t msg_id) const {
+    auto found = _by_id.find(msg_id);
+    return found == _by_id.end() ? nullptr : found->second;
+}
+
+int ChatMessages::index_of(int64_t msg_id) {
+    auto found = _by_id.find(msg_id);
+    return found == _by_id.end() ? -1 : index_of(found->second);
+}
+
+int ChatMessages::index_of(const MessageDataPtr& msg) {
+    auto it = _position_of(msg.get(), msg->sendtime, msg->id);
+    return it == _items.end() ? -1 : (int) (it - _items.begin());
+}
+
+void ChatMessages::insert(const MessageDataPtr& msg) {
+    // after messages of same key, so instant messages keep order they were sent in
+    auto it = std::upper_bound(_items.begin(), _items.end(), msg, [](const MessageDataPtr& a, const MessageDataPtr& b) {
+        return message_key_less(a->sendtime, a->id, b->sendtime, b->id);
     });
+    _items.insert(it, msg);
+    if (msg->id) {
+        _by_id[msg->id] = msg;
+    }
+}
+
+bool ChatMessages::erase(const MessageDataPtr& msg) {
+    auto it = _position_of(msg.get(), msg->sendtime, msg->id);
+    if (it == _items.end()) {
+        return false;
+    }
+    _items.erase(it);
+    if (msg->id) {
+        _by_id.erase(msg->id);
+    }
+    return true;
+}
+
+void ChatMessages::clear() {
+    _items.clear();
+    _by_id.clear();
+}
+
+void ChatMessages::rekey(const MessageDataPtr& msg, time_t old_sendtime, int64_t old_id) {
+    if (msg->sendtime == old_sendtime && msg->id == old_id) {
+        return;
+    }
+    auto it = _position_of(msg.get(), old_sendtime, old_id);
+    if (it == _items.end()) {
+        return;
+    }
+    _items.erase(it);
+    if (old_id) {
+        _by_id.erase(old_id);
+    }
+    insert(msg);
+}
+
+// strict order of chats list on keys taken by AppDataModel::set_chat_order_key(), chat id makes equal keys unique
+bool chat_order_less(const ChatDataPtr &a, const ChatDataPtr &b) {
+    const ChatOrderKey &ak = a->order_key;
+    const ChatOrderKey &bk = b->order_key;
+    if (ak.group != bk.group) {
+        return ak.group < bk.group;
+    }
+    if (ak.has_last_message != bk.has_last_message) {
+        return ak.has_last_message;
+    }
+    if (ak.last_message_time != bk.last_message_time) {
+        return ak.last_message_time > bk.last_message_time;
+    }
+    int cmp = ak.title_key.compare(bk.title_key);
+    if (cmp != 0) {
+        return cmp < 0;
+    }
+    return a->id < b->id;
 }
@@ -8,6 +8,8 @@
 #include <cstdint>
 #include <string>
 #include <vector>
+#include <unordered_map>
+#include <ctime>
 #include "JsonData.h"
 #include "ChatMemberData.h"
 #include "AppDataModelTypes.h"
@@ -33,17 +35,62 @@
 
 typedef std::vector<MessageDataPtr> MessagesVector;
 
+// Messages of chat in display order (sendtime, then id) with index by id.
+// New messages are placed by binary search, so the vector never needs full sort.
+// Instant outgoing messages have id 0 until server confirms them, are not indexed and are kept last.
+class ChatMessages {
+private:
+    MessagesVector _items;
+    std::unordered_map<int64_t, MessageDataPtr> _by_id;
+    MessagesVector::iterator _position_of(const MessageData* msg, time_t sendtime, int64_t id);
+public:
+    typedef MessagesVector::iterator iterator;
+    typedef MessagesVector::const_iterator const_iterator;
+
+    iterator begin() { return _items.begin(); }
+    iterator end() { return _items.end(); }
+    const_iterator begin() const { return _items.begin(); }
+    const_iterator end() const { return _items.end(); }
+    size_t size() const { return _items.size(); }
+    bool empty() const { return _items.empty(); }
+    MessageDataPtr& operator[](size_t idx) { return _items[idx]; }
+    MessageDataPtr& front() { return _items.front(); }
+    MessageDataPtr& back() { return _items.back(); }
+
+    MessageDataPtr find(int64_t msg_id) const;
+    int index_of(int64_t msg_id);
+    int index_of(const MessageDataPtr& msg);
+    void insert(const MessageDataPtr& msg);
+    bool erase(const MessageDataPtr& msg);
+    void clear();
+    // msg got new sendtime or id (update from server, instant message confirmed), moves it to its new place
+    void rekey(const MessageDataPtr& msg, time_t old_sendtime, int64_t old_id);
+};
+
+// Place of chat in chats list, taken when chat was put there. Chat is found in the list by it
+// even after its title or last message changed, until it is placed again.
+struct ChatOrderKey {
+    int group = 0;                      // online/active or unread first, depends on ordering
+    bool has_last_message = false;
+    time_t last_message_time = 0;
+    std::string title_key;
+};
+
+bool chat_order_less(const ChatDataPtr &a, const ChatDataPtr &b);
+
 class ChatData : public JsonData {
 public:
-    MessagesVector messages;
+    ChatMessages messages;
     MessagesVector messages_pending_outgoing;
     std::string messages_load_older_url;
     std::string messages_load_newer_url;
     bool messages_was_loaded = false;
+    bool messages_stored = false;       // messages list goes to message store, it is contiguous up to newest
     int messages_filter = 0;
 
     std::string id;
     std::string title;
+    std::string title_key;              // case folded title, compared bytewise, set by set_title()
     std::string pic_small;
     std::string pic_small_cached;
     std::string action_line;
@@ -57,13 +104,16 @@ public:
     MemberDataPtr member;
     MessageDataPtr last_message;
 
+    ChatOrderKey order_key;
+    bool order_dirty = false;           // waits in AppDataModel to be placed again in chats list
+
     ChatData() {};
     ChatData(const cJSON *jsonobj) {
         update_from_json(jsonobj);
     };
 
     unsigned int update_from_json(const cJSON *jsonobj);
-    void sort_messages();
+    void set_title(const std::string& new_title);
     MessageDataPtr get_message(int64_t msg_id);
     int get_message_index(int64_t msg_id);
     std::string get_last_message_text(int len);
@@ -79,7 +129,7 @@ public:
     }
 
     inline bool has_message(int64_t msg_id) {
-        return (get_message(msg_id) != nullptr);
+        return (messages.find(msg_id) != nullptr);
     }
 
     inline bool has_newer_messages() {
@@ -90,7 +140,7 @@ public:
         return !messages_load_older_url.empty();
     }
 
-    inline MessagesVector& get_messages() {
+    inline ChatMessages& get_messages() {
         return messages;
     }
 };
@@ -0,0 +1,258 @@
+//
+// Chat list baseline and event journal for delta sync at start, see ChatListSync.h
+//
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <cloverleaf/Logger.h>
+#include <cloverleaf/IdleTask.h>
+#include "ChatListSync.h"
+#include "../utils.h"
+
+static bool read_line(FILE* f, std::string& line) {
+    line.clear();
+    int c;
+    while ((c = fgetc(f)) != EOF && c != '\n') {
+        line += (char) c;
+    }
+    return c != EOF;
+}
+
+static const char* sync_mode_names[] = {"none", "full", "delta", "resync"};
+
+ChatListSync::~ChatListSync() {
+    flush();
+}
+
+std::string ChatListSync::_path(const char* leaf) {
+    return std::string(_dir) + "." + leaf;
+}
+
+void ChatListSync::_schedule_flush() {
+    if (!_flush_scheduled) {
+        _flush_scheduled = true;
+        g_idle_task.run_at_next_idle([this]() {
+            flush();
+        });
+    }
+}
+
+// directory belongs to user_id, state of other user is removed
+bool ChatListSync::_open_user(const std::string& user_id) {
+    if (_user_id == user_id) {
+        return true;
+    }
+    _user_id = user_id;
+    std::string user_path = _path("user");
+    if (is_file_exist(user_path) && get_file_contents(user_path.c_str()) == user_id) {
+        return true;
+    }
+    remove_recursive(_dir);
+    mkdir(_dir, 0777);
+    FILE *f = fopen(user_path.c_str(), "wb");
+    if (!f) {
+        Logger::error("ChatListSync can't write %s", user_path.c_str());
+        _user_id.clear();
+        return false;
+    }
+    fputs(user_id.c_str(), f);
+    fclose(f);
+    return true;
+}
+
+bool ChatListSync::can_sync(const std::string& user_id) {
+    if (!_open_user(user_id) || !is_file_exist(_path("chats")) || !is_file_exist(_path("cursor"))) {
+        return false;
+    }
+    _cursor = get_file_contents(_path("cursor").c_str());
+    return !_cursor.empty();
+}
+
+void ChatListSync::start_baseline(const std::string& user_id, const std::string& cursor) {
+    if (!_open_user(user_id)) {
+        return;
+    }
+    invalidate();
+    std::string tmp_path = _path("chats/tmp");
+    _baseline = fopen(tmp_path.c_str(), "wb");
+    if (!_baseline) {
+        Logger::error("ChatListSync can't write %s", tmp_path.c_str());
+        return;
+    }
+    // events coming while chat list loads may be missing in it, they are journaled too
+    _active = true;
+    _cursor = cursor;
+    _cursor_changed = true;
+}
+
+void ChatListSync::baseline_chat(const cJSON* json) {
+    if (!_baseline) {
+        return;
+    }
+    char *str = cJSON_PrintUnformatted(json);
+    fputs(str, _baseline);
+    fputc('\n', _baseline);
+    free(str);
+    _stats.baseline_chats++;
+}
+
+void ChatListSync::end_baseline(bool ok) {
+    if (!_baseline) {
+        return;
+    }
+    bool written = ferror(_baseline) == 0;
+    fclose(_baseline);
+    _baseline = nullptr;
+    std::string tmp_path = _path("chats/tmp");
+    if (ok && written && rename(tmp_path.c_str(), _path("chats").c_str()) == 0) {
+        _schedule_flush();
+    } else {
+        remove(tmp_path.c_str());
+        invalidate();
+    }
+}
+
+// returns true when last line was cut, size is size of file read
+bool ChatListSync::_read_lines(const char* leaf, const std::function<void(const cJSON* json)>& on_line, long& size) {
+    std::string path = _path(leaf);
+    size = 0;
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    std::string line;
+    while (read_line(f, line)) {
+        cJSON *json = cJSON_Parse(line.c_str());
+        if (json) {
+            on_line(json);
+            cJSON_Delete(json);
+        } else {
+            Logger::warn("ChatListSync %s has broken line", path.c_str());
+        }
+    }
+    size = ftell(f);
+    fclose(f);
+    return !line.empty();
+}
+
+void ChatListSync::load(const std::function<void(const cJSON* json)>& on_chat, const std::function<void(const cJSON* json)>& on_event) {
+    flush();
+    _pending.clear();
+    long size;
+    _read_lines("chats", [this, &on_chat](const cJSON* json) {
+        _stats.baseline_chats++;
+        on_chat(json);
+    }, size);
+    bool cut = _read_lines("journal", [this, &on_event](const cJSON* json) {
+        _stats.journal_events++;
+        on_event(json);
+    }, _journal_size);
+    if (cut) {
+        // next append must not continue cut line
+        _pending = "\n";
+    }
+    _active = true;
+}
+
+void ChatListSync::journal(const cJSON* event) {
+    if (!_active) {
+        return;
+    }
+    char *str = cJSON_PrintUnformatted(event);
+    size_t len = strlen(str);
+    _pending.append(str, len);
+    _pending += '\n';
+    free(str);
+    _journal_size += len + 1;
+    _stats.journaled++;
+    if (_journal_size > CHAT_SYNC_MAX_JOURNAL_BYTES) {
+        Logger::info("ChatListSync journal is too big, next start loads whole chat list");
+        invalidate();
+        return;
+    }
+    _schedule_flush();
+}
+
+void ChatListSync::set_cursor(const std::string& cursor) {
+    if (!_active || cursor.empty() || cursor == _cursor) {
+        return;
+    }
+    _cursor = cursor;
+    _cursor_changed = true;
+    _schedule_flush();
+}
+
+// journal goes first, cursor never points after events which are not written
+void ChatListSync::flush() {
+    _flush_scheduled = false;
+    if (!_active || _baseline) {
+        return;
+    }
+    if (!_pending.empty()) {
+        std::string path = _path("journal");
+        FILE *f = fopen(path.c_str(), "ab");
+        if (!f) {
+            Logger::error("ChatListSync can't write %s", path.c_str());
+            invalidate();
+            return;
+        }
+        size_t written = fwrite(_pending.data(), 1, _pending.size(), f);
+        fclose(f);
+        if (written != _pending.size()) {
+            invalidate();
+            return;
+        }
+        _pending.clear();
+    }
+    if (_cursor_changed) {
+        std::string path = _path("cursor");
+        std::string tmp_path = _path("cursor/tmp");
+        FILE *f = fopen(tmp_path.c_str(), "wb");
+        if (!f) {
+            Logger::error("ChatListSync can't write %s", tmp_path.c_str());
+            return;
+        }
+        fputs(_cursor.c_str(), f);
+        fclose(f);
+        remove(path.c_str());
+        rename(tmp_path.c_str(), path.c_str());
+        _cursor_changed = false;
+    }
+}
+
+void ChatListSync::invalidate() {
+    _active = false;
+    _pending.clear();
+    _cursor_changed = false;
+    _journal_size = 0;
+    if (_baseline) {
+        fclose(_baseline);
+        _baseline = nullptr;
+        remove(_path("chats/tmp").c_str());
+    }
+    if (!_user_id.empty()) {
+        remove(_path("cursor").c_str());
+        remove(_path("chats").c_str());
+        remove(_path("journal").c_str());
+    }
+}
+
+void ChatListSync::clear() {
+    invalidate();
+    _user_id.clear();
+    _cursor.clear();
+    remove_recursive(_dir);
+}
+
+bool ChatListSync::dump_stats(const char* file_name, const char* mode) {
+    FILE *f = fopen(file_name, mode);
+    if (!f) {
+        return false;
+    }
+    fprintf(f, "chat list sync: mode:%s startup_bytes:%lu load_cs:%lu interactive_cs:%lu baseline_chats:%lu "
+               "journal_events:%lu delta_events:%lu journaled:%lu\n",
+            sync_mode_names[_stats.mode], _stats.startup_bytes, _stats.load_cs, _stats.interactive_cs,
+            _stats.baseline_chats, _stats.journal_events, _stats.delta_events, _stats.journaled);
+    fclose(f);
+    return true;
+}
@@ -0,0 +1,77 @@
+/* ChatListSync.h
+
+   Chat list of previous run as baseline for next start. Full load of chat list saves its items,
+   chat and message events which come after it are appended to journal together with time of last
+   event seen (sync cursor). Next start rebuilds chat list from baseline and journal and asks server
+   only for events since cursor (/chat/sync/?since=). When server does not keep events for so long
+   (410), journal grew too big or there is no baseline, whole chat list is loaded as before.
+
+   Files are in one directory, ".user" there tells whose they are:
+     chats      chat list items, one JSON per line, written to "chats/tmp" and renamed when complete
+     journal    events after baseline, one JSON per line, line without end is cut by crash and ignored
+     cursor     time of last event (HTTP date as in push stream), written after journal
+
+ */
+
+#ifndef ROCHAT_CHATLISTSYNC_H
+#define ROCHAT_CHATLISTSYNC_H
+
+#include <string>
+#include <functional>
+#include <cstdio>
+#include "../libs/cJSON/cJSON.h"
+
+#define CHAT_SYNC_MAX_JOURNAL_BYTES     (512 * 1024)    // longer journal is dropped, next start loads all chats
+
+#define CHAT_SYNC_MODE_NONE     0
+#define CHAT_SYNC_MODE_FULL     1   // whole chat list loaded, no baseline yet
+#define CHAT_SYNC_MODE_DELTA    2   // baseline and events since cursor
+#define CHAT_SYNC_MODE_RESYNC   3   // delta refused by server, whole chat list loaded
+
+struct ChatListSyncStats {
+    int mode = CHAT_SYNC_MODE_NONE;     // how chat list was loaded at start of this run
+    unsigned long startup_bytes = 0;    // response bodies of chat list requests at start
+    unsigned long load_cs = 0;          // from chat list request to chat list loaded
+    unsigned long interactive_cs = 0;   // from app start to chat list loaded
+    unsigned long baseline_chats = 0;
+    unsigned long journal_events = 0;   // replayed from journal at start
+    unsigned long delta_events = 0;     // got from server at start
+    unsigned long journaled = 0;        // events appended during this run
+};
+
+class ChatListSync {
+private:
+    const char* _dir = "<Choices$Write>.ChatCube.chatsync";
+    std::string _user_id;
+    std::string _cursor;
+    std::string _pending;               // journal lines not written yet
+    FILE* _baseline = nullptr;          // open while full chat list is loading
+    bool _active = false;               // baseline complete, events are journaled
+    bool _cursor_changed = false;
+    bool _flush_scheduled = false;
+    long _journal_size = 0;
+    ChatListSyncStats _stats;
+    std::string _path(const char* leaf);
+    void _schedule_flush();
+    bool _open_user(const std::string& user_id);
+    bool _read_lines(const char* leaf, const std::function<void(const cJSON* json)>& on_line, long& size);
+public:
+    ~ChatListSync();
+    bool can_sync(const std::string& user_id);  // baseline of this user is there
+    const std::string& get_cursor() { return _cursor; }
+    // full chat list load: start_baseline() when it starts, baseline_chat() for each item, end_baseline() when done
+    void start_baseline(const std::string& user_id, const std::string& cursor);
+    void baseline_chat(const cJSON* json);
+    void end_baseline(bool ok);
+    // delta sync: chats of baseline then journal events, in order they came
+    void load(const std::function<void(const cJSON* json)>& on_chat, const std::function<void(const cJSON* json)>& on_event);
+    void journal(const cJSON* event);
+    void set_cursor(const std::string& cursor);
+    void invalidate();              // next start loads whole chat list
+    void clear();                   // logout
+    void flush();
+    ChatListSyncStats& get_stats() { return _stats; }
+    bool dump_stats(const char* file_name, const char* mode="w");
+};
+
+#endif //ROCHAT_CHATLISTSYNC_H
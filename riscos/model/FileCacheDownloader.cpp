@@ -115,18 +115,33 @@ void FileCacheDownloader::do_download(const std::string &url, FileDownloadReques
     auto *downloadreq = new CLDownloadFileRequest(url, on_success_callback, on_fail_callback);
     downloadreq->needs_progress = req->needs_progress;
     downloadreq->total_size_hint = req->total_size_hint;
+    // attachments user is waiting for may be big, thumbnails are not worth keeping partial files for
+    downloadreq->set_resumable(req->needs_progress);
+    downloadreq->set_priority(req->needs_progress ? HTTP_PRIORITY_FOREGROUND_MEDIA : HTTP_PRIORITY_BACKGROUND);
     g_http_service.submit(downloadreq);
 }
 
+int FileCacheDownloader::get_concurrent_downloads_limit() {
+    return g_http_service.is_multiplexing() ? MAX_CONCURRENT_DOWNLOADS_MULTIPLEXED : MAX_CONCURRENT_DOWNLOADS;
+}
+
 void FileCacheDownloader::process_queue() {
-    if (!download_requests.empty() && concurrent_downloads < MAX_CONCURRENT_DOWNLOADS) {
+    int limit = get_concurrent_downloads_limit();
+    // user is waiting for downloads with progress, pass them to http service scheduler straight away
+    for(auto &it : download_requests) {
+        if (!it.second->is_downloading && it.second->needs_progress) {
+            it.second->is_downloading = true;
+            do_download(it.first, it.second);
+        }
+    }
+    if (!download_requests.empty() && concurrent_downloads < limit) {
         for(auto &it : download_requests) {
             if (!it.second->is_downloading) {
                 it.second->is_downloading = true;
                 Logger::debug("process_queue download %s qlen:%d", it.first.c_str(), download_requests.size());
                 do_download(it.first, it.second);
             }
-            if (concurrent_downloads >= MAX_CONCURRENT_DOWNLOADS) {
+            if (concurrent_downloads >= limit) {
                 break;
             }
         }
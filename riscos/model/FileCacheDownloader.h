@@ -15,6 +15,8 @@
 #include "NetworkRequests.h"
 
 #define MAX_CONCURRENT_DOWNLOADS 3
+// with http2 multiplexing all downloads go through single connection so we can run more of them
+#define MAX_CONCURRENT_DOWNLOADS_MULTIPLEXED 12
 
 // tuple have (url, save_to)
 typedef std::tuple<std::string, std::string> DownloadRequestType;
@@ -49,6 +51,7 @@ private:
 //    bool isReady(const std::string& url, const std::string& folder);
 //    bool isDownloading(const std::string& url);
 //    void runDownload(const std::string& url, const std::string& folder, int file_type);
+    int get_concurrent_downloads_limit();
     void possibly_send_downloading_event();
     void process_queue();
     void do_download(const std::string &url, FileDownloadRequest *req);
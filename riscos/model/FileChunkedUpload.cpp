@@ -0,0 +1,196 @@
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cloverleaf/Logger.h>
+#include <cloverleaf/CLUtf8.h>
+#include "FileChunkedUpload.h"
+#include "JsonData.h"
+#include "AppEvents.h"
+#include "../utils.h"
+
+const static char* _tmp_uploads_dir = "<Choices$Write>.ChatCube.temp_uploads";
+
+class CLUploadChunkRequest : public CLChatApiRequest {
+public:
+    FileChunkedUpload *upload;
+    CLUploadChunkRequest(const std::string &a_url, FileChunkedUpload *a_upload,
+                         RequestSuccessCallbackType success_callback, RequestFailCallbackType fail_callback)
+            : CLChatApiRequest("PUT", a_url, success_callback, fail_callback), upload(a_upload) {};
+
+    int on_progress(curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) override {
+        upload->notify_progress(ulnow);
+        return CLHTTPRequest::on_progress(dltotal, dlnow, ultotal, ulnow);
+    }
+};
+
+FileChunkedUpload::FileChunkedUpload(const std::string& a_file_path, const std::string& a_file_name, CLHTTPRequest* a_progress_req,
+                                     ChunkedUploadSuccessCallbackType on_success, RequestFailCallbackType on_fail) :
+        file_path(a_file_path),
+        file_name(a_file_name),
+        progress_req(a_progress_req),
+        success_callback(on_success),
+        fail_callback(on_fail) {
+    file_size = get_filesize(file_path.c_str());
+}
+
+std::string FileChunkedUpload::get_session_path() {
+    return std::string(_tmp_uploads_dir) + ".s" + str_hash_hex(file_path + ":" + std::to_string((long long) file_size));
+}
+
+void FileChunkedUpload::save_session() {
+    if (!is_directory_exist(_tmp_uploads_dir)) {
+        mkdir(_tmp_uploads_dir, 0777);
+    }
+    FILE *f = fopen(get_session_path().c_str(), "wb");
+    if (f) {
+        fputs(upload_id.c_str(), f);
+        fclose(f);
+    }
+}
+
+void FileChunkedUpload::remove_session() {
+    unlink(get_session_path().c_str());
+}
+
+void FileChunkedUpload::start() {
+    if (file_size <= 0) {
+        HttpRequestError err(0, "Can't read file " + file_path, CHUNKED_UPLOAD_ERROR_NO_FILE);
+        if (!finish(&err)) {
+            show_alert_error(err.error_message.c_str());
+        }
+        return;
+    }
+    std::string session_path = get_session_path();
+    if (is_file_exist(session_path)) {
+        upload_id = get_file_contents(session_path.c_str());
+        trim(upload_id);
+    }
+    if (upload_id.empty()) {
+        create_session();
+    } else {
+        query_session();
+    }
+}
+
+void FileChunkedUpload::create_session() {
+    auto on_success = [this](CLHTTPRequest* req) {
+        if (!set_status(req->response_json)) {
+            HttpRequestError err(req->response_code, "Wrong upload session response");
+            if (!finish(&err)) {
+                show_alert_error(err.error_message.c_str());
+            }
+            return;
+        }
+        save_session();
+        send_next_chunk();
+    };
+    auto on_fail = [this](const HttpRequestError& err) {
+        return finish(&err);
+    };
+    auto *req = new CLChatApiRequest("POST", "/upload/", on_success, on_fail);
+    req->post_data = {
+            {"size", std::to_string((long long) file_size)},
+            {"file_name", riscos_local_to_utf8(file_name)}
+    };
+    req->set_priority(HTTP_PRIORITY_FOREGROUND_MEDIA);
+    g_http_service.submit(req);
+}
+
+// session left by previous run, continue from what server has received
+void FileChunkedUpload::query_session() {
+    auto on_success = [this](CLHTTPRequest* req) {
+        if (!set_status(req->response_json)) {
+            Logger::warn("FileChunkedUpload %s session %s does not match file, start new one", file_path.c_str(), upload_id.c_str());
+            remove_session();
+            create_session();
+            return;
+        }
+        Logger::info("FileChunkedUpload %s resume from %lld", file_path.c_str(), (long long) received);
+        send_next_chunk();
+    };
+    auto on_fail = [this](const HttpRequestError& err) {
+        if (err.http_code == 404) {
+            // expired and removed by server
+            remove_session();
+            create_session();
+            return true;
+        }
+        return finish(&err);
+    };
+    auto *req = new CLChatApiRequest("GET", "/upload/" + upload_id + "/", on_success, on_fail);
+    req->set_priority(HTTP_PRIORITY_FOREGROUND_MEDIA);
+    g_http_service.submit(req);
+}
+
+bool FileChunkedUpload::set_status(const cJSON* status) {
+    if (!status || JsonData::get_int64_value(status, "size", 0) != file_size) {
+        return false;
+    }
+    upload_id = JsonData::get_string_value(status, "upload_id", upload_id);
+    received = JsonData::get_int64_value(status, "received", 0);
+    chunk_size = JsonData::get_int64_value(status, "chunk_size", CHUNKED_UPLOAD_DEFAULT_CHUNK_SIZE);
+    return !upload_id.empty() && chunk_size > 0 && received >= 0 && received <= file_size;
+}
+
+void FileChunkedUpload::send_next_chunk() {
+    notify_progress(0);
+    if (received == file_size) {
+        finish(nullptr);
+        return;
+    }
+    auto on_success = [this](CLHTTPRequest* req) {
+        curl_off_t sent_to = req->upload_body_offset + req->upload_body_length;
+        if (!set_status(req->response_json) || received != sent_to) {
+            HttpRequestError err(req->response_code, "Wrong upload part response");
+            if (!finish(&err)) {
+                show_alert_error(err.error_message.c_str());
+            }
+            return;
+        }
+        send_next_chunk();
+    };
+    auto on_fail = [this](const HttpRequestError& err) {
+        if (err.http_code == 409) {
+            // server has other offset (part acknowledge was lost), ask it where to continue
+            query_session();
+            return true;
+        }
+        return finish(&err);
+    };
+    curl_off_t length = file_size - received;
+    if (length > chunk_size) {
+        length = chunk_size;
+    }
+    auto *req = new CLUploadChunkRequest("/upload/" + upload_id + "/?offset=" + std::to_string((long long) received),
+                                         this, on_success, on_fail);
+    req->set_upload_body(file_path, received, length);
+    req->set_lowspeed_limit(30, 10);
+    req->needs_progress = true;
+    req->timing_class = HTTP_TIMING_UPLOAD;
+    req->set_priority(HTTP_PRIORITY_FOREGROUND_MEDIA);
+    g_http_service.submit(req);
+}
+
+void FileChunkedUpload::notify_progress(curl_off_t chunk_sent) {
+    AppEvents::UploadingProgress ev;
+    ev.req = progress_req;
+    ev.percent_done = (int) (((received + chunk_sent) * 100) / file_size);
+    if (ev.percent_done >= 100) {
+        ev.percent_done = 99;
+    }
+    g_app_events.notify(ev);
+}
+
+bool FileChunkedUpload::finish(const HttpRequestError* err) {
+    bool handled = true;
+    if (err) {
+        // session is kept, sending same file again continues from last acknowledged part
+        Logger::error("FileChunkedUpload %s failed at %lld: %s", file_path.c_str(), (long long) received, err->error_message.c_str());
+        handled = fail_callback(*err);
+    } else {
+        Logger::info("FileChunkedUpload %s completed, upload_id: %s", file_path.c_str(), upload_id.c_str());
+        remove_session();
+        success_callback(upload_id);
+    }
+    delete this;
+    return handled;
+}
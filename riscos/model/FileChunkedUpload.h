@@ -0,0 +1,48 @@
+/* FileChunkedUpload.h
+
+   Uploads file to server in parts, each part is acknowledged by server with count of received bytes.
+   Upload session is kept on disk, so upload of same file continues from last acknowledged part
+   after failed request or application restart. Instance deletes itself after success or fail callback.
+
+ */
+
+#ifndef ROCHAT_FILECHUNKEDUPLOAD_H
+#define ROCHAT_FILECHUNKEDUPLOAD_H
+
+#include <string>
+#include <functional>
+#include "NetworkRequests.h"
+
+#define CHUNKED_UPLOAD_DEFAULT_CHUNK_SIZE (64 * 1024) // server tells its own size when session is created
+#define CHUNKED_UPLOAD_ERROR_NO_FILE "no_file"        // error_code of failure found before anything was sent
+
+typedef std::function<void(const std::string& upload_id)> ChunkedUploadSuccessCallbackType;
+
+class FileChunkedUpload {
+private:
+    std::string file_path;
+    std::string file_name;
+    curl_off_t file_size;
+    std::string upload_id;
+    curl_off_t received = 0;
+    curl_off_t chunk_size = CHUNKED_UPLOAD_DEFAULT_CHUNK_SIZE;
+    CLHTTPRequest *progress_req; // UploadingProgress events are sent for this request
+    ChunkedUploadSuccessCallbackType success_callback;
+    RequestFailCallbackType fail_callback;
+
+    std::string get_session_path();
+    void save_session();
+    void remove_session();
+    void create_session();
+    void query_session();
+    bool set_status(const cJSON* status);
+    void send_next_chunk();
+    bool finish(const HttpRequestError* err); // returns fail callback result
+public:
+    FileChunkedUpload(const std::string& file_path, const std::string& file_name, CLHTTPRequest* progress_req,
+                      ChunkedUploadSuccessCallbackType on_success, RequestFailCallbackType on_fail);
+    void start();
+    void notify_progress(curl_off_t chunk_sent);
+};
+
+#endif //ROCHAT_FILECHUNKEDUPLOAD_H
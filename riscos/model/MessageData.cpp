@@ -5,6 +5,12 @@
 
 //typedef std::shared_ptr<MessageData> MessageDataPtr;
 
+// heap block of string, short strings kept inside std::string itself take none
+static size_t string_memory_size(const std::string& s) {
+    size_t size = s.capacity() + 1;
+    return size > sizeof(std::string) ? size : 0;
+}
+
 AttachmentFile::AttachmentFile(const AttachmentFile& other) {
     url = other.url;
     name = other.name;
@@ -36,6 +42,11 @@ void AttachmentFile::update_from_json(const cJSON *json) {
 }
 
 
+size_t AttachmentFile::get_memory_size() const {
+    return sizeof(AttachmentFile) + string_memory_size(url) + string_memory_size(name)
+           + string_memory_size(thumb_url) + string_memory_size(thumb_url_cached);
+}
+
 AttachmentImage::AttachmentImage(const AttachmentImage& att_image) {
     url = att_image.url;
     thumb_url = att_image.thumb_url;
@@ -60,6 +71,10 @@ void AttachmentImage::update_from_json(const cJSON *json) {
     width = get_int_value(json, "width", width);
 }
 
+size_t AttachmentImage::get_memory_size() const {
+    return sizeof(AttachmentImage) + string_memory_size(url) + string_memory_size(thumb_url)
+           + string_memory_size(thumb_url_cached);
+}
 
 ReplyInfo::ReplyInfo(const cJSON *json) {
     update_from_json(json);
@@ -118,6 +133,11 @@ void ReplyInfo::update_from_json(const cJSON *json) {
     }
 }
 
+size_t ReplyInfo::get_memory_size() const {
+    return sizeof(ReplyInfo) + string_memory_size(author_id) + string_memory_size(text)
+           + (att_file ? att_file->get_memory_size() : 0) + (att_image ? att_image->get_memory_size() : 0);
+}
+
 ReplyInfo::~ReplyInfo() {
     delete att_image;
     delete att_file;
@@ -140,6 +160,10 @@ void ForwardInfo::update_from_json(const cJSON *json) {
     chat_id = get_string_value(json, "chat_id", "");
 }
 
+size_t ForwardInfo::get_memory_size() const {
+    return sizeof(ForwardInfo) + string_memory_size(title) + string_memory_size(user_id) + string_memory_size(chat_id);
+}
+
 void MessageData::update_from_json(const cJSON *json)
 {
     const cJSON *tmp_json, *json_item;
@@ -191,8 +215,10 @@ void MessageData::update_from_json(const cJSON *json)
     }
 
     tmp_json = get_json_array(json, "entities");
-    text_entities.clear();
+    // exactly sized, vector grown by emplace_back keeps up to twice the room
+    std::vector<TextEntity> entities;
     if (tmp_json) {
+        entities.reserve(cJSON_GetArraySize(tmp_json));
         cJSON_ArrayForEach(json_item, tmp_json) {
             unsigned int start = get_int_value(json_item, "s", 0),
                 len = get_int_value(json_item, "l", 0),
@@ -200,7 +226,7 @@ void MessageData::update_from_json(const cJSON *json)
             if (start > 0) {
                 start_b = utf8_len_bytes_substr(text, 0, start);
             }
-            text_entities.emplace_back(TextEntity{
+            entities.emplace_back(TextEntity{
                     .type = static_cast<unsigned int>(get_int_value(json_item, "t", 0)),
                     .start = start_b,
                     .len = utf8_len_bytes_substr(text, start, len),
@@ -208,6 +234,7 @@ void MessageData::update_from_json(const cJSON *json)
             });
         }
     }
+    text_entities.swap(entities);
 }
 
 void MessageData::update_from_message(MessageDataPtr msg) {
@@ -250,6 +277,27 @@ void MessageData::update_from_message(MessageDataPtr msg) {
     }
 }
 
+size_t MessageData::get_memory_size() const {
+    size_t size = sizeof(MessageData) + string_memory_size(text) + string_memory_size(author_id)
+                  + text_entities.capacity() * sizeof(TextEntity);
+    for (auto &ent : text_entities) {
+        size += string_memory_size(ent.value);
+    }
+    if (att_file) {
+        size += att_file->get_memory_size();
+    }
+    if (att_image) {
+        size += att_image->get_memory_size();
+    }
+    if (reply_info) {
+        size += reply_info->get_memory_size();
+    }
+    if (forward_info) {
+        size += forward_info->get_memory_size();
+    }
+    return size;
+}
+
 std::string MessageData::get_entity_value(const TextEntity& e) {
     if (e.value.empty()) {
         return utf8_substr(text, e.start, e.len);
@@ -82,6 +82,7 @@ public:
     AttachmentFile(const cJSON *json);
     AttachmentFile(const AttachmentFile& other);
     void update_from_json(const cJSON *json);
+    size_t get_memory_size() const;
 };
 
 class AttachmentImage : public JsonData {
@@ -99,6 +100,7 @@ public:
     AttachmentImage(const cJSON *json);
     AttachmentImage(const AttachmentImage& att_image);
     void update_from_json(const cJSON *json);
+    size_t get_memory_size() const;
 };
 
 class ReplyInfo : public JsonData {
@@ -115,6 +117,7 @@ public:
     ReplyInfo(const ReplyInfo& other);
     ~ReplyInfo();
     void update_from_json(const cJSON *json);
+    size_t get_memory_size() const;
 };
 
 class ForwardInfo : public JsonData {
@@ -127,6 +130,7 @@ public:
     ForwardInfo(const ForwardInfo& other);
 
     void update_from_json(const cJSON *json);
+    size_t get_memory_size() const;
 };
 //class ChatData;
 
@@ -164,6 +168,7 @@ public:
     std::string get_entity_value(const TextEntity& entity);
     void update_from_json(const cJSON *json);
     void update_from_message(MessageDataPtr msg);
+    size_t get_memory_size() const; // message with its parts and strings, for memory stats
     bool is_system()  const { return ((flags & MESSAGE_FLAG_SYSTEM) != 0); }
     bool is_outgoing() const { return ((flags & MESSAGE_FLAG_OUTGOING) != 0); }
     bool is_deleted() const { return ((flags & MESSAGE_FLAG_DELETED) != 0); }
@@ -180,4 +185,10 @@ public:
     bool is_filter_matched(int filter);
 };
 
+// message and its shared_ptr counts in one heap block
+template<class... Args>
+MessageDataPtr make_message_data(Args&&... args) {
+    return std::make_shared<MessageData>(std::forward<Args>(args)...);
+}
+
 #endif
\ No newline at end of file
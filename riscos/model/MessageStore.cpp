@@ -0,0 +1,340 @@
+//
+// Per chat on-disk message store, see MessageStore.h for file format.
+//
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <cloverleaf/Logger.h>
+#include <cloverleaf/IdleTask.h>
+#include "oslib/os.h"
+#include "MessageStore.h"
+#include "JsonData.h"
+#include "../utils.h"
+
+#define MESSAGE_STORE_SIGNATURE "CCMS 1"
+
+static bool read_line(FILE* f, std::string& line) {
+    line.clear();
+    int c;
+    while ((c = fgetc(f)) != EOF && c != '\n') {
+        line += (char) c;
+    }
+    return c != EOF;
+}
+
+static bool read_block(FILE* f, std::string& data, unsigned long size) {
+    data.resize(size);
+    return size == 0 || fread(&data[0], 1, size, f) == size;
+}
+
+static std::string message_record(char type, int64_t id, const cJSON* json) {
+    char *str = cJSON_PrintUnformatted(json);
+    size_t len = strlen(str);
+    char head[64];
+    snprintf(head, sizeof(head), "%c %lld %lu\n", type, (long long) id, (unsigned long) len);
+    std::string record = head;
+    record.append(str, len);
+    record += '\n';
+    free(str);
+    return record;
+}
+
+// top level fields of update replace stored ones, same as MessageData::update_from_json does
+static void merge_message(cJSON* stored, const cJSON* update) {
+    const cJSON *item;
+    cJSON_ArrayForEach(item, update) {
+        if (strcmp(item->string, "id") == 0 || strcmp(item->string, "new_id") == 0) {
+            continue;
+        }
+        cJSON *copy = cJSON_Duplicate(item, true);
+        if (cJSON_GetObjectItemCaseSensitive(stored, item->string)) {
+            cJSON_ReplaceItemInObjectCaseSensitive(stored, item->string, copy);
+        } else {
+            cJSON_AddItemToObject(stored, item->string, copy);
+        }
+    }
+}
+
+MessageStore::~MessageStore() {
+    flush();
+}
+
+std::string MessageStore::_file_path(const std::string& chat_id) {
+    return std::string(_dir) + "." + str_hash_hex(chat_id);
+}
+
+void MessageStore::open(const std::string& user_id) {
+    if (_user_id == user_id) {
+        return;
+    }
+    _pending.clear();
+    _compacted_size.clear();
+    _user_id = user_id;
+    std::string user_path = std::string(_dir) + ".user";
+    if (is_file_exist(user_path) && get_file_contents(user_path.c_str()) == user_id) {
+        return;
+    }
+    // messages of other account
+    remove_recursive(_dir);
+    mkdir(_dir, 0777);
+    FILE *f = fopen(user_path.c_str(), "wb");
+    if (!f) {
+        Logger::error("MessageStore::open can't write %s", user_path.c_str());
+        _user_id.clear();
+        return;
+    }
+    fputs(user_id.c_str(), f);
+    fclose(f);
+}
+
+void MessageStore::clear() {
+    _pending.clear();
+    _compacted_size.clear();
+    _user_id.clear();
+    remove_recursive(_dir);
+}
+
+void MessageStore::_append(const std::string& chat_id, const std::string& record) {
+    _pending[chat_id] += record;
+    _stats.appended_records++;
+    if (!_flush_scheduled) {
+        _flush_scheduled = true;
+        g_idle_task.run_at_next_idle([this]() {
+            flush();
+        });
+    }
+}
+
+void MessageStore::put(const std::string& chat_id, const cJSON* json) {
+    int64_t id = JsonData::get_int64_value(json, "id", 0);
+    if (!is_open() || !id) {
+        return;
+    }
+    _append(chat_id, message_record('M', id, json));
+}
+
+void MessageStore::update(const std::string& chat_id, const cJSON* json) {
+    int64_t id = JsonData::get_int64_value(json, "id", 0);
+    if (!id || !has_chat(chat_id)) {
+        return;
+    }
+    _append(chat_id, message_record('U', id, json));
+}
+
+bool MessageStore::has_chat(const std::string& chat_id) {
+    return is_open() && (_pending.find(chat_id) != _pending.end() || is_file_exist(_file_path(chat_id)));
+}
+
+void MessageStore::remove(const std::string& chat_id, int64_t id) {
+    if (!id || !has_chat(chat_id)) {
+        // nothing stored for this chat
+        return;
+    }
+    char record[32];
+    snprintf(record, sizeof(record), "D %lld\n", (long long) id);
+    _append(chat_id, record);
+}
+
+void MessageStore::clear_chat(const std::string& chat_id) {
+    if (!is_open()) {
+        return;
+    }
+    _pending.erase(chat_id);
+    _compacted_size.erase(chat_id);
+    ::remove(_file_path(chat_id).c_str());
+}
+
+void MessageStore::flush() {
+    _flush_scheduled = false;
+    if (!is_open()) {
+        _pending.clear();
+        return;
+    }
+    std::map<std::string, std::string> pending;
+    pending.swap(_pending);
+    for (auto &chat_records : pending) {
+        _flush_chat(chat_records.first, chat_records.second);
+    }
+}
+
+void MessageStore::_flush_chat(const std::string& chat_id, const std::string& records) {
+    std::string path = _file_path(chat_id);
+    bool is_new = !is_file_exist(path);
+    FILE *f = fopen(path.c_str(), is_new ? "wb" : "ab");
+    if (!f) {
+        Logger::error("MessageStore can't write %s", path.c_str());
+        return;
+    }
+    if (is_new) {
+        fprintf(f, "%s\n", MESSAGE_STORE_SIGNATURE);
+    }
+    fwrite(records.data(), 1, records.size(), f);
+    long size = ftell(f);
+    fclose(f);
+    _stats.flushes++;
+    _stats.written_bytes += records.size();
+    if (size > MESSAGE_STORE_COMPACT_BYTES && size > _compacted_size[chat_id] * 2) {
+        _compact(chat_id);
+    }
+}
+
+bool MessageStore::_read(const std::string& chat_id, std::map<int64_t, cJSON*>& messages) {
+    std::string path = _file_path(chat_id);
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f) {
+        // crash between removing old file and renaming compacted one
+        std::string tmp_path = path + "/tmp";
+        if (!is_file_exist(tmp_path) || rename(tmp_path.c_str(), path.c_str()) != 0 ||
+            !(f = fopen(path.c_str(), "rb"))) {
+            return true;
+        }
+    }
+    std::string line, data;
+    bool ok = read_line(f, line) && line == MESSAGE_STORE_SIGNATURE;
+    while (ok && read_line(f, line)) {
+        long long id;
+        unsigned long len;
+        if (line.empty()) {
+            continue;
+        }
+        if (line[0] == 'M' || line[0] == 'U') {
+            if (sscanf(line.c_str() + 1, " %lld %lu", &id, &len) != 2 || !read_block(f, data, len)) {
+                ok = false;
+                break;
+            }
+            cJSON *json = cJSON_Parse(data.c_str());
+            if (!json) {
+                ok = false;
+                break;
+            }
+            int64_t new_id = JsonData::get_int64_value(json, "new_id", 0);
+            auto found = messages.find(id);
+            if (found == messages.end() && line[0] == 'U') {
+                // message is older than stored ones or was compacted out
+                cJSON_Delete(json);
+                continue;
+            }
+            if (found == messages.end()) {
+                cJSON_DeleteItemFromObjectCaseSensitive(json, "new_id");
+                messages[id] = json;
+            } else {
+                merge_message(found->second, json);
+                cJSON_Delete(json);
+            }
+            if (new_id && new_id != id) {
+                cJSON *msg = messages[id];
+                messages.erase(id);
+                cJSON_ReplaceItemInObjectCaseSensitive(msg, "id", cJSON_CreateInt(new_id));
+                found = messages.find(new_id);
+                if (found != messages.end()) {
+                    cJSON_Delete(found->second);
+                }
+                messages[new_id] = msg;
+            }
+        } else if (line[0] == 'D') {
+            if (sscanf(line.c_str(), "D %lld", &id) != 1) {
+                ok = false;
+                break;
+            }
+            auto found = messages.find(id);
+            if (found != messages.end()) {
+                cJSON_Delete(found->second);
+                messages.erase(found);
+            }
+        } else {
+            ok = false;
+        }
+    }
+    if (!line.empty()) {
+        // last record was cut
+        ok = false;
+    }
+    fclose(f);
+    if (!ok) {
+        Logger::warn("MessageStore %s is broken after %u messages", path.c_str(), (unsigned) messages.size());
+        _stats.broken_files++;
+    }
+    while (messages.size() > MESSAGE_STORE_MAX_MESSAGES) {
+        cJSON_Delete(messages.begin()->second);
+        messages.erase(messages.begin());
+    }
+    return ok;
+}
+
+size_t MessageStore::load(const std::string& chat_id, const std::function<void(const cJSON* json)>& on_message) {
+    if (!is_open()) {
+        return 0;
+    }
+    os_t start = os_read_monotonic_time();
+    flush();
+    std::map<int64_t, cJSON*> messages;
+    bool ok = _read(chat_id, messages);
+    size_t count = messages.size();
+    if (!ok) {
+        // appends must not go after cut record
+        _rewrite(chat_id, messages);
+    }
+    for (auto &msg : messages) {
+        on_message(msg.second);
+        cJSON_Delete(msg.second);
+    }
+    os_t elapsed = os_read_monotonic_time() - start;
+    _stats.loads++;
+    _stats.loaded_messages += count;
+    _stats.load_cs += elapsed;
+    Logger::debug("MessageStore::load chat %s %u messages in %u cs", chat_id.c_str(), (unsigned) count, (unsigned) elapsed);
+    return count;
+}
+
+void MessageStore::_compact(const std::string& chat_id) {
+    std::map<int64_t, cJSON*> messages;
+    _read(chat_id, messages);
+    _rewrite(chat_id, messages);
+    for (auto &msg : messages) {
+        cJSON_Delete(msg.second);
+    }
+}
+
+// file is written anew to temporary one which then replaces it, crash keeps one of them whole
+void MessageStore::_rewrite(const std::string& chat_id, const std::map<int64_t, cJSON*>& messages) {
+    std::string path = _file_path(chat_id);
+    if (messages.empty()) {
+        ::remove(path.c_str());
+        _compacted_size.erase(chat_id);
+        return;
+    }
+    std::string tmp_path = path + "/tmp";
+    FILE *f = fopen(tmp_path.c_str(), "wb");
+    if (f) {
+        fprintf(f, "%s\n", MESSAGE_STORE_SIGNATURE);
+        for (auto &msg : messages) {
+            std::string record = message_record('M', msg.first, msg.second);
+            fwrite(record.data(), 1, record.size(), f);
+        }
+        long size = ftell(f);
+        fclose(f);
+        ::remove(path.c_str());
+        if (rename(tmp_path.c_str(), path.c_str()) == 0) {
+            _compacted_size[chat_id] = size;
+            _stats.compactions++;
+            _stats.written_bytes += size;
+        } else {
+            Logger::error("MessageStore::compact can't rename %s", tmp_path.c_str());
+        }
+    } else {
+        Logger::error("MessageStore::compact can't write %s", tmp_path.c_str());
+    }
+}
+
+bool MessageStore::dump_stats(const char* file_name, const char* mode) {
+    FILE *f = fopen(file_name, mode);
+    if (!f) {
+        return false;
+    }
+    fprintf(f, "message store: loads:%lu loaded_messages:%lu avg_load_cs:%lu appended_records:%lu flushes:%lu "
+               "compactions:%lu broken_files:%lu written_bytes:%llu\n",
+            _stats.loads, _stats.loaded_messages, _stats.loads ? _stats.load_cs / _stats.loads : 0,
+            _stats.appended_records, _stats.flushes, _stats.compactions, _stats.broken_files, _stats.written_bytes);
+    fclose(f);
+    return true;
+}
@@ -0,0 +1,74 @@
+/* MessageStore.h
+
+   Local copy of loaded chat messages, so chat opens from disk at once and only messages newer
+   than stored ones are fetched. Messages are kept as raw JSON records the way server sent them
+   (text entities, attachments, reply and forward info), later partial updates are merged over
+   them on load. Every chat has own append-only file, appends are collected and written at next
+   idle. File is compacted to MESSAGE_STORE_MAX_MESSAGES newest messages when it grows.
+
+   Files are in one directory per user, ".user" file there tells whose they are.
+   Chat file: "CCMS 1" line, then records:
+     M <id> <len>\n<json>\n     message or update of it, "new_id" in json moves it to new id
+     U <id> <len>\n<json>\n     update only, dropped when message is not stored
+     D <id>\n                   message deleted
+   Record cut by crash while appending is ignored with anything after it.
+
+ */
+
+#ifndef ROCHAT_MESSAGESTORE_H
+#define ROCHAT_MESSAGESTORE_H
+
+#include <string>
+#include <map>
+#include <functional>
+#include <cstdint>
+#include "../libs/cJSON/cJSON.h"
+
+#define MESSAGE_STORE_MAX_MESSAGES      300
+#define MESSAGE_STORE_COMPACT_BYTES     (256 * 1024)   // no compaction of smaller files
+
+struct MessageStoreStats {
+    unsigned long loads = 0;
+    unsigned long loaded_messages = 0;
+    unsigned long load_cs = 0;
+    unsigned long appended_records = 0;
+    unsigned long flushes = 0;
+    unsigned long compactions = 0;
+    unsigned long broken_files = 0;         // cut or unreadable records found on load
+    unsigned long long written_bytes = 0;
+};
+
+class MessageStore {
+private:
+    const char* _dir = "<Choices$Write>.ChatCube.msgstore";
+    std::string _user_id;
+    std::map<std::string, std::string> _pending;    // chat id -> records not written yet
+    std::map<std::string, long> _compacted_size;    // chat id -> file size after last compaction
+    bool _flush_scheduled = false;
+    MessageStoreStats _stats;
+    std::string _file_path(const std::string& chat_id);
+    void _append(const std::string& chat_id, const std::string& record);
+    void _flush_chat(const std::string& chat_id, const std::string& records);
+    bool _read(const std::string& chat_id, std::map<int64_t, cJSON*>& messages);
+    void _compact(const std::string& chat_id);
+    void _rewrite(const std::string& chat_id, const std::map<int64_t, cJSON*>& messages);
+public:
+    ~MessageStore();
+    void open(const std::string& user_id);
+    void clear();                   // logout, stored messages of that user are dropped
+    bool is_open() { return !_user_id.empty(); }
+
+    void put(const std::string& chat_id, const cJSON* json);
+    // update event for chat not in memory, merged over stored message on load; nothing if chat has no store file
+    void update(const std::string& chat_id, const cJSON* json);
+    bool has_chat(const std::string& chat_id);
+    void remove(const std::string& chat_id, int64_t id);
+    void clear_chat(const std::string& chat_id);
+    // calls on_message for stored messages of chat from oldest id, returns their count
+    size_t load(const std::string& chat_id, const std::function<void(const cJSON* json)>& on_message);
+    void flush();
+    const MessageStoreStats& get_stats() { return _stats; }
+    bool dump_stats(const char* file_name, const char* mode="w");
+};
+
+#endif //ROCHAT_MESSAGESTORE_H
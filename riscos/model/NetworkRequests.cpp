@@ -2,8 +2,12 @@
 // Created by lenz on 2/3/20.
 //
 #include <sstream>
+#include <vector>
+#include <algorithm>
 #include <errno.h>
 #include <unistd.h>
+#include <sys/stat.h>
+#include <tbx/path.h>
 #include <cloverleaf/Logger.h>
 #include "NetworkRequests.h"
 #include "AppEvents.h"
@@ -13,6 +17,8 @@
 #define FILE_TYPE_JPEG 0xC85
 #define FILE_TYPE_GIF 0x695
 #define DEFAULT_TIMEOUT 60
+#define PARTIAL_DOWNLOAD_MAX_AGE (7 * 24 * 3600)            // sec
+#define PARTIAL_DOWNLOADS_MAX_SIZE (32 * 1024 * 1024)
 
 const static char* _tmp_downloads_dir = "<Choices$Write>.ChatCube.temp_downloads";
 
@@ -172,29 +178,189 @@ void CLChatRequest::on_fail() {
 CLDownloadFileRequest::CLDownloadFileRequest(const string &url, RequestSuccessCallbackType success_callback) :
         CLChatRequest("GET", url, success_callback) {
     set_timeout(0);
+    timing_class = HTTP_TIMING_DOWNLOAD;
 }
 
 CLDownloadFileRequest::CLDownloadFileRequest(const string &url, RequestSuccessCallbackType success_callback, RequestFailCallbackType fail_callback) :
         CLChatRequest("GET", url, success_callback, fail_callback) {
     set_timeout(0);
+    timing_class = HTTP_TIMING_DOWNLOAD;
 }
 int CLDownloadFileRequest::file_id = 0;
 
 bool CLDownloadFileRequest::on_before_submit() {
+    headers_map.erase("If-Range");
+    resume_offset = 0;
+    content_range_start = -1;
+    written = 0;
+    range_not_satisfiable = false;
+    if (resumable) {
+        std::string partial_path = get_partial_path();
+        std::string validator_path = get_validator_path();
+        long partial_size = get_filesize(partial_path.c_str());
+        if (partial_size > 0 && is_file_exist(validator_path)) {
+            resume_offset = partial_size;
+            headers_map["If-Range"] = get_file_contents(validator_path.c_str());
+            Logger::debug("CLDownloadFileRequest resume %s from %ld", url.c_str(), partial_size);
+        }
+    }
     if (!CLChatRequest::on_before_submit()) {
         return false;
     }
-    curl_easy_setopt(curl_handle, CURLOPT_ACCEPT_ENCODING, "");
+    if (resume_offset > 0) {
+        char range[32];
+        snprintf(range, sizeof(range), "%lld-", (long long) resume_offset);
+        curl_easy_setopt(curl_handle, CURLOPT_RANGE, range);
+    } else if (!resumable) {
+        // byte ranges of content-encoded response would not match file on disk, so no encoding for resumable ones
+        curl_easy_setopt(curl_handle, CURLOPT_ACCEPT_ENCODING, "");
+    }
     set_lowspeed_limit(30,10);
     return true;
 }
 
+std::string CLDownloadFileRequest::get_partial_path() {
+    return std::string(_tmp_downloads_dir) + ".r" + str_hash_hex(url);
+}
+
+std::string CLDownloadFileRequest::get_validator_path() {
+    return std::string(_tmp_downloads_dir) + ".v" + str_hash_hex(url);
+}
+
+void CLDownloadFileRequest::remove_partial() {
+    unlink(get_partial_path().c_str());
+    unlink(get_validator_path().c_str());
+}
+
+void CLDownloadFileRequest::expire_partials() {
+    tbx::Path dir = tbx::Path(_tmp_downloads_dir);
+    if (!dir.directory()) {
+        return;
+    }
+    struct Partial {
+        std::string name;
+        time_t modified;
+        long size;
+    };
+    std::vector<Partial> partials;
+    time_t now = time(NULL);
+    for (auto leaf = dir.begin(); leaf != dir.end(); leaf++) {
+        std::string name = std::string(_tmp_downloads_dir) + "." + *leaf;
+        struct stat st;
+        if (leaf->empty() || stat(name.c_str(), &st) != 0) {
+            continue;
+        }
+        if ((*leaf)[0] == 'r') {
+            partials.push_back({leaf->substr(1), st.st_mtime, (long) st.st_size});
+        } else if ((*leaf)[0] != 'v') {
+            // not resumable download of previous run
+            unlink(name.c_str());
+        }
+    }
+    // newest first, whatever is over size limit or too old goes
+    std::sort(partials.begin(), partials.end(), [](const Partial& a, const Partial& b) {
+        return a.modified > b.modified;
+    });
+    long total = 0;
+    for (auto &partial : partials) {
+        total += partial.size;
+        if (total > PARTIAL_DOWNLOADS_MAX_SIZE || now - partial.modified > PARTIAL_DOWNLOAD_MAX_AGE) {
+            Logger::debug("CLDownloadFileRequest::expire_partials removed %s %ld bytes", partial.name.c_str(), partial.size);
+            unlink((std::string(_tmp_downloads_dir) + ".r" + partial.name).c_str());
+            unlink((std::string(_tmp_downloads_dir) + ".v" + partial.name).c_str());
+        }
+    }
+    // validators left without partial file
+    for (auto leaf = dir.begin(); leaf != dir.end(); leaf++) {
+        if (!leaf->empty() && (*leaf)[0] == 'v' && !is_file_exist(std::string(_tmp_downloads_dir) + ".r" + leaf->substr(1))) {
+            unlink((std::string(_tmp_downloads_dir) + "." + *leaf).c_str());
+        }
+    }
+}
+
+unsigned long CLDownloadFileRequest::on_header(char* c, unsigned long size) {
+    long long start;
+    if (size > 14 && strncasecmp(c, "Content-Range:", 14) == 0 && sscanf(c + 14, " bytes %lld-", &start) == 1) {
+        content_range_start = start;
+    }
+    if (size <= 2 && resume_offset > 0 && get_transfer_response_code() == 416) {
+        // end of headers: partial file is not part of what server has now, transfer is stopped
+        // and should_retry() asks for whole file again
+        Logger::debug("CLDownloadFileRequest %s range from %lld not satisfiable", url.c_str(), (long long) resume_offset);
+        remove_partial();
+        range_not_satisfiable = true;
+        error_text = "Requested range not satisfiable";
+        return 0;
+    }
+    return CLChatRequest::on_header(c, size);
+}
+
+bool CLDownloadFileRequest::should_retry(CURLcode result) {
+    if (range_not_satisfiable) {
+        if (restarted_from_start) {
+            return false;
+        }
+        restarted_from_start = true;
+        return true;
+    }
+    return CLChatRequest::should_retry(result);
+}
+
+bool CLDownloadFileRequest::open_saved_file() {
+    if (!is_directory_exist (_tmp_downloads_dir)) {
+        mkdir(_tmp_downloads_dir, 0777);
+    }
+    if (resumable) {
+        long code = get_transfer_response_code();
+        saved_file_path = get_partial_path();
+        if (code == 206) {
+            if (resume_offset == 0 || content_range_start != resume_offset) {
+                error_text = "Unexpected Content-Range in response";
+                Logger::error("CLDownloadFileRequest %s asked from %lld got from %lld", url.c_str(), (long long) resume_offset, (long long) content_range_start);
+                remove_partial();
+                return false;
+            }
+            saved_file = fopen(saved_file_path.c_str(), "ab");
+            Logger::debug("CLDownloadFileRequest resumed at %lld: %s", (long long) resume_offset, saved_file_path.c_str());
+        } else {
+            // whole file sent: validator did not match or server ignores ranges
+            resume_offset = 0;
+            saved_file = fopen(saved_file_path.c_str(), "wb");
+            std::string validator = !response_etag.empty() ? response_etag : response_last_modified;
+            if (validator.empty()) {
+                unlink(get_validator_path().c_str());
+            } else {
+                FILE *f = fopen(get_validator_path().c_str(), "wb");
+                if (f) {
+                    fputs(validator.c_str(), f);
+                    fclose(f);
+                }
+            }
+        }
+    } else {
+        char tmp[255];
+        sprintf(tmp, "%s.temp%dXXXXXX", _tmp_downloads_dir, file_id++);
+        mktemp(tmp);
+        saved_file_path = tmp;
+        saved_file = fopen(saved_file_path.c_str(), "wb");
+    }
+    if (!saved_file) {
+        char err_buffer[ 256 ];
+        strerror_r(errno, err_buffer, 256 ); // get string message from errno, XSI-compliant version
+        error_text = "Can't write to: " + saved_file_path + " error:" + err_buffer;
+        Logger::error("CLDownloadFileRequest::on_append_content %s", error_text.c_str());
+        return false;
+    }
+    Logger::debug("CLDownloadFileRequest::on_append_content created tmp file: %s", saved_file_path.c_str());
+    return true;
+}
+
 curl_off_t CLDownloadFileRequest::get_total_size() {
     if (!total_size) {
         double content_length;
         curl_easy_getinfo(curl_handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD, &content_length);
         if (content_length != -1) {
-            total_size = content_length;
+            total_size = content_length + resume_offset; // 206 tells length of the rest only
         } else {
             total_size = total_size_hint;
         }
@@ -203,32 +369,24 @@ curl_off_t CLDownloadFileRequest::get_total_size() {
 }
 
 unsigned long CLDownloadFileRequest::on_append_content(char* c, unsigned long size) {
-    unsigned long written;
+    unsigned long chunk_written;
     if (!saved_file) {
-        std::stringstream ss;
-        if (!is_directory_exist (_tmp_downloads_dir)) {
-            mkdir(_tmp_downloads_dir, 0777);
+        if (resumable) {
+            long code = get_transfer_response_code();
+            if (code < 200 || code >= 300) {
+                // error page must not overwrite partial file
+                return size;
+            }
         }
-        char tmp[255];
-        sprintf(tmp, "%s.temp%dXXXXXX", _tmp_downloads_dir, file_id++);
-        mktemp(tmp);
-        saved_file_path = tmp;
-        saved_file = fopen(saved_file_path.c_str(), "wb");
-        if (!saved_file) {
-            char err_buffer[ 256 ];
-            strerror_r(errno, err_buffer, 256 ); // get string message from errno, XSI-compliant version
-            response_text = "Can't write to: " + saved_file_path + " error:" + err_buffer;
-            response_code = 0;
-            Logger::error("CLDownloadFileRequest::on_append_content %s", response_text.c_str());
+        if (!open_saved_file()) {
             return 0;
-        } else {
-            Logger::debug("CLDownloadFileRequest::on_append_content created tmp file: %s", saved_file_path.c_str());
         }
     }
-    written = fwrite(c, 1, size, saved_file);
+    chunk_written = fwrite(c, 1, size, saved_file);
+    written += chunk_written;
     if (needs_progress) {
         curl_off_t total = get_total_size();
-        unsigned long saved_size = ftell(saved_file);
+        unsigned long saved_size = resume_offset + written;
         // if total is unknown then use some predefined values just to draw something on progress bar
         if (total == 0) {
             if (saved_size < 10000) {
@@ -244,18 +402,43 @@ unsigned long CLDownloadFileRequest::on_append_content(char* c, unsigned long si
         on_progress(total, saved_size, 0, 0);
         //Logger::error("CLDownloadFileRequest::on_append_content %ld %lld", saved_size, total_size);
     }
-    return written;
+    return chunk_written;
 }
 
 void CLDownloadFileRequest::process_response() {
-    fclose(saved_file);
-    saved_file = NULL;
+    if (saved_file) {
+        fclose(saved_file);
+        saved_file = NULL;
+    }
+    completed = (response_code >= 200 && response_code < 300);
     CLChatRequest::process_response();
 }
 
+void CLDownloadFileRequest::on_retry() {
+    if (saved_file) {
+        fclose(saved_file);
+        saved_file = NULL;
+    }
+    // partial file of resumable download is kept for next attempt, otherwise start from scratch
+    if (!saved_file_path.empty() && !resumable) {
+        unlink(saved_file_path.c_str());
+        saved_file_path.clear();
+    }
+    total_size = 0;
+    CLChatRequest::on_retry();
+}
+
 CLDownloadFileRequest::~CLDownloadFileRequest() {
     Logger::debug("~CLDownloadFileRequest %s this:%p", saved_file_path.c_str(), this);
-    if (!saved_file_path.empty()) {
+    if (saved_file) {
+        fclose(saved_file);
+        saved_file = NULL;
+    }
+    if (resumable && !completed) {
+        Logger::debug("~CLDownloadFileRequest kept partial download %s", saved_file_path.c_str());
+    } else if (resumable) {
+        remove_partial();
+    } else if (!saved_file_path.empty()) {
         Logger::debug("~CLDownloadFileRequest removed: %s", saved_file_path.c_str());
         unlink(saved_file_path.c_str());
     }
@@ -307,5 +490,7 @@ void CLDownloadFileRequest::on_success() {
 
 bool CLChatApiRequest::on_before_submit() {
     headers_map["Accept"] = "application/json";
+    // JSON compresses well, curl decodes gzip/deflate before on_append_content
+    curl_easy_setopt(curl_handle, CURLOPT_ACCEPT_ENCODING, "");
     return CLChatRequest::on_before_submit();
 }
\ No newline at end of file
@@ -60,6 +60,19 @@ protected:
     int file_type = 0xFFD; // ffd - Data;
     static int file_id;
     curl_off_t total_size = 0;
+    // resumable download: partial file and its validator (ETag or Last-Modified) are named by url hash
+    // and kept on failure, next attempt asks only for the rest with Range/If-Range
+    bool resumable = false;
+    bool completed = false;
+    curl_off_t resume_offset = 0;
+    curl_off_t content_range_start = -1;
+    curl_off_t written = 0;
+    bool range_not_satisfiable = false;    // 416 to resume request, partial file is dropped and download restarted
+    bool restarted_from_start = false;     // restart is done once only
+    std::string get_partial_path();
+    std::string get_validator_path();
+    bool open_saved_file();
+    void remove_partial();
 public:
     curl_off_t total_size_hint = 0;
     std::string saved_file_path;
@@ -69,12 +82,19 @@ public:
     ~CLDownloadFileRequest() override ;
     bool on_before_submit() override;
     virtual unsigned long on_append_content(char* c, unsigned long size) override;
+    unsigned long on_header(char* c, unsigned long size) override;
     virtual void process_response() override;
+    void set_resumable(bool on) { resumable = on; };
+    bool can_share_response() override { return false; } // FileCacheDownloader does own dedup by url
+    bool should_retry(CURLcode result) override;
+    void on_retry() override;
     void on_success() override;
     int get_riscos_file_type();
     void set_default_file_type(int t) { file_type = t; };
     curl_off_t get_total_size();
     bool move_file(const char* to);
+    // at start: temp files of previous run and partial downloads too old or over size limit are removed
+    static void expire_partials();
 };
 
 class CLChatApiRequest: public CLChatRequest {
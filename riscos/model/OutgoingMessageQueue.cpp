@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <string.h>
+#include <set>
+#include <algorithm>
+#include <sys/stat.h>
+#include <cloverleaf/Logger.h>
+#include <cloverleaf/CLException.h>
+#include "OutgoingMessageQueue.h"
+#include "JsonData.h"
+#include "../utils.h"
+
+void OutgoingMessageQueue::load(const std::string& user_id) {
+    _items.clear();
+    _user_id = user_id;
+    _loaded = true;
+    if (!is_file_exist(_file_path)) {
+        return;
+    }
+    cJSON *json = cJSON_Parse(get_file_contents(_file_path).c_str());
+    if (!json) {
+        Logger::error("OutgoingMessageQueue::load broken %s", _file_path);
+        ::remove(_file_path);
+        return;
+    }
+    if (JsonData::get_string_value(json, "user", "") != user_id) {
+        // queued by other account, can't be sent by this one
+        Logger::warn("OutgoingMessageQueue::load queue of other user dropped");
+        cJSON_Delete(json);
+        ::remove(_file_path);
+        return;
+    }
+    _next_seq = JsonData::get_int64_value(json, "next_seq", 1);
+    const cJSON *item;
+    cJSON_ArrayForEach(item, cJSON_GetObjectItemCaseSensitive(json, "items")) {
+        OutgoingMessage om;
+        om.seq = JsonData::get_int64_value(item, "seq", 0);
+        om.chat_id = JsonData::get_string_value(item, "chat_id", "");
+        om.file_path = JsonData::get_string_value(item, "file", "");
+        om.file_name = JsonData::get_string_value(item, "file_name", "");
+        om.thumb = JsonData::get_string_value(item, "thumb", "");
+        om.upload_id = JsonData::get_string_value(item, "upload_id", "");
+        om.attempts = JsonData::get_int_value(item, "attempts", 0);
+        om.queued_at = JsonData::get_int64_value(item, "queued_at", 0);
+        const cJSON *field;
+        cJSON_ArrayForEach(field, cJSON_GetObjectItemCaseSensitive(item, "post")) {
+            if (cJSON_IsString(field)) {
+                om.post_data[field->string] = field->valuestring;
+            }
+        }
+        if (om.seq == 0 || om.chat_id.empty()) {
+            continue;
+        }
+        if (om.seq >= _next_seq) {
+            _next_seq = om.seq + 1;
+        }
+        _items.push_back(om);
+        _stats.restored++;
+    }
+    cJSON_Delete(json);
+    Logger::info("OutgoingMessageQueue::load %u messages to send", (unsigned) _items.size());
+    _update_busy();
+}
+
+void OutgoingMessageQueue::save() {
+    if (_items.empty()) {
+        ::remove(_file_path);
+        return;
+    }
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, "user", _user_id.c_str());
+    cJSON_AddIntToObject(json, "next_seq", _next_seq);
+    cJSON *items = cJSON_AddArrayToObject(json, "items");
+    for (auto &om : _items) {
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddIntToObject(item, "seq", om.seq);
+        cJSON_AddStringToObject(item, "chat_id", om.chat_id.c_str());
+        cJSON_AddStringToObject(item, "file", om.file_path.c_str());
+        cJSON_AddStringToObject(item, "file_name", om.file_name.c_str());
+        cJSON_AddStringToObject(item, "thumb", om.thumb.c_str());
+        cJSON_AddStringToObject(item, "upload_id", om.upload_id.c_str());
+        cJSON_AddIntToObject(item, "attempts", om.attempts);
+        cJSON_AddIntToObject(item, "queued_at", om.queued_at);
+        cJSON *post = cJSON_AddObjectToObject(item, "post");
+        for (auto &field : om.post_data) {
+            cJSON_AddStringToObject(post, field.first.c_str(), field.second.c_str());
+        }
+        cJSON_AddItemToArray(items, item);
+    }
+    char *str = cJSON_PrintUnformatted(json);
+    FILE *f = fopen(_file_path, "wb");
+    if (f) {
+        fputs(str, f);
+        fclose(f);
+    } else {
+        Logger::error("OutgoingMessageQueue::save can't write %s", _file_path);
+    }
+    free(str);
+    cJSON_Delete(json);
+}
+
+void OutgoingMessageQueue::clear() {
+    _items.clear();
+    _user_id.clear();
+    _loaded = false;
+    ::remove(_file_path);
+    remove_recursive(_files_dir);
+    _update_busy();
+}
+
+OutgoingMessage* OutgoingMessageQueue::add(const std::string& chat_id, const CLStringsMap& post_data, const std::string& file_path,
+                                           const std::string& thumb, MessageDataPtr instant_message) {
+    OutgoingMessage om;
+    om.seq = _next_seq++;
+    om.chat_id = chat_id;
+    om.post_data = post_data;
+    om.thumb = thumb;
+    om.queued_at = time(NULL);
+    om.instant_message = instant_message;
+    om.post_data["client_send_id"] = to_string((int64_t) om.queued_at) + "-" + to_string((int64_t) om.seq);
+    if (!file_path.empty()) {
+        om.file_name = file_basename_append_ext(file_path);
+        om.file_path = std::string(_files_dir) + ".f" + to_string((int64_t) om.seq);
+        try {
+            if (!is_directory_exist(_files_dir)) {
+                mkdir(_files_dir, 0777);
+            }
+            copy_file(file_path.c_str(), om.file_path.c_str());
+        } catch (CLException &ex) {
+            Logger::error("OutgoingMessageQueue::add can't copy %s: %s", file_path.c_str(), ex.what());
+            ::remove(om.file_path.c_str());
+            return nullptr;
+        }
+    }
+    _items.push_back(om);
+    _stats.queued++;
+    if (_items.size() > _stats.max_length) {
+        _stats.max_length = _items.size();
+    }
+    save();
+    _update_busy();
+    return &_items.back();
+}
+
+OutgoingMessage* OutgoingMessageQueue::find(unsigned long seq) {
+    for (auto &om : _items) {
+        if (om.seq == seq) {
+            return &om;
+        }
+    }
+    return nullptr;
+}
+
+void OutgoingMessageQueue::remove(unsigned long seq, bool sent) {
+    for (auto it = _items.begin(); it != _items.end(); ++it) {
+        if (it->seq == seq) {
+            if (sent) {
+                _stats.sent++;
+                _stats.total_latency_cs += (unsigned long) (time(NULL) - it->queued_at) * 100;
+            } else {
+                _stats.failed++;
+            }
+            if (it->file_path.compare(0, strlen(_files_dir), _files_dir) == 0) {
+                ::remove(it->file_path.c_str());
+            }
+            _items.erase(it);
+            save();
+            _update_busy();
+            return;
+        }
+    }
+}
+
+void OutgoingMessageQueue::requeue(unsigned long seq) {
+    OutgoingMessage *om = find(seq);
+    if (om) {
+        om->in_flight = false;
+        om->waiting_connection = true;
+        _stats.requeued++;
+        save();
+    }
+}
+
+void OutgoingMessageQueue::retry_later(unsigned long seq) {
+    OutgoingMessage *om = find(seq);
+    if (om) {
+        int delay = SEND_QUEUE_RETRY_MIN_CS << std::min(om->server_failures, 10);
+        om->in_flight = false;
+        om->server_failures++;
+        om->retry_at = os_read_monotonic_time() + std::min(delay, SEND_QUEUE_RETRY_MAX_CS);
+        _stats.retried++;
+        save();
+    }
+}
+
+void OutgoingMessageQueue::set_upload_id(unsigned long seq, const std::string& upload_id) {
+    OutgoingMessage *om = find(seq);
+    if (om) {
+        om->upload_id = upload_id;
+        save();
+    }
+}
+
+int OutgoingMessageQueue::next_retry_delay_cs() {
+    int delay = -1;
+    os_t now = os_read_monotonic_time();
+    for (auto &om : _items) {
+        if (om.retry_at && !om.in_flight && !om.waiting_connection) {
+            int left = std::max(0, (int) (om.retry_at - now));
+            if (delay < 0 || left < delay) {
+                delay = left;
+            }
+        }
+    }
+    return delay;
+}
+
+void OutgoingMessageQueue::set_connected() {
+    for (auto &om : _items) {
+        om.waiting_connection = false;
+    }
+}
+
+std::vector<OutgoingMessage*> OutgoingMessageQueue::get_ready() {
+    std::vector<OutgoingMessage*> ready;
+    std::set<std::string> seen_chats;
+    os_t now = os_read_monotonic_time();
+    for (auto &om : _items) {
+        if (!seen_chats.insert(om.chat_id).second) {
+            continue; // earlier message of this chat is not sent yet
+        }
+        if (!om.in_flight && !om.waiting_connection && (om.retry_at == 0 || (int) (om.retry_at - now) <= 0)) {
+            ready.push_back(&om);
+        }
+    }
+    return ready;
+}
+
+void OutgoingMessageQueue::_update_busy() {
+    os_t now = os_read_monotonic_time();
+    if (_items.empty() && _busy_since) {
+        _stats.busy_cs += now - _busy_since;
+        _busy_since = 0;
+    } else if (!_items.empty() && !_busy_since) {
+        _busy_since = now;
+    }
+}
+
+bool OutgoingMessageQueue::dump_stats(const char* file_name, const char* mode) {
+    FILE *f = fopen(file_name, mode);
+    if (!f) {
+        return false;
+    }
+    unsigned long busy_cs = _stats.busy_cs + (_busy_since ? os_read_monotonic_time() - _busy_since : 0);
+    fprintf(f, "send queue: length:%u max_length:%lu queued:%lu restored:%lu sent:%lu failed:%lu requeued:%lu "
+               "retried:%lu avg_latency_cs:%lu busy_cs:%lu sent_per_min:%lu\n",
+            (unsigned) _items.size(), _stats.max_length, _stats.queued, _stats.restored, _stats.sent, _stats.failed,
+            _stats.requeued, _stats.retried, _stats.sent ? _stats.total_latency_cs / _stats.sent : 0, busy_cs,
+            busy_cs ? _stats.sent * 6000 / busy_cs : 0);
+    fclose(f);
+    return true;
+}
@@ -0,0 +1,86 @@
+/* OutgoingMessageQueue.h
+
+   Durable ordered queue of messages being sent. Every send goes through it and is kept on disk
+   until server accepts it, so sends survive restart and long offline periods.
+   Messages of one chat are sent one by one in queue order, different chats go in parallel.
+
+ */
+
+#ifndef ROCHAT_OUTGOINGMESSAGEQUEUE_H
+#define ROCHAT_OUTGOINGMESSAGEQUEUE_H
+
+#include <string>
+#include <list>
+#include <vector>
+#include "oslib/os.h"
+#include "../service/CLHTTPService_v2.h"
+#include "AppDataModelTypes.h"
+
+#define SEND_QUEUE_RETRY_MIN_CS     500     // first retry after server error (5xx, 429), doubled each next one
+#define SEND_QUEUE_RETRY_MAX_CS     (5 * 60 * 100)
+#define SEND_QUEUE_MAX_ATTEMPTS     20      // message is dropped after so many failed sends of any kind
+
+struct OutgoingMessage {
+    unsigned long seq = 0;
+    std::string chat_id;
+    CLStringsMap post_data;         // /chat/send/ fields, "client_send_id" lets server drop repeated send
+    std::string file_path;          // queue own copy uploaded before sending (file, photo), empty for text and sticker
+    std::string file_name;          // upload name with extension, taken from original file
+    std::string thumb;              // cached sticker picture shown in instant message
+    std::string upload_id;          // completed upload of file, send is repeated with it without uploading again
+    time_t queued_at = 0;
+    MessageDataPtr instant_message; // not persisted, made again from fields above after restart
+    bool in_flight = false;
+    bool waiting_connection = false; // last attempt failed by network, next one after reconnect
+    os_t retry_at = 0;              // last attempt failed by server busy or restarting, not sent before it
+    int server_failures = 0;        // in a row, gives backoff delay
+    int attempts = 0;               // persisted, so restarts do not reset the limit
+};
+
+struct OutgoingMessageQueueStats {
+    unsigned long queued = 0;
+    unsigned long restored = 0;     // loaded from disk after restart
+    unsigned long sent = 0;
+    unsigned long failed = 0;       // rejected by server, dropped
+    unsigned long requeued = 0;     // network failures, kept for next drain
+    unsigned long retried = 0;      // server errors (5xx, 429), kept and sent again after backoff
+    unsigned long max_length = 0;
+    unsigned long total_latency_cs = 0; // queued -> accepted by server, for sent ones in this run
+    unsigned long busy_cs = 0;      // time queue was not empty, sent / busy_cs is drain throughput
+};
+
+class OutgoingMessageQueue {
+private:
+    const char* _file_path = "<Choices$Write>.ChatCube.sendqueue";
+    const char* _files_dir = "<Choices$Write>.ChatCube.sendqueue_files"; // dropped files can be temporary, queue keeps copy
+    std::list<OutgoingMessage> _items;  // in seq order, list keeps pointers valid
+    std::string _user_id;
+    unsigned long _next_seq = 1;
+    bool _loaded = false;
+    os_t _busy_since = 0;
+    OutgoingMessageQueueStats _stats;
+    void _update_busy();
+public:
+    void load(const std::string& user_id);
+    void save();
+    void clear();                   // logout, queued sends of that user are dropped
+    bool is_loaded() { return _loaded; }
+
+    // nullptr if file can't be copied to queue, original may be temporary and gone before it is sent
+    OutgoingMessage* add(const std::string& chat_id, const CLStringsMap& post_data, const std::string& file_path,
+                         const std::string& thumb, MessageDataPtr instant_message);
+    OutgoingMessage* find(unsigned long seq);
+    void remove(unsigned long seq, bool sent);
+    void requeue(unsigned long seq);
+    void retry_later(unsigned long seq); // server error, same message again after backoff
+    void set_upload_id(unsigned long seq, const std::string& upload_id);
+    int next_retry_delay_cs();      // until message waiting for retry may go, -1 if there is none
+    void set_connected();           // network is back, waiting messages may go
+    std::vector<OutgoingMessage*> get_ready(); // first not yet sent message of each chat if it may go now
+    std::list<OutgoingMessage>& get_items() { return _items; }
+    size_t size() { return _items.size(); }
+    const OutgoingMessageQueueStats& get_stats() { return _stats; }
+    bool dump_stats(const char* file_name, const char* mode="w");
+};
+
+#endif //ROCHAT_OUTGOINGMESSAGEQUEUE_H
@@ -0,0 +1,73 @@
+//
+// On-disk cache of API GET responses, revalidated with ETag / Last-Modified
+//
+// Entry file format: url, auth token hash, etag, last-modified each on own line, then body as is.
+//
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cloverleaf/Logger.h>
+#include "CLHTTPResponseCache.h"
+#include "../utils.h"
+
+std::string CLHTTPResponseCache::_get_filename(const std::string& url) {
+    return _dir + "." + str_hash_hex(url);
+}
+
+static bool read_line(FILE* f, std::string& line) {
+    line.clear();
+    int c;
+    while ((c = fgetc(f)) != EOF && c != '\n') {
+        line += (char) c;
+    }
+    return c != EOF;
+}
+
+bool CLHTTPResponseCache::load(const std::string& url, const std::string& auth_token, CLHTTPCacheEntry& entry, bool with_body) {
+    std::string filename = _get_filename(url);
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    std::string cached_url, token_hash;
+    bool ok = read_line(f, cached_url) && read_line(f, token_hash) &&
+              read_line(f, entry.etag) && read_line(f, entry.last_modified);
+    if (ok && (cached_url != url || token_hash != str_hash_hex(auth_token))) {
+        ok = false;
+    }
+    if (ok && with_body) {
+        long start = ftell(f);
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f) - start;
+        fseek(f, start, SEEK_SET);
+        entry.body.resize(size);
+        if (size > 0 && fread(&entry.body[0], 1, size, f) != (size_t) size) {
+            Logger::error("CLHTTPResponseCache::load short read %s", filename.c_str());
+            ok = false;
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+void CLHTTPResponseCache::store(const std::string& url, const std::string& auth_token, const CLHTTPCacheEntry& entry) {
+    if (!is_directory_exist(_dir)) {
+        mkdir(_dir.c_str(), 0777);
+    }
+    std::string filename = _get_filename(url);
+    FILE *f = fopen(filename.c_str(), "wb");
+    if (!f) {
+        Logger::error("CLHTTPResponseCache::store can't write %s", filename.c_str());
+        return;
+    }
+    fprintf(f, "%s\n%s\n%s\n%s\n", url.c_str(), str_hash_hex(auth_token).c_str(), entry.etag.c_str(), entry.last_modified.c_str());
+    bool ok = fwrite(entry.body.data(), 1, entry.body.size(), f) == entry.body.size();
+    if (fclose(f) != 0 || !ok) {
+        Logger::error("CLHTTPResponseCache::store write failed %s", filename.c_str());
+        unlink(filename.c_str());
+    }
+}
+
+void CLHTTPResponseCache::remove(const std::string& url) {
+    unlink(_get_filename(url).c_str());
+}
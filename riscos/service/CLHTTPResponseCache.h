@@ -0,0 +1,28 @@
+//
+// On-disk cache of API GET responses, revalidated with ETag / Last-Modified
+//
+
+#ifndef ROCHAT_CLHTTPRESPONSECACHE_H
+#define ROCHAT_CLHTTPRESPONSECACHE_H
+
+#include <string>
+
+struct CLHTTPCacheEntry {
+    std::string etag;
+    std::string last_modified;
+    std::string body;
+};
+
+class CLHTTPResponseCache {
+private:
+    std::string _dir;
+    std::string _get_filename(const std::string& url);
+public:
+    CLHTTPResponseCache(const char* dir) : _dir(dir) {};
+    // auth token is part of the entry so response of other user is never served
+    bool load(const std::string& url, const std::string& auth_token, CLHTTPCacheEntry& entry, bool with_body);
+    void store(const std::string& url, const std::string& auth_token, const CLHTTPCacheEntry& entry);
+    void remove(const std::string& url);
+};
+
+#endif //ROCHAT_CLHTTPRESPONSECACHE_H
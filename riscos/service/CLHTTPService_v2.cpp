@@ -5,6 +5,13 @@
 #include <functional>
 #include <sstream>
 #include <stdexcept>
+#include <vector>
+#include <algorithm>
+#include <errno.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/select.h>
+#include <sys/time.h>
 #include <curl/multi.h>
 #include <curl/curl.h>
 #include <oslib/hourglass.h>
@@ -12,13 +19,26 @@
 #include "oslib/resolver.h"
 #include <cloverleaf/Logger.h>
 #include "CLHTTPService_v2.h"
+#include "IKConfig.h"
+#include "CLHTTPResponseCache.h"
 #include "../utils.h"
 #include "../global.h"
 
 #define DEFAULT_CONN_TIMEOUT 5
+#define OFFLINE_PROBE_MIN_DELAY_CS 100
+#define OFFLINE_PROBE_MAX_DELAY_CS 3000
+
+// upper limits of timing histogram buckets, last one takes everything above
+static const unsigned long timing_bucket_limits_ms[HTTP_TIMING_BUCKETS] = {10, 25, 50, 100, 250, 500, 1000, 2500, 5000, ULONG_MAX};
+static const char* timing_class_names[HTTP_TIMING_CLASSES] = {"api", "download", "upload", "event_stream"};
+static const char* shaping_direction_names[HTTP_SHAPING_DIRECTIONS] = {"recv", "send"};
+// weight of priority class in split of shaped budget among classes with running transfers, 0 - class is never shaped
+static const int shaping_share_pct[HTTP_PRIORITY_CLASSES] = {0, 100, 60, 30};
+static const char* timing_phase_names[HTTP_TIMING_PHASES] = {"dns", "connect", "tls", "server", "transfer"};
 static const char *resolved_ip_file_path =  "<Choices$Write>.ChatCube.cache.resolved";
 
 //extern AppState g_app_state;
+// "host:port" of url, default port of scheme is added if url has none
 static void get_host_port_from_url(const char* url, char* host) {
     char *last_pos;
     int len;
@@ -28,16 +48,33 @@ static void get_host_port_from_url(const char* url, char* host) {
         len = last_pos - url - 8;
         strncpy(host, url + 8, len);
         host[len] = 0;
-        strcat(host, ":443");
+        if (!strchr(host, ':')) {
+            strcat(host, ":443");
+        }
     } else if (memcmp(url,"http://",7) == 0) {
         last_pos = strchr(url + 7,'/');
         len = last_pos - url - 7;
         strncpy(host, url + 7, len);
         host[len] = 0;
-        strcat(host, ":80");
+        if (!strchr(host, ':')) {
+            strcat(host, ":80");
+        }
     }
 }
 
+// errors caused by network/server availability (as opposed to cancel by user or local write errors), worth a retry
+static bool is_connection_error(CURLcode result) {
+    return result != CURLE_OK
+           && result != CURLE_ABORTED_BY_CALLBACK
+           && result != CURLE_WRITE_ERROR;
+}
+
+// server could not be reached at all, other errors happen on a working connection
+static bool is_unreachable_error(CURLcode result, double connect_time) {
+    return result == CURLE_COULDNT_CONNECT || result == CURLE_COULDNT_RESOLVE_HOST ||
+           (result == CURLE_OPERATION_TIMEDOUT && connect_time == 0);
+}
+
 static void get_host_from_url(const char* url, char* host) {
     char *last_pos;
     int len;
@@ -53,14 +90,59 @@ static void get_host_from_url(const char* url, char* host) {
         strncpy(host, url + 7, len);
         host[len] = 0;
     }
+    char *port = strchr(host, ':');
+    if (port) {
+        *port = 0;
+    }
+}
+
+static int _CLHTTPService_Socket(CURL *easy, curl_socket_t s, int what, void *userp, void *socketp) {
+    ((CLHTTPService *) userp)->on_curl_socket(s, what);
+    return 0;
+}
+
+static int _CLHTTPService_Timer(CURLM *multi, long timeout_ms, void *userp) {
+    ((CLHTTPService *) userp)->on_curl_timer(timeout_ms);
+    return 0;
 }
 
 CLHTTPService::CLHTTPService() {
     curl_global_init(CURL_GLOBAL_ALL);
     _curl_multi = curl_multi_init();
+    curl_multi_setopt(_curl_multi, CURLMOPT_SOCKETFUNCTION, _CLHTTPService_Socket);
+    curl_multi_setopt(_curl_multi, CURLMOPT_SOCKETDATA, this);
+    curl_multi_setopt(_curl_multi, CURLMOPT_TIMERFUNCTION, _CLHTTPService_Timer);
+    curl_multi_setopt(_curl_multi, CURLMOPT_TIMERDATA, this);
+
+    // all access is from the single wimp task so no lock functions needed
+    _curl_share = curl_share_init();
+    if (_curl_share) {
+        curl_share_setopt(_curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(_curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+        curl_share_setopt(_curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+    } else {
+        Logger::error("CLHTTPService curl_share_init failed, connections will not be shared");
+    }
+    event_stream.curl_share = _curl_share;
 }
 
 CLHTTPService::~CLHTTPService() {
+    _websocket.close();
+    for (auto &call : _websocket_calls) {
+        delete call.second.req;
+    }
+    for (auto req : _retry_requests) {
+        delete req;
+    }
+    _retry_requests.clear();
+    for (auto &queue : _queued_requests) {
+        for (auto req : queue) {
+            delete req;
+        }
+        queue.clear();
+    }
     while (!_running_requests.empty()) {
         std::map<CURL *, CLHTTPRequest*>::iterator cb = _running_requests.begin();
         curl_multi_remove_handle(_curl_multi, cb->first);
@@ -68,10 +150,23 @@ CLHTTPService::~CLHTTPService() {
         _running_requests.erase(cb);
     }
     curl_multi_cleanup(_curl_multi);
+    if (_probe_handle) {
+        curl_multi_remove_handle(_probe_multi, _probe_handle);
+        curl_easy_cleanup(_probe_handle);
+    }
+    if (_probe_multi) {
+        curl_multi_cleanup(_probe_multi);
+    }
+    if (_curl_share) {
+        curl_share_cleanup(_curl_share);
+    }
 
     if (_resolved_addrs) {
         curl_slist_free_all(_resolved_addrs);
     }
+    for (auto addrs : _retired_resolved_addrs) {
+        curl_slist_free_all(addrs);
+    }
 
     curl_global_cleanup();
 }
@@ -82,14 +177,219 @@ void CLHTTPService::init(const string &base, const string &lang, const string &u
     _user_agent = user_agent;
     event_stream.base_url = base;
     event_stream.user_agent = user_agent;
+    _dns_ttl = IKConfig::get_value("network", "dns_ttl", 3600);
+    _load_resolved();
+    _use_socket_action = (IKConfig::get_value("network", "socket_action", 1) != 0);
+    Logger::debug("CLHTTPService::init socket_action mode: %d", _use_socket_action);
+    _set_multiplex(IKConfig::get_value("network", "http2", 0) != 0);
+    set_max_running(HTTP_PRIORITY_INTERACTIVE, IKConfig::get_value("network", "max_interactive", 6));
+    set_max_running(HTTP_PRIORITY_FOREGROUND_MEDIA, IKConfig::get_value("network", "max_foreground_media", 3));
+    set_max_running(HTTP_PRIORITY_BACKGROUND, IKConfig::get_value("network", "max_background", 3));
+    set_max_running(HTTP_PRIORITY_BULK, IKConfig::get_value("network", "max_bulk", 1));
+    _shaping_enabled = (IKConfig::get_value("network", "shaping", 1) != 0);
+    _shaping_reserve_pct = IKConfig::get_value("network", "shaping_reserve_pct", 25);
+    if (_shaping_reserve_pct < 0 || _shaping_reserve_pct > 90) {
+        _shaping_reserve_pct = 25;
+    }
+    // start assuming slow line, estimate grows as soon as traffic shows more
+    _shaping[HTTP_SHAPING_RECV].link_rate = IKConfig::get_value("network", "shaping_recv_rate", 32768);
+    _shaping[HTTP_SHAPING_SEND].link_rate = IKConfig::get_value("network", "shaping_send_rate", 16384);
+
+    std::string trace_replay = IKConfig::get_value("network", "trace_replay");
+    std::string trace_record = IKConfig::get_value("network", "trace_record");
+    if (!trace_replay.empty()) {
+        if (_trace.start_replay(trace_replay, IKConfig::get_value("network", "trace_time_scale_pct", 100))) {
+            is_online = true;
+        }
+    } else if (!trace_record.empty()) {
+        _trace.start_record(trace_record);
+    }
+    event_stream.trace = &_trace;
+
+    // traced traffic must all be HTTP requests and events
+    _use_websocket = (IKConfig::get_value("network", "websocket", 0) != 0) && _trace.get_mode() == HTTP_TRACE_OFF;
+    _websocket.user_agent = user_agent;
+    _websocket.on_message = [this](const std::string& message) { _on_websocket_message(message); };
+    _websocket.on_open = [this]() {
+        _websocket_failures = 0;
+        Logger::info("CLHTTPService event stream over websocket %s", _websocket.get_url().c_str());
+    };
+    _websocket.on_close = [this](bool was_open) { _on_websocket_close(was_open); };
 }
 
-bool CLHTTPService::resolve_server_hostname() {
+void CLHTTPService::set_max_running(int priority, int max_running) {
+    assert(priority >= 0 && priority < HTTP_PRIORITY_CLASSES);
+    _priority_stats[priority].max_running = (max_running > 0 ? max_running : 1);
+}
+
+// HTTP/2 multiplexing lets parallel downloads share one TLS connection to the server
+void CLHTTPService::_set_multiplex(bool on) {
+    _use_multiplex = on;
+    event_stream.use_multiplex = on;
+    curl_multi_setopt(_curl_multi, CURLMOPT_PIPELINING, on ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING);
+    Logger::debug("CLHTTPService http2 multiplexing: %d", on);
+}
+
+void CLHTTPService::on_curl_socket(curl_socket_t s, int what) {
+    if (what == CURL_POLL_REMOVE) {
+        _watched_sockets.erase(s);
+    } else {
+        _watched_sockets[s] = what;
+    }
+}
+
+void CLHTTPService::on_curl_timer(long timeout_ms) {
+    if (timeout_ms < 0) {
+        _curl_timer_active = false;
+        return;
+    }
+    // monotonic time has centisecond resolution, round up so we never wake up before the curl deadline
+    _curl_timer_expire_at = os_read_monotonic_time() + (timeout_ms + 9) / 10;
+    _curl_timer_active = true;
+}
+
+void CLHTTPService::_socket_action(curl_socket_t s, int ev_bitmask) {
+    int running = 0;
+    if (s == CURL_SOCKET_TIMEOUT) {
+        _counters.timer_actions++;
+    } else {
+        _counters.socket_actions++;
+    }
+    curl_multi_socket_action(_curl_multi, s, ev_bitmask, &running);
+}
+
+// advance transfers: only sockets which are ready or expired curl timeout get processed
+void CLHTTPService::_drive_transfers() {
+    _counters.process_calls++;
+    if (!_use_socket_action) {
+        int running = 0;
+        _counters.perform_calls++;
+        curl_multi_perform(_curl_multi, &running);
+        _last_drive_busy = running > 0;
+        return;
+    }
+
+    bool did_work = false;
+    if (!_watched_sockets.empty()) {
+        fd_set fdread;
+        fd_set fdwrite;
+        fd_set fdexcep;
+        int maxfd = -1;
+        struct timeval tv = {0, 0};
+
+        FD_ZERO(&fdread);
+        FD_ZERO(&fdwrite);
+        FD_ZERO(&fdexcep);
+        for (auto &it : _watched_sockets) {
+            if (it.second & CURL_POLL_IN) {
+                FD_SET(it.first, &fdread);
+            }
+            if (it.second & CURL_POLL_OUT) {
+                FD_SET(it.first, &fdwrite);
+            }
+            FD_SET(it.first, &fdexcep);
+            if ((int) it.first > maxfd) {
+                maxfd = it.first;
+            }
+        }
+
+        int ready = select(maxfd + 1, &fdread, &fdwrite, &fdexcep, &tv);
+        if (ready > 0) {
+            // socket callbacks modify _watched_sockets while curl works, so collect ready sockets first
+            std::vector<std::pair<curl_socket_t, int>> ready_sockets;
+            for (auto &it : _watched_sockets) {
+                int ev_bitmask = 0;
+                if (FD_ISSET(it.first, &fdread)) {
+                    ev_bitmask |= CURL_CSELECT_IN;
+                }
+                if (FD_ISSET(it.first, &fdwrite)) {
+                    ev_bitmask |= CURL_CSELECT_OUT;
+                }
+                if (FD_ISSET(it.first, &fdexcep)) {
+                    ev_bitmask |= CURL_CSELECT_ERR;
+                }
+                if (ev_bitmask) {
+                    ready_sockets.push_back(std::make_pair(it.first, ev_bitmask));
+                }
+            }
+            for (auto &it : ready_sockets) {
+                _socket_action(it.first, it.second);
+            }
+            did_work = true;
+        } else if (ready < 0) {
+            // some socket already closed under us, let curl check all of them
+            Logger::error("CLHTTPService::_drive_transfers select error: %d", errno);
+            _socket_action(CURL_SOCKET_TIMEOUT, 0);
+            did_work = true;
+        }
+    }
+
+    if (_curl_timer_active && (int) (os_read_monotonic_time() - _curl_timer_expire_at) >= 0) {
+        // clear before action, curl may set new timeout from inside curl_multi_socket_action
+        _curl_timer_active = false;
+        _socket_action(CURL_SOCKET_TIMEOUT, 0);
+        did_work = true;
+    }
+
+    if (!did_work) {
+        _counters.idle_calls++;
+    }
+    _last_drive_busy = did_work;
+}
+
+// centiseconds until process() has something to do. Sockets can't wake the task up, so running transfers
+// are polled every HTTP_POLL_BUSY_CS and open event stream every listen_cs.
+int CLHTTPService::next_process_delay_cs(int listen_cs) {
+    os_t now = os_read_monotonic_time();
+    if (_trace.replaying()) {
+        return _replay_pending.empty() ? listen_cs : HTTP_POLL_BUSY_CS;
+    }
+    if (!is_online) {
+        if (_probe_handle) {
+            return HTTP_POLL_BUSY_CS;
+        }
+        return _offline_probe_delay_cs > 0 ? std::max(0, (int) (_offline_probe_at - now)) : 0;
+    }
+    int delay = listen_cs;
+    if (_last_drive_busy || !_running_requests.empty()) {
+        delay = std::min(delay, HTTP_POLL_BUSY_CS);
+    }
+    if (_use_socket_action) {
+        if (_curl_timer_active) {
+            delay = std::min(delay, std::max(0, (int) (_curl_timer_expire_at - now)));
+        }
+    } else {
+        long timeout_ms = -1;
+        curl_multi_timeout(_curl_multi, &timeout_ms);
+        if (timeout_ms >= 0) {
+            delay = std::min(delay, (int) ((timeout_ms + 9) / 10));
+        }
+    }
+    for (auto req : _retry_requests) {
+        delay = std::min(delay, std::max(0, (int) (req->retry_at - now)));
+    }
+    if (event_stream.started() && _websocket_transport() && _websocket.get_state() == WEBSOCKET_STATE_CLOSED) {
+        delay = std::min(delay, std::max(0, (int) (_websocket_retry_at - now)));
+    }
+    return delay;
+}
+
+bool CLHTTPService::resolve_server_hostname(bool use_stored) {
     int err, port;
     os_error *os_err;
     char host[130];
     resolver_host_details *host_details;
 
+    if (_trace.replaying()) {
+        return true;
+    }
+    if (use_stored && !_resolved_ip.empty() && _resolved_expires > time(NULL)) {
+        // address from previous run is still valid, connect error will drop it
+        _counters.dns_store_hits++;
+        is_online = true;
+        return true;
+    }
+
     get_host_from_url(_base_url.c_str(), host);
 
 //    os_err = xresolver_cache_control(resolvercachecontrolreason_FLUSH_ALL);
@@ -111,17 +411,11 @@ bool CLHTTPService::resolve_server_hostname() {
         return false;
     }
 
-//    if (memcmp(_base_url.c_str(),"https://",8) == 0) {
-//        port = 443;
-//    } else {
-//        port = 80;
-//    }
-
-//    sprintf(host, "%s:%d:%d.%d.%d.%d", host, port, host_details->addresses[0][0], host_details->addresses[0][1], host_details->addresses[0][2], host_details->addresses[0][3]);
-//    curl_slist_free_all(_resolved_addrs);
-//    _resolved_addrs = curl_slist_append(_resolved_addrs, host);
-//    Logger::debug("resolve hostname: %s", host);
-    Logger::debug("hostname resolved %s:%d.%d.%d.%d", host, host_details->addresses[0][0], host_details->addresses[0][1], host_details->addresses[0][2], host_details->addresses[0][3]);
+    char ip[20];
+    sprintf(ip, "%d.%d.%d.%d", host_details->addresses[0][0], host_details->addresses[0][1], host_details->addresses[0][2], host_details->addresses[0][3]);
+    Logger::debug("hostname resolved %s:%s", host, ip);
+    _set_resolved(ip, time(NULL) + _dns_ttl);
+    _save_resolved();
     is_online = true;
 
     return true;
@@ -129,10 +423,27 @@ bool CLHTTPService::resolve_server_hostname() {
 
 static size_t _IKHTTPRequest_Write(void *content, size_t size, size_t nmemb, void *userp)
 {
+    ((CLHTTPRequest *) userp)->content_bytes_down += size * nmemb;
+    if (((CLHTTPRequest *) userp)->trace) {
+        ((CLHTTPRequest *) userp)->trace_body.append((char *) content, size * nmemb);
+    }
     return ((CLHTTPRequest *) userp)->on_append_content((char *) content, size * nmemb);
     //Logger::debug("_IKHTTPRequest_Write content=%s", ((IKHTTPResponse*)userp)->text.c_str());
 }
 
+static size_t _IKHTTPRequest_Header(char *buffer, size_t size, size_t nitems, void *userp)
+{
+    if (((CLHTTPRequest *) userp)->trace) {
+        ((CLHTTPRequest *) userp)->trace_headers.append(buffer, size * nitems);
+    }
+    return ((CLHTTPRequest *) userp)->on_header(buffer, size * nitems);
+}
+
+static size_t _IKHTTPRequest_Read(char *buffer, size_t size, size_t nitems, void *userp)
+{
+    return ((CLHTTPRequest *) userp)->read_upload_body(buffer, size * nitems);
+}
+
 static int _IKHTTPRequest_XFER(void *p,
                                curl_off_t dltotal, curl_off_t dlnow,
                                curl_off_t ultotal, curl_off_t ulnow)
@@ -155,21 +466,76 @@ void CLHTTPService::submit(CLHTTPRequest* req) {
         url = req_url;
     }
 
+    if (req->websocket_allowed && _websocket.is_open() && req_url[0] == '/') {
+        _submit_over_websocket(req);
+        return;
+    }
+    if (_trace.recording()) {
+        req->trace = true;
+        req->trace_headers.clear();
+        req->trace_body.clear();
+    }
+
+    // identical GET already in flight: attach to it instead of doing the same transfer again
+    if (req->single_flight_key.empty() && req->can_share_response()) {
+        std::string key = req->method + " " + url + " " + _auth_token;
+        auto found = _single_flight_requests.find(key);
+        if (found != _single_flight_requests.end()) {
+            Logger::debug("CLHTTPService single-flight: %s already in flight, attached", url.c_str());
+            found->second->single_flight_followers.push_back(req);
+            _counters.single_flight_saved++;
+            return;
+        }
+        req->single_flight_key = key;
+        _single_flight_requests[key] = req;
+    }
+
+    if (req->use_response_cache && req->method == "GET") {
+        CLHTTPCacheEntry entry;
+        req->response_cache_url = url;
+        if (_response_cache.load(url, _auth_token, entry, false)) {
+            if (!entry.etag.empty()) {
+                req->headers_map["If-None-Match"] = entry.etag;
+            }
+            if (!entry.last_modified.empty()) {
+                req->headers_map["If-Modified-Since"] = entry.last_modified;
+            }
+        }
+    }
+
     if (!req->on_before_submit()) {
+        if (!req->single_flight_key.empty()) {
+            _single_flight_requests.erase(req->single_flight_key);
+        }
         req->on_fail();
         delete(req);
         return;
     }
 
+    if (_trace.replaying()) {
+        _submit_replayed(req, url);
+        return;
+    }
+
     Logger::debug("URL %s handle: %x req: %x", url.c_str(), curl_handle, req);
     curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, _user_agent.c_str());
     curl_easy_setopt(curl_handle, CURLOPT_URL, url.c_str());
     curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, _IKHTTPRequest_Write);
     curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, req);
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, _IKHTTPRequest_Header);
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, req);
     curl_easy_setopt(curl_handle, CURLOPT_PRIVATE, req);
     curl_easy_setopt(curl_handle, CURLOPT_CAINFO, "<ChatCube$Dir>.ssl.chain");
     curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYPEER, false);
-    if (!req->upload_files.empty() && req->needs_progress) {
+    if (_curl_share) {
+        curl_easy_setopt(curl_handle, CURLOPT_SHARE, _curl_share);
+    }
+    if (_use_multiplex) {
+        curl_easy_setopt(curl_handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+        // wait for connection in progress to be multiplexed instead of opening new one
+        curl_easy_setopt(curl_handle, CURLOPT_PIPEWAIT, 1L);
+    }
+    if ((!req->upload_files.empty() || !req->upload_body_file.empty()) && req->needs_progress) {
         curl_easy_setopt(curl_handle, CURLOPT_XFERINFOFUNCTION, _IKHTTPRequest_XFER);
         curl_easy_setopt(curl_handle, CURLOPT_NOPROGRESS, 0L);
         curl_easy_setopt(curl_handle, CURLOPT_PROGRESSDATA, req);
@@ -178,12 +544,216 @@ void CLHTTPService::submit(CLHTTPRequest* req) {
         g_hourglass_on();
     }
 
-//    if (_resolved_addrs) {
-//        //Logger::debug("Use resolved");
-//        curl_easy_setopt(curl_handle, CURLOPT_RESOLVE, _resolved_addrs);
-//    }
-    _running_requests.insert(std::make_pair(curl_handle, req));
-    curl_multi_add_handle(_curl_multi, curl_handle);
+    if (_resolved_addrs) {
+        curl_easy_setopt(curl_handle, CURLOPT_RESOLVE, _resolved_addrs);
+    }
+    req->attempts++;
+    if (req->priority < 0 || req->priority >= HTTP_PRIORITY_CLASSES) {
+        req->priority = HTTP_PRIORITY_INTERACTIVE;
+    }
+    CLHTTPPriorityStats &stats = _priority_stats[req->priority];
+    req->queued_at = os_read_monotonic_time();
+    _queued_requests[req->priority].push_back(req);
+    stats.queued++;
+    if (stats.queued > stats.max_queued) {
+        stats.max_queued = stats.queued;
+    }
+    _admit_queued_requests();
+}
+
+void CLHTTPService::_start_request(CLHTTPRequest* req) {
+    CLHTTPPriorityStats &stats = _priority_stats[req->priority];
+    unsigned long wait_cs = os_read_monotonic_time() - req->queued_at;
+    stats.running++;
+    stats.admitted++;
+    stats.total_wait_cs += wait_cs;
+    if (wait_cs > stats.max_wait_cs) {
+        stats.max_wait_cs = wait_cs;
+    }
+    if (wait_cs > 100) {
+        Logger::debug("CLHTTPService request %s waited %lu cs in priority %d queue", req->url.c_str(), wait_cs, req->priority);
+    }
+    _running_requests.insert(std::make_pair(req->curl_handle, req));
+    _apply_shaping(req);
+    curl_multi_add_handle(_curl_multi, req->curl_handle);
+    // request made from Wimp event should not wait for poll timer planned while nothing was running
+    app_poll_wakeup();
+}
+
+void CLHTTPService::_on_request_finished(CLHTTPRequest* req) {
+    CLHTTPPriorityStats &stats = _priority_stats[req->priority];
+    if (stats.running > 0) {
+        stats.running--;
+    }
+    double size[HTTP_SHAPING_DIRECTIONS] = {0, 0};
+    curl_easy_getinfo(req->curl_handle, CURLINFO_SIZE_DOWNLOAD, &size[HTTP_SHAPING_RECV]);
+    curl_easy_getinfo(req->curl_handle, CURLINFO_SIZE_UPLOAD, &size[HTTP_SHAPING_SEND]);
+    for (int dir = 0; dir < HTTP_SHAPING_DIRECTIONS; dir++) {
+        _shaping[dir].bytes_done += (unsigned long long) size[dir];
+        if (shaping_share_pct[req->priority] > 0) {
+            _shaping[dir].bytes_done_shaped += (unsigned long long) size[dir];
+        }
+    }
+}
+
+void CLHTTPService::_apply_shaping(CLHTTPRequest* req) {
+    curl_off_t recv_cap = _shaping[HTTP_SHAPING_RECV].cap[req->priority];
+    curl_off_t send_cap = _shaping[HTTP_SHAPING_SEND].cap[req->priority];
+    curl_easy_setopt(req->curl_handle, CURLOPT_MAX_RECV_SPEED_LARGE, recv_cap);
+    curl_easy_setopt(req->curl_handle, CURLOPT_MAX_SEND_SPEED_LARGE, send_cap);
+}
+
+// Part of shaped budget for priority class: budget is split by class weights among shaped classes
+// with running transfers (class itself counted as running), so shaped classes together never get
+// more than budget.
+unsigned long CLHTTPService::_shaping_class_budget(int dir, int priority) {
+    if (shaping_share_pct[priority] == 0) {
+        return 0;
+    }
+    unsigned long budget = _shaping[dir].link_rate / 100 * (100 - _shaping_reserve_pct);
+    int weights = 0;
+    for (int p = 0; p < HTTP_PRIORITY_CLASSES; p++) {
+        if (shaping_share_pct[p] > 0 && (p == priority || _priority_stats[p].running > 0)) {
+            weights += shaping_share_pct[p];
+        }
+    }
+    return budget / weights * shaping_share_pct[priority];
+}
+
+// Once per window measure throughput of all transfers and of shaped (non interactive) classes.
+// Shaped classes together get link estimate minus reserved headroom, split by class weight among
+// active classes and then by running transfers. Link estimate follows measured traffic: raised when shaped traffic was held
+// by its cap for several windows (link may carry more), lowered to measured total when link could
+// not carry even the shaped budget (slow line, headroom would be eaten).
+void CLHTTPService::_update_shaping() {
+    os_t now = os_read_monotonic_time();
+    int elapsed = (int) (now - _shaping_window_at);
+    if (!_shaping_enabled || elapsed < HTTP_SHAPING_WINDOW_CS) {
+        return;
+    }
+    bool first_window = (_shaping_window_at == 0);
+    _shaping_window_at = now;
+
+    double running[HTTP_SHAPING_DIRECTIONS] = {0, 0}, running_shaped[HTTP_SHAPING_DIRECTIONS] = {0, 0};
+    int shaped_running = 0;
+    for (auto &item : _running_requests) {
+        double size[HTTP_SHAPING_DIRECTIONS] = {0, 0};
+        curl_easy_getinfo(item.first, CURLINFO_SIZE_DOWNLOAD, &size[HTTP_SHAPING_RECV]);
+        curl_easy_getinfo(item.first, CURLINFO_SIZE_UPLOAD, &size[HTTP_SHAPING_SEND]);
+        bool shaped = shaping_share_pct[item.second->priority] > 0;
+        for (int dir = 0; dir < HTTP_SHAPING_DIRECTIONS; dir++) {
+            running[dir] += size[dir];
+            if (shaped) {
+                running_shaped[dir] += size[dir];
+            }
+        }
+        if (shaped) {
+            shaped_running++;
+        }
+    }
+    if (event_stream.get_curl_handle()) {
+        double size = 0;
+        curl_easy_getinfo(event_stream.get_curl_handle(), CURLINFO_SIZE_DOWNLOAD, &size);
+        running[HTTP_SHAPING_RECV] += size;
+    }
+
+    for (int dir = 0; dir < HTTP_SHAPING_DIRECTIONS; dir++) {
+        CLHTTPShapingStats &sh = _shaping[dir];
+        unsigned long long total = sh.bytes_done + (unsigned long long) running[dir];
+        unsigned long long shaped = sh.bytes_done_shaped + (unsigned long long) running_shaped[dir];
+        // event stream reconnect or retried transfer restart their counters, such window is skipped
+        bool valid = !first_window && total >= sh.bytes_sampled && shaped >= sh.bytes_sampled_shaped;
+        if (valid) {
+            sh.last_rate = (unsigned long) ((total - sh.bytes_sampled) * 100 / elapsed);
+            sh.last_shaped_rate = (unsigned long) ((shaped - sh.bytes_sampled_shaped) * 100 / elapsed);
+        }
+        sh.bytes_sampled = total;
+        sh.bytes_sampled_shaped = shaped;
+        if (!valid || shaped_running == 0) {
+            sh.limited_windows = 0;
+            continue;
+        }
+
+        unsigned long budget = sh.link_rate / 100 * (100 - _shaping_reserve_pct);
+        if (sh.last_rate > sh.link_rate) {
+            sh.link_rate = sh.last_rate;
+        } else if (sh.last_shaped_rate >= budget / 10 * 9) {
+            if (++sh.limited_windows >= HTTP_SHAPING_PROBE_WINDOWS) {
+                sh.link_rate += sh.link_rate / 4;
+                sh.limited_windows = 0;
+                sh.probes_up++;
+                Logger::debug("CLHTTPService shaping %s: probe link rate up to %lu", shaping_direction_names[dir], sh.link_rate);
+            }
+        } else if (sh.last_shaped_rate > 0 && sh.last_rate < budget) {
+            sh.link_rate = sh.last_rate > HTTP_SHAPING_MIN_RATE * 2 ? sh.last_rate : HTTP_SHAPING_MIN_RATE * 2;
+            sh.limited_windows = 0;
+            sh.backoffs++;
+            Logger::debug("CLHTTPService shaping %s: link carries only %lu, back off", shaping_direction_names[dir], sh.last_rate);
+        } else {
+            sh.limited_windows = 0;
+        }
+    }
+
+    bool changed = false;
+    for (int dir = 0; dir < HTTP_SHAPING_DIRECTIONS; dir++) {
+        CLHTTPShapingStats &sh = _shaping[dir];
+        for (int priority = 0; priority < HTTP_PRIORITY_CLASSES; priority++) {
+            unsigned long cap = 0;
+            if (shaping_share_pct[priority] > 0) {
+                int running_in_class = _priority_stats[priority].running > 0 ? _priority_stats[priority].running : 1;
+                cap = _shaping_class_budget(dir, priority) / running_in_class;
+                // floor may take class over its budget, _admit_queued_requests() keeps that to one transfer
+                if (cap < HTTP_SHAPING_MIN_RATE) {
+                    cap = HTTP_SHAPING_MIN_RATE;
+                }
+            }
+            if (cap != sh.cap[priority]) {
+                sh.cap[priority] = cap;
+                sh.cap_changes++;
+                changed = true;
+            }
+        }
+    }
+    if (changed) {
+        // libcurl reads speed limits while transfer goes, new caps apply to running transfers too
+        for (auto &item : _running_requests) {
+            _apply_shaping(item.second);
+        }
+    }
+}
+
+// shaped class gets one more transfer only if its budget still gives each one at least the floor rate
+bool CLHTTPService::_shaping_admits(CLHTTPRequest* req) {
+    const CLHTTPPriorityStats &stats = _priority_stats[req->priority];
+    if (!_shaping_enabled || shaping_share_pct[req->priority] == 0 || stats.running == 0) {
+        return true;
+    }
+    bool upload = !req->upload_files.empty() || !req->upload_body_file.empty();
+    int dir = upload ? HTTP_SHAPING_SEND : HTTP_SHAPING_RECV;
+    return (unsigned long) (stats.running + 1) * HTTP_SHAPING_MIN_RATE <= _shaping_class_budget(dir, req->priority);
+}
+
+// admit queued requests by priority class within class concurrency limits.
+// background and bulk classes are held back while interactive requests are queued or running,
+// and while the class above them still has requests waiting.
+void CLHTTPService::_admit_queued_requests() {
+    const CLHTTPPriorityStats &interactive = _priority_stats[HTTP_PRIORITY_INTERACTIVE];
+    for (int priority = 0; priority < HTTP_PRIORITY_CLASSES; priority++) {
+        std::list<CLHTTPRequest*> &queue = _queued_requests[priority];
+        CLHTTPPriorityStats &stats = _priority_stats[priority];
+        if (priority >= HTTP_PRIORITY_BACKGROUND && (interactive.queued > 0 || interactive.running > 0)) {
+            break;
+        }
+        if (priority >= HTTP_PRIORITY_BACKGROUND && _priority_stats[priority - 1].queued > 0) {
+            break;
+        }
+        while (!queue.empty() && stats.running < stats.max_running && _shaping_admits(queue.front())) {
+            CLHTTPRequest *req = queue.front();
+            queue.pop_front();
+            stats.queued--;
+            _start_request(req);
+        }
+    }
 }
 
 void CLHTTPService::start_event_stream(const std::string &channel, const std::string &start_date) {
@@ -195,6 +765,14 @@ void CLHTTPService::start_event_stream(const std::string &channel, const std::st
         curl_multi_remove_handle(_curl_multi, event_stream.get_curl_handle());
         event_stream.clear_curl_handle();
     }
+    if (_trace.replaying()) {
+        // events come from trace
+        return;
+    }
+    if (_websocket_transport()) {
+        _start_websocket();
+        return;
+    }
     CURL *handle;
     // start event stream listener if it not started yet
     handle = event_stream.make_curl_handle(_resolved_addrs);
@@ -208,6 +786,182 @@ void CLHTTPService::stop_event_stream() {
         curl_multi_remove_handle(_curl_multi, event_stream.get_curl_handle());
         event_stream.clear_curl_handle();
     }
+    if (_websocket.get_state() != WEBSOCKET_STATE_CLOSED) {
+        _websocket.close();
+        _on_websocket_close(true);
+    }
+}
+
+void CLHTTPService::_start_websocket() {
+    std::string url = _base_url + _lang + "/api/ws/";
+    const std::string &last_date = event_stream.get_last_event_date();
+    if (!last_date.empty()) {
+        char *escaped = curl_easy_escape(NULL, last_date.c_str(), last_date.length());
+        url += "?time=";
+        url += escaped;
+        curl_free(escaped);
+    }
+    _counters.websocket_connects++;
+    _websocket.connect(_curl_multi, url, _auth_token.empty() ? "" : "Token " + _auth_token, _resolved_addrs, _curl_share);
+}
+
+// small call as {"call": id, "method", "path", "data"} text message, server replies {"reply": id, "status", "body"}
+void CLHTTPService::_submit_over_websocket(CLHTTPRequest* req) {
+    if (!req->on_before_submit()) {
+        req->on_fail();
+        delete(req);
+        return;
+    }
+    unsigned long call_id = _websocket_next_call++;
+    cJSON *call = cJSON_CreateObject();
+    cJSON_AddIntToObject(call, "call", call_id);
+    cJSON_AddStringToObject(call, "method", req->method.c_str());
+    cJSON_AddStringToObject(call, "path", req->url.c_str());
+    cJSON *data = cJSON_AddObjectToObject(call, "data");
+    for (auto &field : req->post_data) {
+        cJSON_AddStringToObject(data, field.first.c_str(), field.second.c_str());
+    }
+    char *text = cJSON_PrintUnformatted(call);
+    cJSON_Delete(call);
+
+    req->attempts++;
+    _websocket_calls[call_id] = {req, os_read_monotonic_time()};
+    _counters.websocket_calls++;
+    Logger::debug("CLHTTPService websocket call %lu %s %s", call_id, req->method.c_str(), req->url.c_str());
+    _websocket.send_text(text);
+    free(text);
+}
+
+void CLHTTPService::_on_websocket_message(const std::string& message) {
+    static char websocket_url[] = "websocket";
+    cJSON *json = cJSON_Parse(message.c_str());
+    if (json == NULL) {
+        Logger::debug("CLHTTPService websocket message JSON parse error [%s]", message.c_str());
+        return;
+    }
+    const cJSON *reply = cJSON_GetObjectItemCaseSensitive(json, "reply");
+    if (reply && cJSON_IsInt(reply)) {
+        auto found = _websocket_calls.find((unsigned long) reply->valueint64);
+        if (found == _websocket_calls.end()) {
+            Logger::warn("CLHTTPService websocket reply to unknown call %lld", reply->valueint64);
+        } else {
+            CLHTTPRequest *req = found->second.req;
+            _counters.websocket_call_total_cs += os_read_monotonic_time() - found->second.started;
+            _websocket_calls.erase(found);
+            const cJSON *status = cJSON_GetObjectItemCaseSensitive(json, "status");
+            const cJSON *body = cJSON_GetObjectItemCaseSensitive(json, "body");
+            req->response_code = (status && cJSON_IsInt(status)) ? status->valueint : 0;
+            if (body) {
+                char *str = cJSON_PrintUnformatted(body);
+                req->response_text = str;
+                free(str);
+            }
+            req->response_url = websocket_url;
+            req->process_response();
+            delete(req);
+        }
+    } else {
+        event_stream.on_event_json(json);
+    }
+    cJSON_Delete(json);
+}
+
+void CLHTTPService::_on_websocket_close(bool was_open) {
+    // replies of calls in flight are lost with connection, send them by HTTP
+    std::map<unsigned long, CLWebSocketCall> pending;
+    pending.swap(_websocket_calls);
+    for (auto &call : pending) {
+        _counters.websocket_calls_resent++;
+        submit(call.second.req);
+    }
+    if (!event_stream.started()) {
+        return;
+    }
+    if (!was_open) {
+        _websocket_failures++;
+        _counters.websocket_failures++;
+        if (_websocket_failures >= HTTP_WEBSOCKET_MAX_FAILURES) {
+            Logger::warn("CLHTTPService websocket failed %d times, event stream goes back to SSE", _websocket_failures);
+            _counters.websocket_fallbacks++;
+            return;
+        }
+    }
+    _websocket_retry_at = os_read_monotonic_time() + HTTP_WEBSOCKET_RETRY_CS * std::max(1, _websocket_failures);
+}
+
+// response is taken from trace now and delivered after recorded duration (scaled), nothing goes to network
+void CLHTTPService::_submit_replayed(CLHTTPRequest* req, const std::string& url) {
+    CLHTTPReplayItem item;
+    item.req = req;
+    item.url = url;
+    if (!_trace.find_response(req->method, req->url, item.response)) {
+        item.response.code = 0;
+        item.response.body = "Request is not in trace";
+    }
+    if (req->needs_hourglass) {
+        g_hourglass_on();
+    }
+    req->attempts++;
+    item.due = os_read_monotonic_time() + _trace.scale(item.response.duration_cs);
+    _replay_pending.push_back(std::move(item));
+}
+
+void CLHTTPService::_process_replay() {
+    os_t now = os_read_monotonic_time();
+    _counters.process_calls++;
+    for (auto it = _replay_pending.begin(); it != _replay_pending.end();) {
+        if ((int) (now - it->due) < 0) {
+            ++it;
+            continue;
+        }
+        // handlers may submit new requests, item is taken out first
+        CLHTTPReplayItem item = std::move(*it);
+        it = _replay_pending.erase(it);
+        _deliver_replayed(item);
+    }
+
+    CLHTTPTraceEvent event;
+    while (event_stream.started() && _trace.pop_due_event(event)) {
+        cJSON *json = cJSON_Parse(event.json.c_str());
+        if (json) {
+            event_stream.on_event_json(json);
+            cJSON_Delete(json);
+        }
+    }
+    if (!_replay_finished_logged && _trace.replay_finished() && _replay_pending.empty()) {
+        _replay_finished_logged = true;
+        Logger::info("CLHTTPTrace replay finished in %lu cs, %lu requests %lu events, %lu not in trace",
+                     (unsigned long) _trace.elapsed(), _trace.get_stats().replayed_requests,
+                     _trace.get_stats().replayed_events, _trace.get_stats().missing);
+    }
+}
+
+// body goes through on_header/on_append_content like curl would pass it, so streamed parsing and downloads work the same
+void CLHTTPService::_deliver_replayed(CLHTTPReplayItem& item) {
+    CLHTTPRequest *req = item.req;
+    CLHTTPTraceResponse &response = item.response;
+    if (response.code == 0) {
+        req->response_code = 0;
+        req->response_text = response.body;
+        _complete_request(req, &item.url[0]);
+        return;
+    }
+    req->response_code = response.code;
+    size_t pos = 0;
+    while (pos < response.headers.size()) {
+        size_t eol = response.headers.find('\n', pos);
+        size_t len = (eol == std::string::npos ? response.headers.size() : eol + 1) - pos;
+        req->on_header(&response.headers[pos], len);
+        pos += len;
+    }
+    if (!response.body.empty()) {
+        req->content_bytes_down += response.body.size();
+        if (req->on_append_content(&response.body[0], response.body.size()) != response.body.size()) {
+            req->response_code = 0;
+            req->response_text = req->error_text.empty() ? curl_easy_strerror(CURLE_WRITE_ERROR) : req->error_text;
+        }
+    }
+    _complete_request(req, &item.url[0]);
 }
 
 //void CLHTTPService::_process_request(CURLMsg* msg) {
@@ -233,55 +987,62 @@ void CLHTTPService::stop_event_stream() {
 
 void CLHTTPService::process() {
     bool event_stream_restarted = false;
-    int running = 1, messagesLeft = -1;
-    long curl_timeo;
+    int messagesLeft = -1;
     CURLMsg *curlMsg;
     CURL *handle;
-    fd_set fdread;
-    fd_set fdwrite;
-    fd_set fdexcep;
-    int maxfd = -1;
 
-    if (!is_online && !resolve_server_hostname()) {
-        Logger::debug("Server hostname still not resolved, run requests next time");
+    if (_trace.replaying()) {
+        _process_replay();
         return;
     }
+    if (!is_online && !_probe_server_online()) {
+        return;
+    }
+    _submit_due_retries();
+    _update_shaping();
 
 //    Logger::debug("es started=%d", event_stream.started());
-    if (event_stream.started() && !event_stream.get_curl_handle()) {
+    if (event_stream.started() && _websocket_transport()) {
+        if (_websocket.get_state() == WEBSOCKET_STATE_CLOSED &&
+            (int) (os_read_monotonic_time() - _websocket_retry_at) >= 0) {
+            _start_websocket();
+        }
+    } else if (event_stream.started() && !event_stream.get_curl_handle()) {
         // start event stream listener if it not started yet
         handle = event_stream.make_curl_handle(_resolved_addrs);
         curl_multi_add_handle(_curl_multi, handle);
         Logger::debug("make event stream handle %p", handle);
     }
 
-    curl_multi_perform(_curl_multi, &running);
-//    Logger::debug("curl_multi_perform running=%d", running);
+    _drive_transfers();
+    _websocket.process();
 
     while ((curlMsg = curl_multi_info_read(_curl_multi, &messagesLeft))) {
         CURL *e = curlMsg->easy_handle;
 //        Logger::debug("curlMsg=%x msg=%d done=%d, handle=%x, left=%d", curlMsg, curlMsg->msg, CURLMSG_DONE, e, messagesLeft);
-        if (curlMsg->msg == CURLMSG_DONE) {
+        if (curlMsg->msg == CURLMSG_DONE && e == _websocket.get_curl_handle()) {
+            // CONNECT_ONLY handle is done once connected, it stays in multi while websocket is used
+            _websocket.on_connected(curlMsg->data.result);
+        } else if (curlMsg->msg == CURLMSG_DONE) {
             char *url;
-            char host[200];
+            char host[200], api_host[200];
             curl_easy_getinfo(e, CURLINFO_EFFECTIVE_URL, &url);
             get_host_port_from_url(url, host);
+            get_host_port_from_url(_base_url.c_str(), api_host);
             curl_multi_remove_handle(_curl_multi, e);
             Logger::debug("get curl response from handle: %p", e);
-            if (curlMsg->data.result != CURLE_OK) {
+            double connect_time = 0;
+            curl_easy_getinfo(e, CURLINFO_CONNECT_TIME, &connect_time);
+            if (is_unreachable_error(curlMsg->data.result, connect_time) && strcmp(host, api_host) == 0) {
+                // only API server being unreachable means offline, failed media of other hosts or
+                // errors on an established connection are left to the request
                 is_online = false;
+                _verify_server = true;
+                _invalidate_resolved(host);
             }
-//            if (curlMsg->data.result == CURLE_OK) {
-//                if (!_is_host_resolved(host)) {
-//                    char *ip;
-//                    curl_easy_getinfo(e, CURLINFO_PRIMARY_IP, &ip);
-//                    _add_resolved(host, ip);
-//                }
-//            } else {
-//                // connection errors may cause by old resolved addr so clear resolved addresses
-//                is_online = false;
-//            }
             if (e == event_stream.get_curl_handle()) {
+                _record_timing(e, HTTP_TIMING_EVENT_STREAM, curlMsg->data.result != CURLE_OK,
+                               event_stream.get_connection_inflated_bytes());
 //                curl_multi_remove_handle(_curl_multi, e);
                 event_stream.clear_curl_handle();
                 if (event_stream.started()) {
@@ -297,27 +1058,37 @@ void CLHTTPService::process() {
                 int erased = _running_requests.erase(e);
                 if (!erased) {
                     Logger::error("CLHTTPService::_process_request() req not erased from _running_requests (url:%s)", url);
+                } else if (req) {
+                    _on_request_finished(req);
+                    _record_timing(e, req->upload_files.empty() ? req->timing_class : HTTP_TIMING_UPLOAD,
+                                   curlMsg->data.result != CURLE_OK, req->content_bytes_down, req->content_bytes_up);
                 }
                 if (curlMsg->data.result == CURLE_OK) {
                     if (req) {
-                        if (req->needs_hourglass) {
-                            g_hourglass_off();
-                        }
-                        req->response_url = url;
-                        curl_easy_getinfo(e, CURLINFO_RESPONSE_CODE, &req->response_code);
-                        req->process_response();
-                        delete (req);
+                        // curl writes a long, int member would be overrun where long is 64 bit
+                        req->response_code = req->get_transfer_response_code();
+                        _complete_request(req, url);
                     } else {
                         Logger::error("CLHTTPService::_process_request() missing req (%s)", url);
                     }
                 } else {
                     if (req) {
                         const char* connection_error = curl_easy_strerror(curlMsg->data.result);
-                        Logger::error("CLHTTPService::process() CURL error: %s resubmit request %s",
-                                      connection_error, url);
-                        req->cleanup();
-                        req->init();
-                        submit(req);
+                        if (req->should_retry(curlMsg->data.result)) {
+                            Logger::error("CLHTTPService::process() CURL error: %s retry %d/%d request %s",
+                                          connection_error, req->attempts, req->retry_policy.max_attempts, url);
+                            req->cleanup();
+                            req->init();
+                            req->on_retry();
+                            _park_for_retry(req);
+                        } else {
+                            Logger::error("CLHTTPService::process() CURL error: %s request failed %s",
+                                          connection_error, url);
+                            _counters.retries_exhausted++;
+                            req->response_code = 0;
+                            req->response_text = req->error_text.empty() ? connection_error : req->error_text;
+                            _complete_request(req, url);
+                        }
                     }
                 }
             }
@@ -325,8 +1096,9 @@ void CLHTTPService::process() {
             Logger::error("CLHTTPService::process() CURL MSG error: %d", curlMsg->msg);
         }
     }
+    _admit_queued_requests();
 
-    if (!event_stream_restarted && event_stream.started() && !event_stream.is_active()) {
+    if (!event_stream_restarted && event_stream.started() && !_websocket_transport() && !event_stream.is_active()) {
         Logger::warn("CLHTTPService::event_stream inactive (restarting)");
         if (resolve_server_hostname()) {
             curl_multi_remove_handle(_curl_multi, event_stream.get_curl_handle());
@@ -339,169 +1111,521 @@ void CLHTTPService::process() {
     }
 }
 
-bool CLHTTPService::connected() {
-    return (event_stream.started() && event_stream.is_connected());
+// curl times are cumulative from start of transfer, split them to phases
+void CLHTTPService::_record_timing(CURL* handle, int timing_class, bool failed, unsigned long long content_down, unsigned long long content_up) {
+    double namelookup = 0, connect = 0, appconnect = 0, starttransfer = 0, total = 0, size_down = 0, size_up = 0;
+    curl_easy_getinfo(handle, CURLINFO_NAMELOOKUP_TIME, &namelookup);
+    curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME, &connect);
+    curl_easy_getinfo(handle, CURLINFO_APPCONNECT_TIME, &appconnect);
+    curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME, &starttransfer);
+    curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME, &total);
+    curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD, &size_down);
+    curl_easy_getinfo(handle, CURLINFO_SIZE_UPLOAD, &size_up);
+
+    double connected = appconnect > connect ? appconnect : connect;
+    double phases[HTTP_TIMING_PHASES];
+    phases[HTTP_TIMING_DNS] = namelookup;
+    phases[HTTP_TIMING_CONNECT] = connect - namelookup;
+    phases[HTTP_TIMING_TLS] = appconnect > 0 ? appconnect - connect : 0;
+    phases[HTTP_TIMING_SERVER] = starttransfer > 0 ? starttransfer - connected : 0;
+    phases[HTTP_TIMING_TRANSFER] = starttransfer > 0 ? total - starttransfer : 0;
+
+    CLHTTPTimingStats &stats = _timing_stats[timing_class];
+    if (timing_class == HTTP_TIMING_API && !failed && _first_api_ttfb_ms == 0) {
+        // time to first byte of first API call after start, the one cold DNS/TLS hurts most
+        _first_api_ttfb_ms = (unsigned long) (starttransfer * 1000);
+        Logger::info("CLHTTPService first API response ttfb %lu ms (dns %lu ms, tls %lu ms)", _first_api_ttfb_ms,
+                     (unsigned long) (phases[HTTP_TIMING_DNS] * 1000), (unsigned long) (phases[HTTP_TIMING_TLS] * 1000));
+    }
+    stats.count++;
+    if (failed) {
+        stats.failed++;
+    }
+    stats.bytes_down += (unsigned long long) size_down;
+    stats.bytes_up += (unsigned long long) size_up;
+    // curl counts body bytes as received, before decoding
+    stats.content_down += content_down ? content_down : (unsigned long long) size_down;
+    stats.content_up += content_up ? content_up : (unsigned long long) size_up;
+    for (int phase = 0; phase < HTTP_TIMING_PHASES; phase++) {
+        unsigned long ms = phases[phase] > 0 ? (unsigned long) (phases[phase] * 1000) : 0;
+        int bucket = 0;
+        while (ms > timing_bucket_limits_ms[bucket]) {
+            bucket++;
+        }
+        stats.histogram[phase][bucket]++;
+        stats.total_ms[phase] += ms;
+        if (ms > stats.max_ms[phase]) {
+            stats.max_ms[phase] = ms;
+        }
+    }
 }
 
-bool CLHTTPService::_is_host_resolved(char* host) {
-    struct curl_slist *addr = _resolved_addrs;
-    int len = strlen(host);
-    while(addr) {
-        if (memcmp(host, addr->data, len) == 0) {
+bool CLHTTPService::dump_stats(const char* file_name, const char* mode) {
+    FILE *f = fopen(file_name, mode);
+    if (!f) {
+        Logger::error("CLHTTPService::dump_stats can't write %s", file_name);
+        return false;
+    }
+    fprintf(f, "Network stats. online:%d multiplex:%d socket_action:%d first_api_ttfb_ms:%lu\n", is_online, _use_multiplex, _use_socket_action, _first_api_ttfb_ms);
+    fprintf(f, "event_stream: compression:%d bytes_wire:%llu bytes_inflated:%llu\n",
+            event_stream.use_compression, event_stream.bytes_wire, event_stream.bytes_inflated);
+    fprintf(f, "counters: process:%lu idle:%lu socket_actions:%lu timer_actions:%lu perform:%lu retries:%lu retries_exhausted:%lu "
+               "offline_probes:%lu single_flight_saved:%lu cache_hits:%lu cache_misses:%lu cache_bytes_saved:%lu "
+               "dns_store_hits:%lu dns_invalidations:%lu\n",
+            _counters.process_calls, _counters.idle_calls, _counters.socket_actions, _counters.timer_actions,
+            _counters.perform_calls, _counters.retries, _counters.retries_exhausted, _counters.offline_probes,
+            _counters.single_flight_saved, _counters.cache_hits, _counters.cache_misses, _counters.cache_bytes_saved,
+            _counters.dns_store_hits, _counters.dns_invalidations);
+    fprintf(f, "websocket: enabled:%d state:%d connects:%lu failures:%lu fallbacks:%lu calls:%lu calls_resent:%lu "
+               "avg_call_cs:%lu messages_in:%lu messages_out:%lu bytes_in:%llu bytes_out:%llu\n",
+            _use_websocket, _websocket.get_state(), _counters.websocket_connects, _counters.websocket_failures,
+            _counters.websocket_fallbacks, _counters.websocket_calls, _counters.websocket_calls_resent,
+            _counters.websocket_calls ? _counters.websocket_call_total_cs / _counters.websocket_calls : 0,
+            _websocket.messages_in, _websocket.messages_out, _websocket.bytes_in, _websocket.bytes_out);
+    _trace.dump_stats(f);
+    for (int priority = 0; priority < HTTP_PRIORITY_CLASSES; priority++) {
+        CLHTTPPriorityStats &ps = _priority_stats[priority];
+        fprintf(f, "priority %d: max_running:%d admitted:%lu max_queued:%d total_wait_cs:%lu max_wait_cs:%lu\n",
+                priority, ps.max_running, ps.admitted, ps.max_queued, ps.total_wait_cs, ps.max_wait_cs);
+    }
+    for (int dir = 0; dir < HTTP_SHAPING_DIRECTIONS; dir++) {
+        CLHTTPShapingStats &sh = _shaping[dir];
+        fprintf(f, "shaping %s: enabled:%d reserve_pct:%d link_rate:%lu last_rate:%lu last_shaped_rate:%lu "
+                   "probes_up:%lu backoffs:%lu cap_changes:%lu caps:",
+                shaping_direction_names[dir], _shaping_enabled, _shaping_reserve_pct, sh.link_rate, sh.last_rate,
+                sh.last_shaped_rate, sh.probes_up, sh.backoffs, sh.cap_changes);
+        for (int priority = 0; priority < HTTP_PRIORITY_CLASSES; priority++) {
+            fprintf(f, " %lu", sh.cap[priority]);
+        }
+        fputc('\n', f);
+    }
+    fprintf(f, "histogram buckets ms:");
+    for (int bucket = 0; bucket < HTTP_TIMING_BUCKETS - 1; bucket++) {
+        fprintf(f, " <=%lu", timing_bucket_limits_ms[bucket]);
+    }
+    fprintf(f, " more\n");
+    for (int tc = 0; tc < HTTP_TIMING_CLASSES; tc++) {
+        CLHTTPTimingStats &ts = _timing_stats[tc];
+        fprintf(f, "%s: count:%lu failed:%lu bytes_down:%llu bytes_up:%llu content_down:%llu content_up:%llu\n",
+                timing_class_names[tc], ts.count, ts.failed, ts.bytes_down, ts.bytes_up, ts.content_down, ts.content_up);
+        if (ts.count == 0) {
+            continue;
+        }
+        for (int phase = 0; phase < HTTP_TIMING_PHASES; phase++) {
+            fprintf(f, "  %-8s avg:%lu max:%lu |", timing_phase_names[phase], ts.total_ms[phase] / ts.count, ts.max_ms[phase]);
+            for (int bucket = 0; bucket < HTTP_TIMING_BUCKETS; bucket++) {
+                fprintf(f, " %lu", ts.histogram[phase][bucket]);
+            }
+            fputc('\n', f);
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+// process response of finished request and share it with requests attached to it by single-flight
+
+#define TRACE_MASK "***"
+
+// trace file is shared for analysis, auth token of login and signup responses must not get there
+static void _mask_trace_secret(std::string& json, const char* quoted_name) {
+    size_t pos = 0;
+    while ((pos = json.find(quoted_name, pos)) != std::string::npos) {
+        pos += strlen(quoted_name);
+        size_t start = json.find_first_not_of(" \t\r\n", pos);
+        if (start == std::string::npos || json[start] != ':') {
+            continue;
+        }
+        start = json.find_first_not_of(" \t\r\n", start + 1);
+        if (start == std::string::npos || json[start] != '"') {
+            continue;
+        }
+        size_t end = start + 1;
+        while (end < json.size() && json[end] != '"') {
+            end += json[end] == '\\' ? 2 : 1;
+        }
+        if (end >= json.size()) {
+            return;
+        }
+        json.replace(start + 1, end - start - 1, TRACE_MASK);
+        pos = start + 1 + strlen(TRACE_MASK) + 1;
+    }
+}
+
+void CLHTTPService::_complete_request(CLHTTPRequest* req, char* url) {
+    if (!req->single_flight_key.empty()) {
+        _single_flight_requests.erase(req->single_flight_key);
+    }
+    if (req->needs_hourglass) {
+        g_hourglass_off();
+    }
+    if (!req->response_cache_url.empty()) {
+        _apply_response_cache(req);
+    }
+    if (req->trace) {
+        // 304 is recorded as the 200 it was turned to, so replay does not depend on response cache
+        bool raw_body = req->response_code != 0 && !req->trace_body.empty();
+        CLStringsMap trace_post = req->post_data;
+        for (auto &item : trace_post) {
+            if (item.first.find("password") != std::string::npos) {
+                item.second = TRACE_MASK;
+            }
+        }
+        std::string trace_body = raw_body ? req->trace_body : req->response_text;
+        _mask_trace_secret(trace_body, "\"token\"");
+        _trace.record_request(req->method, req->url, req->build_url_parameters(trace_post), req->response_code,
+                              req->trace_headers, trace_body, req->queued_at);
+    }
+    req->response_url = url;
+    // copy before leader is processed, its fail handling may take response_text away
+    for (auto follower : req->single_flight_followers) {
+        follower->response_url = url;
+        follower->response_code = req->response_code;
+        follower->response_text = req->response_text;
+    }
+    req->process_response();
+    for (auto follower : req->single_flight_followers) {
+        follower->process_response();
+        delete follower;
+    }
+    req->single_flight_followers.clear();
+    delete (req);
+}
+
+// 304 is turned to 200 with cached body, new validated 200 response is stored
+void CLHTTPService::_apply_response_cache(CLHTTPRequest* req) {
+    if (req->response_code == 304) {
+        CLHTTPCacheEntry entry;
+        if (_response_cache.load(req->response_cache_url, _auth_token, entry, true)) {
+            _counters.cache_hits++;
+            _counters.cache_bytes_saved += entry.body.size();
+            Logger::debug("CLHTTPService cache hit %s %d bytes", req->response_cache_url.c_str(), entry.body.size());
+            req->response_code = 200;
+            req->response_text = std::move(entry.body);
+        } else {
+            Logger::error("CLHTTPService 304 but cached response missing %s", req->response_cache_url.c_str());
+            _response_cache.remove(req->response_cache_url);
+            req->response_code = 0;
+            req->response_text = "Cached response missing";
+        }
+    } else if (req->response_code == 200) {
+        _counters.cache_misses++;
+        if (!req->response_etag.empty() || !req->response_last_modified.empty()) {
+            CLHTTPCacheEntry entry;
+            entry.etag = req->response_etag;
+            entry.last_modified = req->response_last_modified;
+            entry.body = req->response_text;
+            _response_cache.store(req->response_cache_url, _auth_token, entry);
+        }
+    }
+}
+
+void CLHTTPService::_park_for_retry(CLHTTPRequest* req) {
+    req->retry_at = os_read_monotonic_time() + req->next_retry_delay_cs();
+    _retry_requests.push_back(req);
+}
+
+void CLHTTPService::_submit_due_retries() {
+    if (_retry_requests.empty()) {
+        return;
+    }
+    os_t now = os_read_monotonic_time();
+    auto it = _retry_requests.begin();
+    while (it != _retry_requests.end()) {
+        CLHTTPRequest *req = *it;
+        if ((int) (now - req->retry_at) >= 0) {
+            it = _retry_requests.erase(it);
+            _counters.retries++;
+            submit(req);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// circuit breaker: while server is unreachable all requests are parked and server is probed
+// with exponentially growing interval instead of every poll. At start address stored by previous run
+// is enough, after connection error hostname is looked up again and server must accept connection.
+bool CLHTTPService::_probe_server_online() {
+    os_t now = os_read_monotonic_time();
+    if (_probe_handle) {
+        int connected = _finish_probe_connect();
+        if (connected < 0) {
+            return false;
+        }
+        if (connected) {
+            Logger::info("Server accepts connections, resume requests");
+            _verify_server = false;
+            _offline_probe_delay_cs = 0;
+            is_online = true;
             return true;
         }
-        addr = addr->next;
+        is_online = false;
+        _delay_next_probe(now);
+        return false;
     }
+    if (_offline_probe_delay_cs > 0 && (int) (now - _offline_probe_at) < 0) {
+        return false;
+    }
+    _counters.offline_probes++;
+    if (resolve_server_hostname(!_verify_server)) {
+        if (_verify_server) {
+            // resolved does not mean reachable, stays offline until connect check is done
+            is_online = false;
+            _start_probe_connect();
+            return false;
+        }
+        if (_offline_probe_delay_cs > 0) {
+            Logger::info("Server hostname resolved, resume requests");
+        }
+        _offline_probe_delay_cs = 0;
+        return true;
+    }
+    _delay_next_probe(now);
     return false;
 }
 
-//void CLHTTPService::_load_resolved() {
-//    char buf[255];
-//    FILE *f = nullptr;
-//
-//    if (_resolved_addrs) {
-//        curl_slist_free_all(_resolved_addrs);
-//        _resolved_addrs = NULL;
-//    }
-//
-//    if (is_file_exist(resolved_ip_file_path)) {
-//        f = fopen(resolved_ip_file_path, "r");
-//    }
-//    if (f != nullptr) {
-//        while(fgets(buf, sizeof(buf) - 1, f)) {
-//            rtrim(buf);
-//            if (strlen(buf) > 0) {
-//                Logger::debug("add resolved: %s", buf);
-//                _resolved_addrs = curl_slist_append(_resolved_addrs, buf);
-//            }
-//        }
-//        fclose(f);
-//    }
-//}
+void CLHTTPService::_delay_next_probe(os_t now) {
+    if (_offline_probe_delay_cs == 0) {
+        _offline_probe_delay_cs = OFFLINE_PROBE_MIN_DELAY_CS;
+    } else if (_offline_probe_delay_cs < OFFLINE_PROBE_MAX_DELAY_CS) {
+        _offline_probe_delay_cs *= 2;
+        if (_offline_probe_delay_cs > OFFLINE_PROBE_MAX_DELAY_CS) {
+            _offline_probe_delay_cs = OFFLINE_PROBE_MAX_DELAY_CS;
+        }
+    }
+    _offline_probe_at = now + _offline_probe_delay_cs;
+    Logger::debug("Server still not reachable, next try in %d cs", _offline_probe_delay_cs);
+}
 
-void CLHTTPService::_add_resolved(char *host, char* ip) {
-    char buf[200];
+// TCP and TLS connect only, in own multi handle as transfers of main one are parked while offline
+void CLHTTPService::_start_probe_connect() {
+    if (!_probe_multi) {
+        _probe_multi = curl_multi_init();
+    }
+    _probe_handle = curl_easy_init();
+    curl_easy_setopt(_probe_handle, CURLOPT_URL, _base_url.c_str());
+    curl_easy_setopt(_probe_handle, CURLOPT_CONNECT_ONLY, 1L);
+    curl_easy_setopt(_probe_handle, CURLOPT_CONNECTTIMEOUT, 10L);
+    curl_easy_setopt(_probe_handle, CURLOPT_CAINFO, "<ChatCube$Dir>.ssl.chain");
+    curl_easy_setopt(_probe_handle, CURLOPT_SSL_VERIFYPEER, false);
+    if (_resolved_addrs) {
+        curl_easy_setopt(_probe_handle, CURLOPT_RESOLVE, _resolved_addrs);
+    }
+    curl_multi_add_handle(_probe_multi, _probe_handle);
+}
 
-    sprintf(buf, "%s:%s", host, ip);
-    _resolved_addrs = curl_slist_append(_resolved_addrs, buf);
+int CLHTTPService::_finish_probe_connect() {
+    int running = 0;
+    curl_multi_perform(_probe_multi, &running);
+    int messages_left;
+    CURLMsg *msg;
+    while ((msg = curl_multi_info_read(_probe_multi, &messages_left))) {
+        if (msg->msg != CURLMSG_DONE || msg->easy_handle != _probe_handle) {
+            continue;
+        }
+        CURLcode result = msg->data.result;
+        curl_multi_remove_handle(_probe_multi, _probe_handle);
+        curl_easy_cleanup(_probe_handle);
+        _probe_handle = NULL;
+        if (result != CURLE_OK) {
+            Logger::debug("Server connect check failed: %s", curl_easy_strerror(result));
+            return 0;
+        }
+        return 1;
+    }
+    return -1;
+}
 
-//    FILE *f = nullptr;
-//    struct curl_slist *addr = _resolved_addrs;
-//    f = fopen(resolved_ip_file_path, "w");
-//    while(addr) {
-//        if (((char *)addr->data)[0] != '-') {
-//            Logger::debug("save resolved: %s", addr->data);
-//            fprintf(f, "%s\n", addr->data);
-//            addr = addr->next;
-//        }
-//    }
-//    fclose(f);
+bool CLHTTPService::connected() {
+    if (_trace.replaying()) {
+        return event_stream.started();
+    }
+    if (_websocket_transport()) {
+        return (event_stream.started() && _websocket.is_connected());
+    }
+    return (event_stream.started() && event_stream.is_connected());
 }
 
-//void CLHTTPService::_clean_resolved(char* host) {
-//    if (_resolved_addrs) {
-//        Logger::debug("CURL error, clear resolved addrs");
-//
-//        char buf[200];
-//        sprintf(buf, "-%s", host);
-//        int len = strlen(buf);
-//
-//        struct curl_slist *addr = _resolved_addrs;
-//        bool found = false;
-//        while(addr) {
-//            if (memcmp(buf, addr->data, len) == 0) {
-//                found = true;
-//                break;
-//            }
-//            addr = addr->next;
-//        }
-//        if (!found) {
-//            _resolved_addrs = curl_slist_append(_resolved_addrs, buf);
-////
-////            FILE *f = fopen(resolved_ip_file_path, "w");
-////            fclose(f);
-//        }
-//    }
-//    is_online = false;
-//}
+// file has one line: "host:port:ip expires_unix_time"
+void CLHTTPService::_load_resolved() {
+    char host[200], entry[255];
+    long expires;
+    FILE *f = fopen(resolved_ip_file_path, "r");
+    if (!f) {
+        return;
+    }
+    get_host_port_from_url(_base_url.c_str(), host);
+    size_t host_len = strlen(host);
+    if (fscanf(f, "%254s %ld", entry, &expires) == 2 && strncmp(entry, host, host_len) == 0 && entry[host_len] == ':') {
+        if (expires > time(NULL)) {
+            Logger::debug("CLHTTPService loaded resolved %s", entry);
+            _set_resolved(entry + host_len + 1, expires);
+        } else {
+            Logger::debug("CLHTTPService resolved %s expired", entry);
+        }
+    }
+    fclose(f);
+}
+
+void CLHTTPService::_save_resolved() {
+    char host[200];
+    FILE *f = fopen(resolved_ip_file_path, "w");
+    if (!f) {
+        Logger::error("CLHTTPService can't save resolved address to %s", resolved_ip_file_path);
+        return;
+    }
+    get_host_port_from_url(_base_url.c_str(), host);
+    fprintf(f, "%s:%s %ld\n", host, _resolved_ip.c_str(), (long) _resolved_expires);
+    fclose(f);
+}
+
+void CLHTTPService::_set_resolved_addrs(const std::string& entry) {
+    if (_resolved_addrs) {
+        _retired_resolved_addrs.push_back(_resolved_addrs);
+    }
+    _resolved_addrs = curl_slist_append(NULL, entry.c_str());
+}
+
+void CLHTTPService::_set_resolved(const char* ip, time_t expires) {
+    char host[200];
+    get_host_port_from_url(_base_url.c_str(), host);
+    if (_resolved_ip == ip) {
+        _resolved_expires = expires;
+        return;
+    }
+    _resolved_ip = ip;
+    _resolved_expires = expires;
+    _set_resolved_addrs(std::string(host) + ":" + ip);
+}
+
+// server moved or network changed: forget address, "-host:port" removes it from curl DNS cache too
+void CLHTTPService::_invalidate_resolved(const char* failed_host) {
+    char host[200];
+    get_host_port_from_url(_base_url.c_str(), host);
+    if (_resolved_ip.empty() || strcmp(host, failed_host) != 0) {
+        return;
+    }
+    Logger::warn("CLHTTPService connect to %s failed, resolved address dropped", _resolved_ip.c_str());
+    _counters.dns_invalidations++;
+    _resolved_ip.clear();
+    _resolved_expires = 0;
+    _set_resolved_addrs(std::string("-") + host);
+    unlink(resolved_ip_file_path);
+}
+
+// header value without trailing CRLF if line is "name: value", header name is case insensitive (HTTP/2)
+static bool get_header_value(const char* line, size_t size, const char* name, std::string& value) {
+    size_t name_len = strlen(name);
+    if (size <= name_len || strncasecmp(line, name, name_len) != 0 || line[name_len] != ':') {
+        return false;
+    }
+    value.assign(line + name_len + 1, size - name_len - 1);
+    trim(value);
+    return true;
+}
 
 /* CLHTTPEventStream */
 
 size_t _eventStreamWriteFunction(char *ptr, size_t size, size_t nmemb, void *userdata)
 {
-    ((CLHTTPEventStream *) userdata)->parse_raw_sse_event(ptr, size * nmemb);
-
+    if (!((CLHTTPEventStream *) userdata)->on_receive(ptr, size * nmemb)) {
+        return 0; // abort connection, it is restarted as inactive
+    }
     return size * nmemb;
 }
 
-void CLHTTPEventStream::parse_raw_sse_event(char* c, unsigned long size) {
-    _last_activity_time = time(NULL);
-    _last_receive_time = _last_activity_time;
-    _sse_buf.append(c, size);
-//    Logger::debug("parse_raw_sse_event buf=", _sse_buf.c_str());
-//    debug_print_string(_sse_buf);
-//    Logger::debug("");
-    if (_sse_buf.at(_sse_buf.length() - 1) != '\n') {
-//        printf("unfinished _sse_buf=[%s]", _sse_buf.c_str());
-        return;
+static size_t _eventStreamHeaderFunction(char *buffer, size_t size, size_t nitems, void *userdata)
+{
+    ((CLHTTPEventStream *) userdata)->on_header(buffer, size * nitems);
+    return size * nitems;
+}
+
+void CLHTTPEventStream::on_header(char* c, unsigned long size) {
+    std::string encoding;
+    if (size > 5 && strncmp(c, "HTTP/", 5) == 0) {
+        _inflate.start(""); // new response after redirect
+    } else if (get_header_value(c, size, "Content-Encoding", encoding) && !encoding.empty() &&
+               strcasecmp(encoding.c_str(), "identity") != 0) {
+        if (!_inflate.start(encoding)) {
+            Logger::error("CLHTTPEventStream unsupported Content-Encoding: %s", encoding.c_str());
+        }
     }
-    istringstream input(_sse_buf);
-    string line;
-    while(getline(input, line)) {
-//        printf("line=%s _sse_buf=[%s]\n", line.c_str(), _sse_buf.c_str());
-        if (line.substr(0, 5) == "data:") {
-            string ev = line.substr(5, line.length() - 5);
-            trim(ev);
-            if (_sse_raw.length() > 0) {
-                _sse_raw += "\n";
-            }
-            _sse_raw += ev;
-//            printf("STRART EVENT line=%s ev=%s _sse_buf=[%s]", line.c_str(), _sse_raw.c_str(), _sse_buf.c_str());
-        } else if (line.length() == 0) {
-            //printf("NEW EVENT line=%s ev=%s _sse_buf=[%s]", line.c_str(), _sse_raw.c_str(), _sse_buf.c_str());
-            on_raw_sse_event(_sse_raw);
-            _sse_raw.clear();
-        } else if (_sse_raw.length() > 0) {
-//            printf("bad data line=%s ev=%s _sse_buf=[%s]", line.c_str(), _sse_raw.c_str(), _sse_buf.c_str());
-            _sse_raw.clear();
+}
+
+bool CLHTTPEventStream::on_receive(char* c, unsigned long size) {
+    if (!_inflate.is_active()) {
+        if (!_inflate.get_encoding().empty()) {
+            // encoded with something we can't decode
+            use_compression = false;
+            return false;
         }
+        parse_raw_sse_event(c, size);
+        return true;
+    }
+    _last_activity_time = time(NULL);
+    _last_receive_time = _last_activity_time;
+    unsigned long long out_before = _inflate.get_bytes_out();
+    bool ok = _inflate.feed(c, size);
+    bytes_wire += size;
+    bytes_inflated += _inflate.get_bytes_out() - out_before;
+    if (!ok) {
+        Logger::error("CLHTTPEventStream broken %s data, reconnect without compression", _inflate.get_encoding().c_str());
+        use_compression = false;
+        _inflate.end();
     }
-    _sse_buf.clear();
+    return ok;
 }
 
-void CLHTTPEventStream::on_raw_sse_event(string& raw) {
-    cJSON *contentJson = cJSON_Parse(raw.c_str());
-    const cJSON *objId, *objTime, *objData;
+void CLHTTPEventStream::parse_raw_sse_event(char* c, unsigned long size) {
+    _last_activity_time = time(NULL);
+    _last_receive_time = _last_activity_time;
+    _sse_parser.feed(c, size);
+}
 
-    Logger::debug("parse_raw_sse_event get RAW EVENT\n%s", raw.c_str());
+void CLHTTPEventStream::on_sse_event(const CLSSEEvent& ev) {
+    cJSON *contentJson = cJSON_Parse(ev.data);
+    const char *raw = ev.data;
+
+    Logger::debug("parse_raw_sse_event get RAW EVENT %s id:%s\n%s", ev.type.c_str(), ev.id.c_str(), raw);
     if (contentJson == NULL) {
         const char *errorPtr = cJSON_GetErrorPtr();
         if (errorPtr != NULL) {
-            Logger::debug("on_raw_sse_event JSON parse error: %s [%s]", errorPtr, raw.c_str());
+            Logger::debug("on_raw_sse_event JSON parse error: %s [%s]", errorPtr, raw);
         }
         return;
     }
+    on_event_json(contentJson);
+    cJSON_Delete(contentJson);
+}
+
+void CLHTTPEventStream::on_event_json(const cJSON* contentJson) {
+    const cJSON *objId, *objTime, *objData;
+
     // "{"id":1,"channel":"ROCHAT.m2","text":"","tag":"1","time":"Tue, 15 Oct 2019 11:50:56 GMT","eventid":""}"
     objId = cJSON_GetObjectItemCaseSensitive(contentJson, "id");
     if (!objId || !cJSON_IsInt(objId)) {
-        Logger::debug("on_raw_sse_event JSON missing 'id' key [%s]", raw.c_str());
+        Logger::debug("on_event_json JSON missing 'id' key");
         return;
     }
 
     objTime = cJSON_GetObjectItemCaseSensitive(contentJson, "time");
     if (!objTime || !cJSON_IsString(objTime)) {
-        Logger::debug("on_raw_sse_event JSON missing 'time' key [%s]", raw.c_str());
+        Logger::debug("on_event_json JSON missing 'time' key");
         return;
     }
     _last_sse_event_time = objTime->valuestring;
     //_last_sse_event_id = objId->valueint;
+    if (trace && trace->recording()) {
+        char *str = cJSON_PrintUnformatted(contentJson);
+        trace->record_event(str);
+        free(str);
+    }
 
     objData = cJSON_GetObjectItemCaseSensitive(contentJson, "text");
     if (objData) {
         _events_handler(objData);
     }
-
-    cJSON_Delete(contentJson);
 }
 
 CURL* CLHTTPEventStream::make_curl_handle(struct curl_slist * resolved_addrs) {
@@ -513,8 +1637,21 @@ CURL* CLHTTPEventStream::make_curl_handle(struct curl_slist * resolved_addrs) {
     assert(!channel.empty());
 
     _curl_handle = curl_easy_init();
+    _sse_parser.reset(); // drop partial event of previous connection
+    _inflate.start("");  // reset counters and encoding, started for real by Content-Encoding header
     curl_easy_setopt(_curl_handle, CURLOPT_WRITEFUNCTION, _eventStreamWriteFunction);
     curl_easy_setopt(_curl_handle, CURLOPT_WRITEDATA, this);
+    curl_easy_setopt(_curl_handle, CURLOPT_HEADERFUNCTION, _eventStreamHeaderFunction);
+    curl_easy_setopt(_curl_handle, CURLOPT_HEADERDATA, this);
+    if (use_compression) {
+        // decoded here instead of by curl, so each flushed block is parsed as it comes
+        curl_easy_setopt(_curl_handle, CURLOPT_HTTP_CONTENT_DECODING, 0L);
+        if (_curl_headers) {
+            curl_slist_free_all(_curl_headers);
+        }
+        _curl_headers = curl_slist_append(NULL, "Accept-Encoding: gzip, deflate");
+        curl_easy_setopt(_curl_handle, CURLOPT_HTTPHEADER, _curl_headers);
+    }
     curl_easy_setopt(_curl_handle, CURLOPT_CONNECTTIMEOUT, DEFAULT_CONN_TIMEOUT);
 
     if (_last_sse_event_time.length() > 0) {
@@ -528,6 +1665,13 @@ CURL* CLHTTPEventStream::make_curl_handle(struct curl_slist * resolved_addrs) {
     curl_easy_setopt(_curl_handle, CURLOPT_USERAGENT, user_agent.c_str());
     curl_easy_setopt(_curl_handle, CURLOPT_CAINFO, "<ChatCube$Dir>.ssl.chain");
     curl_easy_setopt(_curl_handle, CURLOPT_SSL_VERIFYPEER, false);
+    if (curl_share) {
+        curl_easy_setopt(_curl_handle, CURLOPT_SHARE, curl_share);
+    }
+    if (use_multiplex) {
+        curl_easy_setopt(_curl_handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+        curl_easy_setopt(_curl_handle, CURLOPT_PIPEWAIT, 1L);
+    }
     Logger::debug("CLHTTPEventStream::make_curl_handle url=%s", url);
 
     if (resolved_addrs) {
@@ -549,6 +1693,12 @@ CLHTTPRequest::CLHTTPRequest(const char* a_method, const string &a_url) {
 
 
 CLHTTPRequest::~CLHTTPRequest() {
+    for (auto follower : single_flight_followers) {
+        delete follower;
+    }
+    if (json_stream) {
+        delete json_stream;
+    }
     cleanup();
 }
 
@@ -571,6 +1721,10 @@ void CLHTTPRequest::cleanup() {
         curl_slist_free_all(_curl_headers);
         _curl_headers = NULL;
     }
+    if (_upload_body_fp) {
+        fclose(_upload_body_fp);
+        _upload_body_fp = NULL;
+    }
 
     if (curl_handle) {
 //        Logger::debug("Request cleanup %s curl_easy_cleanup: %x this: %x", url.c_str(), curl_handle, this);
@@ -612,6 +1766,43 @@ void CLHTTPRequest::set_hourglass(bool on) {
     needs_hourglass = on;
 }
 
+void CLHTTPRequest::set_priority(int a_priority) {
+    priority = a_priority;
+}
+
+void CLHTTPRequest::set_response_cache(bool on) {
+    use_response_cache = on;
+}
+
+void CLHTTPRequest::set_json_stream(const std::string& array_key, JsonStreamItemHandlerType handler) {
+    if (json_stream) {
+        delete json_stream;
+    }
+    json_stream = new CLJsonArrayStream(array_key, handler);
+}
+
+void CLHTTPRequest::set_upload_body(const std::string& file_path, curl_off_t offset, curl_off_t length) {
+    upload_body_file = file_path;
+    upload_body_offset = offset;
+    upload_body_length = length;
+}
+
+size_t CLHTTPRequest::read_upload_body(char* buffer, size_t size) {
+    curl_off_t sent = _upload_body_fp ? ftell(_upload_body_fp) - upload_body_offset : upload_body_length;
+    if (sent >= upload_body_length) {
+        return 0;
+    }
+    if ((curl_off_t) size > upload_body_length - sent) {
+        size = upload_body_length - sent;
+    }
+    size_t n = fread(buffer, 1, size, _upload_body_fp);
+    if (n == 0 && ferror(_upload_body_fp)) {
+        Logger::error("CLHTTPRequest read error %s", upload_body_file.c_str());
+        return CURL_READFUNC_ABORT;
+    }
+    return n;
+}
+
 void CLHTTPRequest::set_url_parameters(CLStringsMap &data) {
     std::string fields = build_url_parameters(data);
     url = url + "?" + fields;
@@ -626,7 +1817,25 @@ void CLHTTPRequest::set_url_parameters(CLStringsMap &data) {
 //}
 
 bool CLHTTPRequest::on_before_submit() {
-    if (!upload_files.empty()) {
+    if (!upload_body_file.empty()) {
+        // reopened on every attempt, retry sends the part from its start again
+        if (_upload_body_fp) {
+            fclose(_upload_body_fp);
+        }
+        _upload_body_fp = fopen(upload_body_file.c_str(), "rb");
+        if (!_upload_body_fp || fseek(_upload_body_fp, upload_body_offset, SEEK_SET) != 0) {
+            Logger::error("CLHTTPRequest can't read upload body %s at %lld", upload_body_file.c_str(), (long long) upload_body_offset);
+            return false;
+        }
+        curl_easy_setopt(curl_handle, CURLOPT_UPLOAD, 1L);
+        curl_easy_setopt(curl_handle, CURLOPT_READFUNCTION, _IKHTTPRequest_Read);
+        curl_easy_setopt(curl_handle, CURLOPT_READDATA, this);
+        curl_easy_setopt(curl_handle, CURLOPT_INFILESIZE_LARGE, upload_body_length);
+        headers_map["Content-Type"] = "application/octet-stream";
+        headers_map["Expect"] = "";
+        Logger::debug("uploading %s %lld+%lld", upload_body_file.c_str(), (long long) upload_body_offset, (long long) upload_body_length);
+
+    } else if (!upload_files.empty()) {
         for(auto &item: upload_files) {
             curl_formadd(&_curl_formpost,
                          &_curl_formlast,
@@ -646,15 +1855,19 @@ bool CLHTTPRequest::on_before_submit() {
                 Logger::debug("POST %s: %s",  item.first.c_str(), item.second.c_str());
             }
         }
-        curl_easy_setopt(curl_handle, CURLOPT_HTTPPOST, _curl_formpost);
         headers_map["Expect"] = "";
+        if (!compress_body || !_set_compressed_form_body()) {
+            curl_easy_setopt(curl_handle, CURLOPT_HTTPPOST, _curl_formpost);
+        }
 
     } else if (!post_data.empty()) {
         std::string post_str = build_url_parameters(post_data);
         if (post_str.find("password=") == std::string::npos) {
             Logger::debug("POST data:%s",  post_str.c_str());
         }
-        curl_easy_setopt(curl_handle, CURLOPT_COPYPOSTFIELDS, post_str.c_str());
+        if (!compress_body || !_set_compressed_body(post_str, "application/x-www-form-urlencoded")) {
+            curl_easy_setopt(curl_handle, CURLOPT_COPYPOSTFIELDS, post_str.c_str());
+        }
 
     } else if (method == "POST") {
         curl_easy_setopt(curl_handle, CURLOPT_COPYPOSTFIELDS, "");
@@ -681,15 +1894,149 @@ bool CLHTTPRequest::on_before_submit() {
     return true;
 };
 
+// body is sent gzipped only if it is big enough, not too big for server to inflate and really gets smaller
+bool CLHTTPRequest::_set_compressed_body(const std::string& body, const std::string& content_type) {
+    std::string compressed;
+    if (body.size() < HTTP_COMPRESS_BODY_MIN || body.size() > HTTP_COMPRESS_BODY_MAX || !gzip_compress(body.data(), body.size(), compressed) ||
+        compressed.size() >= body.size()) {
+        return false;
+    }
+    Logger::debug("CLHTTPRequest %s body gzipped %u -> %u", url.c_str(), (unsigned) body.size(), (unsigned) compressed.size());
+    // size must be set before binary data is copied
+    curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t) compressed.size());
+    curl_easy_setopt(curl_handle, CURLOPT_COPYPOSTFIELDS, compressed.data());
+    headers_map["Content-Type"] = content_type;
+    headers_map["Content-Encoding"] = "gzip";
+    content_bytes_up = body.size();
+    return true;
+}
+
+static size_t _append_form_data(void *arg, const char *buf, size_t len) {
+    ((std::string *) arg)->append(buf, len);
+    return len;
+}
+
+// multipart body is serialized by curl itself (including files), then compressed as whole.
+// Files are sized first, a body over the limit is never read into memory.
+bool CLHTTPRequest::_set_compressed_form_body() {
+    unsigned long long files_size = 0;
+    for (auto &item: upload_files) {
+        long size = get_filesize(item.second.c_str());
+        if (size < 0) {
+            return false;
+        }
+        files_size += size;
+    }
+    if (files_size > HTTP_COMPRESS_BODY_MAX) {
+        Logger::debug("CLHTTPRequest %s form files %llu bytes, sent uncompressed", url.c_str(), files_size);
+        return false;
+    }
+    std::string body;
+    if (curl_formget(_curl_formpost, &body, _append_form_data) != 0 || body.compare(0, 2, "--") != 0) {
+        return false;
+    }
+    size_t eol = body.find("\r\n");
+    if (eol == std::string::npos) {
+        return false;
+    }
+    return _set_compressed_body(body, "multipart/form-data; boundary=" + body.substr(2, eol - 2));
+}
+
+bool CLHTTPRequest::can_share_response() {
+    // streamed response is consumed by handler of one request only
+    return method == "GET" && upload_files.empty() && upload_body_file.empty() && !needs_progress && !json_stream;
+}
+
+bool CLHTTPRequest::is_idempotent() {
+    return method != "POST";
+}
+
+// code of response being received: from curl while transfer runs, set before body is fed when replayed from trace
+long CLHTTPRequest::get_transfer_response_code() {
+    if (response_code) {
+        return response_code;
+    }
+    long code = 0;
+    curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &code);
+    return code;
+}
+
+bool CLHTTPRequest::should_retry(CURLcode result) {
+    if (!is_connection_error(result) || cancel_loading) {
+        return false;
+    }
+    if (attempts >= retry_policy.max_attempts) {
+        return false;
+    }
+    if (!is_idempotent() && !retry_policy.retry_non_idempotent) {
+        // safe to replay only if request surely never reached the server
+        return result == CURLE_COULDNT_RESOLVE_HOST || result == CURLE_COULDNT_CONNECT;
+    }
+    return true;
+}
+
+// exponential backoff with jitter, attempts counted from submit()
+int CLHTTPRequest::next_retry_delay_cs() {
+    int delay = retry_policy.base_delay_cs;
+    for (int i = 1; i < attempts && delay < retry_policy.max_delay_cs; i++) {
+        delay *= 2;
+    }
+    if (delay > retry_policy.max_delay_cs) {
+        delay = retry_policy.max_delay_cs;
+    }
+    return delay / 2 + rand() % (delay / 2 + 1);
+}
+
+void CLHTTPRequest::on_retry() {
+    response_text.clear();
+    error_text.clear();
+    response_code = 0;
+    content_bytes_down = 0;
+    if (json_stream) {
+        json_stream->reset();
+    }
+}
+
 unsigned long CLHTTPRequest::on_append_content(char* c, unsigned long size) {
+    if (json_stream) {
+        long code = get_transfer_response_code();
+        // error pages are kept as is for parse_error()
+        if (code >= 200 && code < 300) {
+            json_stream->feed(c, size);
+            if (!use_response_cache) { // full body is only needed to be stored in cache
+                return size;
+            }
+        }
+    }
     response_text.append(c, size);
     return size;
 }
 
+unsigned long CLHTTPRequest::on_header(char* c, unsigned long size) {
+    if (size > 5 && strncmp(c, "HTTP/", 5) == 0) {
+        // new response after redirect, headers of previous one do not matter
+        response_etag.clear();
+        response_last_modified.clear();
+    } else if (!get_header_value(c, size, "ETag", response_etag)) {
+        get_header_value(c, size, "Last-Modified", response_last_modified);
+    }
+    return size;
+}
+
 void CLHTTPRequest::process_response() {
 //    fprintf(stderr, "response=%s", response_text.c_str());
     Logger::debug("response=%s", response_text.c_str());
-    if (response_code > 0) {
+    if (json_stream && response_code >= 200 && response_code < 300) {
+        if (json_stream->get_bytes_fed() == 0) {
+            // body did not come from network (response cache)
+            json_stream->feed(response_text.data(), response_text.size());
+        }
+        json_stream->finish();
+        if (response_text.empty()) {
+            response_text = json_stream->get_envelope();
+        }
+        response_json = cJSON_Parse(json_stream->get_envelope().c_str());
+    } else if (response_code > 0) {
         response_json = cJSON_Parse(response_text.c_str());
     }
     if (response_code > 100 and response_code < 400) {
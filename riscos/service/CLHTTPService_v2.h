@@ -17,7 +17,54 @@
 #include <stdlib.h>
 #include "../utils.h"
 #include "curl/curl.h"
+#include "oslib/os.h"
 #include "../libs/cJSON/cJSON.h"
+#include "CLHTTPResponseCache.h"
+#include "CLJsonArrayStream.h"
+#include "CLSSEParser.h"
+#include "CLInflateStream.h"
+#include "CLWebSocket.h"
+#include "CLHTTPTrace.h"
+
+// request priority classes, lower value admitted first
+#define HTTP_PRIORITY_INTERACTIVE       0 // user actions: send message, load messages, open chat
+#define HTTP_PRIORITY_FOREGROUND_MEDIA  1 // downloads/uploads user waiting for
+#define HTTP_PRIORITY_BACKGROUND        2 // thumbnails, avatars, stickers prefetch
+#define HTTP_PRIORITY_BULK              3 // app update, feedback upload, history export
+#define HTTP_PRIORITY_CLASSES           4
+
+// classes of completed transfers for timing statistics
+#define HTTP_TIMING_API                 0
+#define HTTP_TIMING_DOWNLOAD            1
+#define HTTP_TIMING_UPLOAD              2
+#define HTTP_TIMING_EVENT_STREAM        3 // event stream connections, each one ended means reconnect
+#define HTTP_TIMING_CLASSES             4
+
+// phases of transfer, each one measured separately from curl cumulative times
+#define HTTP_TIMING_DNS                 0
+#define HTTP_TIMING_CONNECT             1
+#define HTTP_TIMING_TLS                 2
+#define HTTP_TIMING_SERVER              3 // request sent -> first byte of response
+#define HTTP_TIMING_TRANSFER            4 // first byte -> done
+#define HTTP_TIMING_PHASES              5
+#define HTTP_TIMING_BUCKETS             10
+
+// bandwidth shaping of background traffic, see CLHTTPService::_update_shaping
+#define HTTP_SHAPING_RECV               0
+#define HTTP_SHAPING_SEND               1
+#define HTTP_SHAPING_DIRECTIONS         2
+#define HTTP_SHAPING_WINDOW_CS          100   // throughput measured and caps recomputed once per window
+#define HTTP_SHAPING_PROBE_WINDOWS      5     // windows shaped traffic must be held by its cap before link estimate is raised
+#define HTTP_SHAPING_MIN_RATE           2048  // bytes/s, no shaped transfer gets less
+
+#define HTTP_POLL_BUSY_CS               2     // poll period while transfers run, see next_process_delay_cs
+
+#define HTTP_COMPRESS_BODY_MIN          1024  // smaller request bodies are sent as is even with compress_body
+#define HTTP_COMPRESS_BODY_MAX          (2560 * 1024) // server inflates gzipped body in memory up to its DATA_UPLOAD_MAX_MEMORY_SIZE
+
+// optional websocket transport of event stream, see CLHTTPService::_start_websocket
+#define HTTP_WEBSOCKET_MAX_FAILURES     3     // connects failed in a row before falling back to SSE for this run
+#define HTTP_WEBSOCKET_RETRY_CS         200   // delay before reconnect, multiplied by failures in a row
 
 using namespace std;
 typedef std::map<std::string, std::string> CLStringsMap;
@@ -27,20 +74,31 @@ typedef std::function<int(curl_off_t dltotal, curl_off_t dlnow,
 
 class CLHTTPEventStream {
 private:
-    std::string _sse_buf;
-    std::string _sse_raw;
+    CLSSEParser _sse_parser;
+    CLInflateStream _inflate;   // active when server answered with Content-Encoding
     std::string _last_sse_event_time;
     CURL *_curl_handle = NULL;
+    struct curl_slist *_curl_headers = NULL;
     PushStreamHandlerType _events_handler;
     time_t _last_activity_time = 0;
     time_t _last_receive_time = 0;
-    void on_raw_sse_event(string& raw);
+    void on_sse_event(const CLSSEEvent& ev);
     bool _started = false;
 
 public:
+    CLHTTPEventStream() :
+            _sse_parser([this](const CLSSEEvent& ev) { on_sse_event(ev); }),
+            _inflate([this](const char* c, size_t size) { _sse_parser.feed(c, size); }) {};
+
     std::string base_url;
     std::string user_agent;
     std::string channel;
+    CURLSH *curl_share = NULL;
+    CLHTTPTrace *trace = NULL;      // events are written to it while recording
+    bool use_multiplex = false;
+    bool use_compression = true;    // turned off for next connections if inflate ever fails
+    unsigned long long bytes_wire = 0;      // compressed bytes of all connections
+    unsigned long long bytes_inflated = 0;
 
     CURL *get_curl_handle() {
         return _curl_handle;
@@ -51,12 +109,20 @@ public:
             curl_easy_cleanup(_curl_handle);
             _curl_handle = NULL;
         }
+        if (_curl_headers) {
+            curl_slist_free_all(_curl_headers);
+            _curl_headers = NULL;
+        }
     }
 
     void set_last_event_date(const std::string& dt) {
         _last_sse_event_time = dt;
     }
 
+    const std::string& get_last_event_date() {
+        return _last_sse_event_time;
+    }
+
     void set_events_handler(PushStreamHandlerType events_handler) {
         _events_handler = events_handler;
     }
@@ -67,17 +133,35 @@ public:
     bool is_active() { return ((_last_activity_time + 30) > time(NULL)); }
     bool is_connected() { return ((_last_receive_time + 30) > time(NULL)); }
     CURL* make_curl_handle(struct curl_slist * resolved_addrs);
+    unsigned long long get_connection_inflated_bytes() { return _inflate.get_bytes_out(); }
+    bool on_receive(char* c, unsigned long size);
+    void on_header(char* c, unsigned long size);
     void parse_raw_sse_event(char* c, unsigned long size);
+    void on_event_json(const cJSON* json); // push stream message {"id", "time", "text": event, ...}, from SSE or websocket
 };
 
 
+struct CLHTTPRetryPolicy {
+    int max_attempts = 5;           // including the first one
+    int base_delay_cs = 50;         // delay before first retry, doubled on each next retry
+    int max_delay_cs = 3000;
+    bool retry_non_idempotent = false; // POST is retried only if it surely was not sent to server
+};
+
 class CLHTTPRequest {
 private:
     struct curl_httppost *_curl_formpost = NULL;
     struct curl_slist *_curl_headers = NULL;
     struct curl_httppost *_curl_formlast = NULL;
+    FILE *_upload_body_fp = NULL;
+    bool _set_compressed_body(const std::string& body, const std::string& content_type);
+    bool _set_compressed_form_body();
 public:
     CLStringsMap upload_files;
+    // raw request body streamed from part of file (chunked upload), used instead of post_data/upload_files
+    std::string upload_body_file;
+    curl_off_t upload_body_offset = 0;
+    curl_off_t upload_body_length = 0;
     CLStringsMap post_data;
     CLStringsMap headers_map = {{"X-AppPlatform", "riscos"}};
     std::string url;
@@ -85,11 +169,32 @@ public:
     int lowspeed_limit = 0;
     int lowspeed_time = 0;
     int timeout = 0;
+    int priority = HTTP_PRIORITY_INTERACTIVE;
+    int timing_class = HTTP_TIMING_API;
+    os_t queued_at = 0;
+    CLHTTPRetryPolicy retry_policy;
+    int attempts = 0;
+    os_t retry_at = 0;
+    std::string single_flight_key;
+    std::list<CLHTTPRequest*> single_flight_followers; // identical requests which get copy of this response
+    bool use_response_cache = false;
+    std::string response_cache_url;
+    std::string response_etag;
+    std::string response_last_modified;
+    CLJsonArrayStream *json_stream = NULL;
+    bool compress_body = false;             // gzip POST body, server must accept Content-Encoding: gzip
+    bool websocket_allowed = false;         // small call which may go over event websocket instead of own transfer
+    bool trace = false;                     // raw headers and body are kept for trace recording
+    std::string trace_headers;
+    std::string trace_body;
+    unsigned long long content_bytes_down = 0; // response body after content decoding
+    unsigned long long content_bytes_up = 0;   // request body before compression, 0 if sent as is
     bool needs_progress = false;
     bool cancel_loading = false;
     bool needs_hourglass = false;
     int response_code = 0;
     std::string response_text = "";
+    std::string error_text;                 // failure found by request itself, reported instead of curl error
     char *response_url = NULL;
     cJSON *response_json = NULL;
     CURL *curl_handle;
@@ -103,12 +208,26 @@ public:
     void set_timeout(const int timeout);
     void set_lowspeed_limit(const int time, const int limit); // time in sec, limit is bytes pre second
     void set_hourglass(bool on);
+    void set_priority(int a_priority);
+    void set_response_cache(bool on); // revalidate GET with ETag/Last-Modified and serve 304 from disk cache
+    // parse elements of array (top level one if array_key is empty) while downloading,
+    // response_json then has that array empty
+    void set_json_stream(const std::string& array_key, JsonStreamItemHandlerType handler);
+    void set_upload_body(const std::string& file_path, curl_off_t offset, curl_off_t length);
+    size_t read_upload_body(char* buffer, size_t size);
+    bool is_idempotent();
+    long get_transfer_response_code();
+    int next_retry_delay_cs();
 
     virtual int on_progress(curl_off_t dltotal, curl_off_t dlnow,
                                     curl_off_t ultotal, curl_off_t ulnow);
     virtual void process_response();
     virtual bool on_before_submit();
     virtual unsigned long on_append_content(char* c, unsigned long size);
+    virtual unsigned long on_header(char* c, unsigned long size);
+    virtual bool should_retry(CURLcode result);
+    virtual bool can_share_response();
+    virtual void on_retry();
 
     virtual void on_success() {};
     virtual void on_fail() {};
@@ -116,21 +235,160 @@ public:
 };
 
 
+struct CLHTTPServiceCounters {
+    unsigned long process_calls = 0;    // times process() was called from the poll timer
+    unsigned long idle_calls = 0;       // process() calls where no socket was ready and curl timer not expired
+    unsigned long socket_actions = 0;   // curl_multi_socket_action calls for ready sockets
+    unsigned long timer_actions = 0;    // curl_multi_socket_action calls for expired curl timeouts
+    unsigned long perform_calls = 0;    // curl_multi_perform calls (polling mode)
+    unsigned long retries = 0;          // failed transfers resubmitted after backoff
+    unsigned long retries_exhausted = 0; // failed transfers given up
+    unsigned long offline_probes = 0;   // server hostname resolve or connect attempts while offline
+    unsigned long single_flight_saved = 0; // GETs attached to identical in-flight request instead of new transfer
+    unsigned long websocket_connects = 0;
+    unsigned long websocket_failures = 0; // connects failed before websocket was open
+    unsigned long websocket_fallbacks = 0; // times event stream went back to SSE
+    unsigned long websocket_calls = 0;  // API calls sent over websocket instead of own transfer
+    unsigned long websocket_calls_resent = 0; // calls without reply when websocket closed, sent again by HTTP
+    unsigned long websocket_call_total_cs = 0;
+    unsigned long cache_hits = 0;       // 304 responses served from response cache
+    unsigned long cache_misses = 0;     // cacheable GETs which got full response
+    unsigned long cache_bytes_saved = 0; // body bytes served from response cache instead of network
+    unsigned long dns_store_hits = 0;   // hostname resolves skipped thanks to persisted address
+    unsigned long dns_invalidations = 0; // persisted address dropped after connect error
+};
+
+struct CLHTTPPriorityStats {
+    int max_running = 0;            // concurrency cap of the class
+    int running = 0;
+    int queued = 0;
+    int max_queued = 0;
+    unsigned long admitted = 0;
+    unsigned long total_wait_cs = 0;
+    unsigned long max_wait_cs = 0;
+};
+
+struct CLHTTPShapingStats {
+    unsigned long link_rate = 0;        // estimated link throughput, bytes/s
+    unsigned long last_rate = 0;        // all traffic in last window, bytes/s
+    unsigned long last_shaped_rate = 0; // shaped classes part of it
+    unsigned long cap[HTTP_PRIORITY_CLASSES] = {}; // per transfer cap in bytes/s, 0 - not limited
+    unsigned long probes_up = 0;        // link estimate raised as shaped traffic was held by its cap
+    unsigned long backoffs = 0;         // link estimate lowered as link could not carry shaped budget
+    unsigned long cap_changes = 0;
+    unsigned long long bytes_done = 0;  // of finished transfers, running ones are sampled every window
+    unsigned long long bytes_done_shaped = 0;
+    unsigned long long bytes_sampled = 0;
+    unsigned long long bytes_sampled_shaped = 0;
+    int limited_windows = 0;
+};
+
+struct CLHTTPTimingStats {
+    unsigned long count = 0;
+    unsigned long failed = 0;           // transfers ended with curl error
+    unsigned long long bytes_down = 0;
+    unsigned long long bytes_up = 0;
+    unsigned long long content_down = 0;  // bytes_down are as on wire, these are after/before content encoding
+    unsigned long long content_up = 0;
+    unsigned long total_ms[HTTP_TIMING_PHASES] = {};
+    unsigned long max_ms[HTTP_TIMING_PHASES] = {};
+    unsigned long histogram[HTTP_TIMING_PHASES][HTTP_TIMING_BUCKETS] = {}; // see timing_bucket_limits_ms
+};
+
 class CLHTTPService {
 private:
     CLHTTPEventStream event_stream;
+    struct CLWebSocketCall {
+        CLHTTPRequest *req;
+        os_t started;
+    };
+    CLWebSocket _websocket;     // replaces SSE when enabled, small API calls go over it as well
+    bool _use_websocket = false;
+    int _websocket_failures = 0; // in a row
+    os_t _websocket_retry_at = 0;
+    unsigned long _websocket_next_call = 1;
+    std::map<unsigned long, CLWebSocketCall> _websocket_calls; // waiting for reply by call id
+    // record/replay of traffic, see CLHTTPTrace.h
+    struct CLHTTPReplayItem {
+        CLHTTPRequest *req;
+        std::string url;
+        os_t due;
+        CLHTTPTraceResponse response;
+    };
+    CLHTTPTrace _trace;
+    std::list<CLHTTPReplayItem> _replay_pending;
+    bool _replay_finished_logged = false;
     CURLM *_curl_multi = NULL;
+    CURLSH *_curl_share = NULL; // DNS cache, TLS sessions and connections shared between all handles
+    bool _use_multiplex = false;
     std::map<CURL *, CLHTTPRequest*> _running_requests;
+    std::list<CLHTTPRequest*> _queued_requests[HTTP_PRIORITY_CLASSES];
+    std::list<CLHTTPRequest*> _retry_requests; // failed requests waiting for backoff delay or server back online
+    std::map<std::string, CLHTTPRequest*> _single_flight_requests; // in-flight GETs by method+url+auth
+    CLHTTPResponseCache _response_cache{"<Choices$Write>.ChatCube.apicache"};
+    CLHTTPPriorityStats _priority_stats[HTTP_PRIORITY_CLASSES];
+    CLHTTPTimingStats _timing_stats[HTTP_TIMING_CLASSES];
+    // caps for background classes keep reserved headroom for event stream and interactive requests
+    CLHTTPShapingStats _shaping[HTTP_SHAPING_DIRECTIONS];
+    bool _shaping_enabled = true;
+    int _shaping_reserve_pct = 25;
+    os_t _shaping_window_at = 0;
+    std::map<curl_socket_t, int> _watched_sockets; // socket -> CURL_POLL_IN/OUT/INOUT
+    bool _use_socket_action = true;
+    bool _curl_timer_active = false;
+    os_t _curl_timer_expire_at = 0; // monotonic time (cs) when curl wants to be called with CURL_SOCKET_TIMEOUT
+    bool _last_drive_busy = false;  // sockets had data on last process(), more is likely to follow
+    CLHTTPServiceCounters _counters;
+    // circuit breaker: while offline server hostname is probed with growing interval
+    os_t _offline_probe_at = 0;
+    int _offline_probe_delay_cs = 0;
+    bool _verify_server = false;        // went offline by connection error, stored address proves nothing
+    CURLM *_probe_multi = NULL;
+    CURL *_probe_handle = NULL;         // connect check to server while offline
+    void _start_probe_connect();
+    int _finish_probe_connect();        // 1 connected, 0 failed, -1 still running
+    void _delay_next_probe(os_t now);
     std::string _user_agent;
     std::string _base_url = "https://test.chatcube.org";
-    struct curl_slist * _resolved_addrs;
+    // server address persisted between runs and given to curl by CURLOPT_RESOLVE
+    struct curl_slist * _resolved_addrs = NULL;
+    std::list<struct curl_slist *> _retired_resolved_addrs; // may still be referenced by handles not started yet
+    std::string _resolved_ip;
+    time_t _resolved_expires = 0;
+    int _dns_ttl = 3600;        // seconds, RISC OS resolver does not tell record TTL
+    unsigned long _first_api_ttfb_ms = 0;
     std::string _lang = "en";
     std::string _auth_token = "";
 //    void _process_request(CURLMsg* msg);
-    bool _is_host_resolved(char* host);
-//    void _load_resolved();
-    void _add_resolved(char *host, char* ip);
-    void _clean_resolved(char *host);
+    void _load_resolved();
+    void _save_resolved();
+    void _set_resolved_addrs(const std::string& entry);
+    void _set_resolved(const char* ip, time_t expires);
+    void _invalidate_resolved(const char* failed_host);
+    void _drive_transfers();
+    void _socket_action(curl_socket_t s, int ev_bitmask);
+    void _set_multiplex(bool on);
+    void _admit_queued_requests();
+    void _start_request(CLHTTPRequest* req);
+    void _on_request_finished(CLHTTPRequest* req);
+    void _complete_request(CLHTTPRequest* req, char* url);
+    void _record_timing(CURL* handle, int timing_class, bool failed, unsigned long long content_down = 0, unsigned long long content_up = 0);
+    void _apply_response_cache(CLHTTPRequest* req);
+    void _update_shaping();
+    unsigned long _shaping_class_budget(int dir, int priority);
+    bool _shaping_admits(CLHTTPRequest* req);
+    void _apply_shaping(CLHTTPRequest* req);
+    void _park_for_retry(CLHTTPRequest* req);
+    void _submit_due_retries();
+    bool _probe_server_online();
+    bool _websocket_transport() { return _use_websocket && _websocket_failures < HTTP_WEBSOCKET_MAX_FAILURES; }
+    void _start_websocket();
+    void _on_websocket_message(const std::string& message);
+    void _on_websocket_close(bool was_open);
+    void _submit_over_websocket(CLHTTPRequest* req);
+    void _submit_replayed(CLHTTPRequest* req, const std::string& url);
+    void _process_replay();
+    void _deliver_replayed(CLHTTPReplayItem& item);
 
 public:
     bool is_online = false;
@@ -147,6 +405,7 @@ public:
     void start_event_stream(const std::string &channel, const std::string& start_date);
 
     void stop_event_stream();
+    const std::string& get_last_event_date() { return event_stream.get_last_event_date(); }
 
     void submit(CLHTTPRequest* req);
 
@@ -174,11 +433,27 @@ public:
         _base_url = baseUrl;
         event_stream.base_url = baseUrl;
     }
-    bool resolve_server_hostname();
+    bool resolve_server_hostname(bool use_stored = true); // stored address of previous run is used at start only
 
     bool connected();
+    bool websocket_open() { return _websocket.is_open(); }
+    bool replaying() { return _trace.replaying(); }
     /* main processor */
     void process();
+    int next_process_delay_cs(int listen_cs);
+
+    /* curl multi socket interface callbacks */
+    void on_curl_socket(curl_socket_t s, int what);
+    void on_curl_timer(long timeout_ms);
+
+    bool is_socket_action_mode() { return _use_socket_action; }
+    bool is_multiplexing() { return _use_multiplex; }
+    const CLHTTPServiceCounters& get_counters() { return _counters; }
+    const CLHTTPPriorityStats& get_priority_stats(int priority) { return _priority_stats[priority]; }
+    const CLHTTPShapingStats& get_shaping_stats(int direction) { return _shaping[direction]; }
+    void set_max_running(int priority, int max_running);
+    const CLHTTPTimingStats& get_timing_stats(int timing_class) { return _timing_stats[timing_class]; }
+    bool dump_stats(const char* file_name, const char* mode = "w");
 
 };
 
@@ -0,0 +1,179 @@
+//
+// Record/replay of HTTP traffic for repeatable performance runs, see CLHTTPTrace.h for file format.
+//
+#include <stdio.h>
+#include <string.h>
+#include <cloverleaf/Logger.h>
+#include "CLHTTPTrace.h"
+
+#define TRACE_SIGNATURE "CLTRACE 1"
+
+static bool read_line(FILE* f, std::string& line) {
+    line.clear();
+    int c;
+    while ((c = fgetc(f)) != EOF && c != '\n') {
+        line += (char) c;
+    }
+    return c != EOF;
+}
+
+static bool read_block(FILE* f, std::string& data, unsigned long size) {
+    data.resize(size);
+    return size == 0 || fread(&data[0], 1, size, f) == size;
+}
+
+bool CLHTTPTrace::start_record(const std::string& file_name) {
+    close();
+    _fp = fopen(file_name.c_str(), "wb");
+    if (!_fp) {
+        Logger::error("CLHTTPTrace can't write trace %s", file_name.c_str());
+        return false;
+    }
+    fprintf(_fp, "%s\n", TRACE_SIGNATURE);
+    _file_name = file_name;
+    _mode = HTTP_TRACE_RECORD;
+    _start = os_read_monotonic_time();
+    Logger::info("CLHTTPTrace recording to %s", file_name.c_str());
+    return true;
+}
+
+bool CLHTTPTrace::start_replay(const std::string& file_name, int time_scale_pct) {
+    close();
+    FILE *f = fopen(file_name.c_str(), "rb");
+    if (!f) {
+        Logger::error("CLHTTPTrace can't read trace %s", file_name.c_str());
+        return false;
+    }
+    bool ok = _load(f);
+    fclose(f);
+    if (!ok) {
+        Logger::error("CLHTTPTrace %s is not a valid trace", file_name.c_str());
+        _responses.clear();
+        _events.clear();
+        return false;
+    }
+    _file_name = file_name;
+    _time_scale_pct = time_scale_pct < 0 ? 100 : time_scale_pct;
+    _mode = HTTP_TRACE_REPLAY;
+    _start = os_read_monotonic_time();
+    Logger::info("CLHTTPTrace replaying %s at %d%% time, %u urls %u events", file_name.c_str(), _time_scale_pct,
+                 (unsigned) _responses.size(), (unsigned) _events.size());
+    return true;
+}
+
+bool CLHTTPTrace::_load(FILE* f) {
+    std::string line;
+    if (!read_line(f, line) || line != TRACE_SIGNATURE) {
+        return false;
+    }
+    while (read_line(f, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        if (line[0] == 'Q') {
+            unsigned long time_cs, duration_cs, post_len, headers_len, body_len;
+            int code;
+            char method[16], url[2048];
+            if (sscanf(line.c_str(), "Q %lu %lu %d %15s %2047s %lu %lu %lu", &time_cs, &duration_cs, &code,
+                       method, url, &post_len, &headers_len, &body_len) != 8) {
+                return false;
+            }
+            CLHTTPTraceResponse response;
+            std::string post;
+            response.duration_cs = duration_cs;
+            response.code = code;
+            if (!read_block(f, post, post_len) || !read_block(f, response.headers, headers_len) ||
+                !read_block(f, response.body, body_len)) {
+                return false;
+            }
+            _responses[std::string(method) + " " + url].push_back(std::move(response));
+        } else if (line[0] == 'E') {
+            unsigned long time_cs, len;
+            if (sscanf(line.c_str(), "E %lu %lu", &time_cs, &len) != 2) {
+                return false;
+            }
+            CLHTTPTraceEvent event;
+            event.time_cs = time_cs;
+            if (!read_block(f, event.json, len)) {
+                return false;
+            }
+            _events.push_back(std::move(event));
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+void CLHTTPTrace::close() {
+    if (_fp) {
+        fclose(_fp);
+        _fp = NULL;
+    }
+    _mode = HTTP_TRACE_OFF;
+}
+
+void CLHTTPTrace::record_request(const std::string& method, const std::string& url, const std::string& post,
+                                 int code, const std::string& headers, const std::string& body, os_t started) {
+    if (!_fp) {
+        return;
+    }
+    os_t now = os_read_monotonic_time();
+    fprintf(_fp, "Q %lu %lu %d %s %s %lu %lu %lu\n", (unsigned long) (started - _start), (unsigned long) (now - started),
+            code, method.c_str(), url.c_str(), (unsigned long) post.size(), (unsigned long) headers.size(),
+            (unsigned long) body.size());
+    fwrite(post.data(), 1, post.size(), _fp);
+    fwrite(headers.data(), 1, headers.size(), _fp);
+    fwrite(body.data(), 1, body.size(), _fp);
+    fputc('\n', _fp);
+    fflush(_fp); // trace of session which crashed is the interesting one
+    _stats.recorded_requests++;
+}
+
+void CLHTTPTrace::record_event(const char* json) {
+    if (!_fp) {
+        return;
+    }
+    size_t len = strlen(json);
+    fprintf(_fp, "E %lu %lu\n", (unsigned long) elapsed(), (unsigned long) len);
+    fwrite(json, 1, len, _fp);
+    fputc('\n', _fp);
+    fflush(_fp);
+    _stats.recorded_events++;
+}
+
+bool CLHTTPTrace::find_response(const std::string& method, const std::string& url, CLHTTPTraceResponse& response) {
+    auto found = _responses.find(method + " " + url);
+    if (found == _responses.end() || found->second.empty()) {
+        Logger::warn("CLHTTPTrace %s %s is not in trace", method.c_str(), url.c_str());
+        _stats.missing++;
+        return false;
+    }
+    std::deque<CLHTTPTraceResponse> &responses = found->second;
+    if (responses.size() > 1) {
+        response = std::move(responses.front());
+        responses.pop_front();
+    } else {
+        response = responses.front();
+    }
+    _stats.replayed_requests++;
+    _stats.replayed_bytes += response.body.size();
+    return true;
+}
+
+bool CLHTTPTrace::pop_due_event(CLHTTPTraceEvent& event) {
+    if (_events.empty() || (int) (elapsed() - scale(_events.front().time_cs)) < 0) {
+        return false;
+    }
+    event = std::move(_events.front());
+    _events.pop_front();
+    _stats.replayed_events++;
+    return true;
+}
+
+void CLHTTPTrace::dump_stats(FILE* f) {
+    fprintf(f, "trace: mode:%d file:%s time_scale_pct:%d recorded_requests:%lu recorded_events:%lu "
+               "replayed_requests:%lu replayed_events:%lu replayed_bytes:%llu missing:%lu\n",
+            _mode, _file_name.c_str(), _time_scale_pct, _stats.recorded_requests, _stats.recorded_events,
+            _stats.replayed_requests, _stats.replayed_events, _stats.replayed_bytes, _stats.missing);
+}
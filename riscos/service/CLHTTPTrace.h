@@ -0,0 +1,84 @@
+//
+// Record/replay of HTTP traffic for repeatable performance runs.
+// Record mode writes every finished request (response code, headers, body, time taken) and every
+// push stream event to a trace file. Replay mode serves responses and events from that file
+// with original or scaled timing, without any network.
+//
+// Trace file format: "CLTRACE 1" line, then entries, each is a header line followed by raw data:
+//   Q <time_cs> <duration_cs> <code> <method> <url> <post_len> <headers_len> <body_len>\n<post><headers><body>\n
+//   E <time_cs> <len>\n<event json>\n
+// time_cs is counted from start of the trace, post data is only for reading, replay matches by method and url.
+//
+
+#ifndef ROCHAT_CLHTTPTRACE_H
+#define ROCHAT_CLHTTPTRACE_H
+
+#include <stdio.h>
+#include <string>
+#include <map>
+#include <deque>
+#include "oslib/os.h"
+
+#define HTTP_TRACE_OFF 0
+#define HTTP_TRACE_RECORD 1
+#define HTTP_TRACE_REPLAY 2
+
+struct CLHTTPTraceResponse {
+    os_t duration_cs = 0;
+    int code = 0;
+    std::string headers;    // raw header lines as they came, "\r\n" terminated
+    std::string body;       // decoded body, error message when code is 0
+};
+
+struct CLHTTPTraceEvent {
+    os_t time_cs = 0;
+    std::string json;
+};
+
+struct CLHTTPTraceStats {
+    unsigned long recorded_requests = 0;
+    unsigned long recorded_events = 0;
+    unsigned long replayed_requests = 0;
+    unsigned long replayed_events = 0;
+    unsigned long missing = 0;          // requests not found in trace
+    unsigned long long replayed_bytes = 0;
+};
+
+class CLHTTPTrace {
+private:
+    int _mode = HTTP_TRACE_OFF;
+    FILE *_fp = NULL;
+    std::string _file_name;
+    os_t _start = 0;
+    int _time_scale_pct = 100;
+    // responses of one "method url" in order they were recorded, last one is kept for any further calls
+    std::map<std::string, std::deque<CLHTTPTraceResponse>> _responses;
+    std::deque<CLHTTPTraceEvent> _events;
+    CLHTTPTraceStats _stats;
+    bool _load(FILE* f);
+public:
+    ~CLHTTPTrace() { close(); }
+    bool start_record(const std::string& file_name);
+    bool start_replay(const std::string& file_name, int time_scale_pct);
+    void close();
+    int get_mode() { return _mode; }
+    bool recording() { return _mode == HTTP_TRACE_RECORD; }
+    bool replaying() { return _mode == HTTP_TRACE_REPLAY; }
+    os_t elapsed() { return os_read_monotonic_time() - _start; }
+    os_t scale(os_t cs) { return cs * _time_scale_pct / 100; }
+
+    void record_request(const std::string& method, const std::string& url, const std::string& post,
+                        int code, const std::string& headers, const std::string& body, os_t started);
+    void record_event(const char* json);
+
+    bool find_response(const std::string& method, const std::string& url, CLHTTPTraceResponse& response);
+    bool pop_due_event(CLHTTPTraceEvent& event);  // next event whose scaled time has come
+    bool replay_finished() { return _events.empty(); }
+    // by "method url", for drivers which feed recorded bodies to parsers without the service
+    const std::map<std::string, std::deque<CLHTTPTraceResponse>>& get_responses() { return _responses; }
+    const std::deque<CLHTTPTraceEvent>& get_events() { return _events; }
+    const CLHTTPTraceStats& get_stats() { return _stats; }
+    void dump_stats(FILE* f);
+};
+
+#endif //ROCHAT_CLHTTPTRACE_H
@@ -0,0 +1,97 @@
+//
+// Incremental decoder of gzip/deflate content encoding
+//
+
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+#include "CLInflateStream.h"
+
+bool CLInflateStream::_init(int window_bits) {
+    memset(&_zs, 0, sizeof(_zs));
+    _active = (inflateInit2(&_zs, window_bits) == Z_OK);
+    return _active;
+}
+
+bool CLInflateStream::start(const std::string& content_encoding) {
+    end();
+    _bytes_in = 0;
+    _bytes_out = 0;
+    _raw_deflate = false;
+    _head.clear();
+    _encoding = content_encoding;
+    if (strcasecmp(content_encoding.c_str(), "gzip") != 0 && strcasecmp(content_encoding.c_str(), "x-gzip") != 0 &&
+        strcasecmp(content_encoding.c_str(), "deflate") != 0) {
+        return false;
+    }
+    _head_pending = strcasecmp(content_encoding.c_str(), "deflate") == 0;
+    // 32 - detect gzip or zlib header automatically
+    return _init(15 + 32);
+}
+
+void CLInflateStream::end() {
+    if (_active) {
+        inflateEnd(&_zs);
+        _active = false;
+    }
+}
+
+bool CLInflateStream::feed(const char* c, size_t size) {
+    if (!_active) {
+        return false;
+    }
+    if (_head_pending) {
+        size_t take = std::min(size, 2 - _head.size());
+        _head.append(c, take);
+        c += take;
+        size -= take;
+        if (_head.size() < 2) {
+            return true;
+        }
+        _head_pending = false;
+        unsigned char cmf = _head[0], flg = _head[1];
+        bool zlib_header = (cmf & 0x0F) == Z_DEFLATED && (cmf * 256 + flg) % 31 == 0;
+        bool gzip_header = cmf == 0x1F && flg == 0x8B;
+        if (!zlib_header && !gzip_header) {
+            // some servers send "deflate" as raw deflate data without zlib header
+            inflateEnd(&_zs);
+            _raw_deflate = true;
+            if (!_init(-15)) {
+                return false;
+            }
+        }
+        std::string head;
+        head.swap(_head);
+        if (!_inflate(head.data(), head.size())) {
+            return false;
+        }
+    }
+    return _inflate(c, size);
+}
+
+bool CLInflateStream::_inflate(const char* c, size_t size) {
+    _bytes_in += size;
+    _zs.next_in = (Bytef *) c;
+    _zs.avail_in = size;
+    do {
+        _zs.next_out = (Bytef *) _out;
+        _zs.avail_out = sizeof(_out);
+        int ret = inflate(&_zs, Z_SYNC_FLUSH);
+        size_t produced = sizeof(_out) - _zs.avail_out;
+        if (produced > 0) {
+            _bytes_out += produced;
+            _handler(_out, produced);
+        }
+        if (ret == Z_STREAM_END) {
+            if (_zs.avail_in == 0) {
+                break;
+            }
+            inflateReset(&_zs); // next gzip member follows
+        } else if (ret == Z_BUF_ERROR) {
+            break; // all input consumed, rest of block comes with next chunk
+        } else if (ret != Z_OK) {
+            return false;
+        }
+    } while (_zs.avail_in > 0 || _zs.avail_out == 0);
+    return true;
+}
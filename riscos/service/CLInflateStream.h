@@ -0,0 +1,44 @@
+//
+// Incremental decoder of gzip/deflate content encoding for long-lived responses.
+// Output is handed on as soon as inflate produces it, so blocks flushed by server
+// (Z_SYNC_FLUSH) are delivered without waiting for end of stream.
+//
+
+#ifndef ROCHAT_CLINFLATESTREAM_H
+#define ROCHAT_CLINFLATESTREAM_H
+
+#include <string>
+#include <functional>
+#include <zlib.h>
+
+#define INFLATE_STREAM_BUFFER_SIZE 4096
+
+typedef std::function<void(const char* data, size_t size)> InflateOutputHandlerType;
+
+class CLInflateStream {
+private:
+    z_stream _zs;
+    bool _active = false;
+    bool _raw_deflate = false;      // "deflate" sent without zlib header
+    bool _head_pending = false;     // "deflate" waits for 2 bytes telling zlib header from raw deflate
+    std::string _encoding;
+    std::string _head;              // first bytes of "deflate" until header is checked
+    unsigned long long _bytes_in = 0;
+    unsigned long long _bytes_out = 0;
+    InflateOutputHandlerType _handler;
+    char _out[INFLATE_STREAM_BUFFER_SIZE];
+    bool _init(int window_bits);
+    bool _inflate(const char* c, size_t size);
+public:
+    CLInflateStream(InflateOutputHandlerType handler) : _handler(handler) {};
+    ~CLInflateStream() { end(); }
+    bool start(const std::string& content_encoding); // false for encoding not supported
+    void end();
+    bool feed(const char* c, size_t size);          // false if data is broken
+    bool is_active() { return _active; }
+    const std::string& get_encoding() { return _encoding; }
+    unsigned long long get_bytes_in() { return _bytes_in; }
+    unsigned long long get_bytes_out() { return _bytes_out; }
+};
+
+#endif //ROCHAT_CLINFLATESTREAM_H
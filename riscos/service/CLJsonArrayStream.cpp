@@ -0,0 +1,122 @@
+//
+// Incremental splitter of JSON array elements, fed with response bytes as they arrive
+//
+#include <cloverleaf/Logger.h>
+#include "CLJsonArrayStream.h"
+
+void CLJsonArrayStream::_emit_element() {
+    cJSON *item = cJSON_Parse(_element.c_str());
+    if (item) {
+        _handler(item, _items_count++);
+        cJSON_Delete(item);
+    } else {
+        Logger::error("CLJsonArrayStream: can't parse element %d: %.100s", _items_count, _element.c_str());
+    }
+    _element.clear();
+}
+
+void CLJsonArrayStream::feed(const char* c, unsigned long size) {
+    _bytes_fed += size;
+    for (const char *end = c + size; c < end; c++) {
+        char ch = *c;
+        bool in_element = _items_depth >= 0 && (_depth > _items_depth || !_element.empty());
+
+        if (_in_string) {
+            if (_escaped) {
+                _escaped = false;
+            } else if (ch == '\\') {
+                _escaped = true;
+            } else if (ch == '"') {
+                _in_string = false;
+            }
+            if (in_element) {
+                _element += ch;
+            } else {
+                _envelope += ch;
+                if (_depth == 1 && _in_string) {
+                    _key += ch;
+                }
+            }
+            continue;
+        }
+
+        if (_items_depth >= 0 && _depth == _items_depth) {
+            // between elements of streamed array or inside scalar element
+            if (ch == ',' || ch == ']') {
+                if (!_element.empty()) {
+                    _emit_element();
+                }
+                if (ch == ']') {
+                    _items_depth = -1;
+                    _depth--;
+                    _envelope += ch;
+                }
+                continue;
+            }
+            if (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n') {
+                continue;
+            }
+        }
+
+        switch (ch) {
+            case '"':
+                _in_string = true;
+                if (_depth == 1 && _items_depth < 0) {
+                    _key.clear();
+                    _key_matched = false;
+                }
+                break;
+            case ':':
+                if (_depth == 1 && _items_depth < 0) {
+                    _key_matched = (_key == _array_key);
+                }
+                break;
+            case '[':
+            case '{':
+                if (ch == '[' && _items_depth < 0 &&
+                    ((_depth == 0 && _array_key.empty()) || (_depth == 1 && _key_matched))) {
+                    _depth++;
+                    _items_depth = _depth;
+                    _envelope += ch;
+                    continue;
+                }
+                _depth++;
+                break;
+            case ']':
+            case '}':
+                _depth--;
+                if (_items_depth >= 0 && _depth == _items_depth) {
+                    _element += ch;
+                    _emit_element();
+                    continue;
+                }
+                break;
+        }
+
+        if (_items_depth >= 0 && (_depth > _items_depth || ch == '"' || _depth == _items_depth)) {
+            _element += ch;
+        } else {
+            _envelope += ch;
+        }
+    }
+}
+
+void CLJsonArrayStream::finish() {
+    if (!_element.empty()) {
+        Logger::error("CLJsonArrayStream: response ended inside of element %d", _items_count);
+        _element.clear();
+    }
+}
+
+void CLJsonArrayStream::reset() {
+    _envelope.clear();
+    _element.clear();
+    _key.clear();
+    _depth = 0;
+    _items_depth = -1;
+    _in_string = false;
+    _escaped = false;
+    _key_matched = false;
+    _items_count = 0;
+    _bytes_fed = 0;
+}
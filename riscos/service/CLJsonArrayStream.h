@@ -0,0 +1,45 @@
+//
+// Incremental splitter of JSON array elements, fed with response bytes as they arrive
+//
+
+#ifndef ROCHAT_CLJSONARRAYSTREAM_H
+#define ROCHAT_CLJSONARRAYSTREAM_H
+
+#include <string>
+#include <functional>
+#include "../libs/cJSON/cJSON.h"
+
+// item is deleted after handler returns, index counts from 0 for every response
+typedef std::function<void(cJSON* item, int index)> JsonStreamItemHandlerType;
+
+// Elements of array (top level one or the one under array_key of top level object) are parsed
+// and passed to handler one by one as soon as each is complete, only one element is kept in memory.
+// Everything else is collected into envelope, with the streamed array left empty:
+// [] or {"items":[],"next":"..."}
+class CLJsonArrayStream {
+private:
+    std::string _array_key;
+    JsonStreamItemHandlerType _handler;
+    std::string _envelope;
+    std::string _element;
+    std::string _key;           // last string seen on first level of top level object
+    int _depth = 0;
+    int _items_depth = -1;      // depth of streamed array elements, -1 if not inside the array
+    bool _in_string = false;
+    bool _escaped = false;
+    bool _key_matched = false;
+    int _items_count = 0;
+    unsigned long _bytes_fed = 0;
+    void _emit_element();
+public:
+    CLJsonArrayStream(const std::string& array_key, JsonStreamItemHandlerType handler)
+            : _array_key(array_key), _handler(handler) {};
+    void feed(const char* c, unsigned long size);
+    void finish();
+    void reset();
+    const std::string& get_envelope() { return _envelope; }
+    int get_items_count() { return _items_count; }
+    unsigned long get_bytes_fed() { return _bytes_fed; }
+};
+
+#endif //ROCHAT_CLJSONARRAYSTREAM_H
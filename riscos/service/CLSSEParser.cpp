@@ -0,0 +1,110 @@
+//
+// Incremental parser of text/event-stream, chunks may be split at any byte
+//
+#include <string.h>
+#include <stdlib.h>
+#include "CLSSEParser.h"
+
+void CLSSEParser::feed(const char* c, size_t size) {
+    if (_skip_lf && size > 0) {
+        _skip_lf = false;
+        if (*c == '\n') {
+            c++;
+            size--;
+        }
+    }
+    _buf.append(c, size);
+
+    const char *start = _buf.data();
+    const char *end = start + _buf.size();
+    const char *line = start;
+    const char *p = start + _scan_pos;
+    _feeding = true;
+    while (p < end && !_reset_pending) {
+        if (*p != '\n' && *p != '\r') {
+            p++;
+            continue;
+        }
+        _process_line(line, p - line);
+        if (*p == '\r') {
+            if (p + 1 == end) {
+                _skip_lf = true;
+            } else if (p[1] == '\n') {
+                p++;
+            }
+        }
+        line = ++p;
+    }
+    _feeding = false;
+    if (_reset_pending) {
+        // handler restarted the stream, rest of this chunk belongs to the old connection
+        _reset_pending = false;
+        _clear();
+        return;
+    }
+    _buf.erase(0, line - start);
+    _scan_pos = _buf.size();
+}
+
+void CLSSEParser::_process_line(const char* line, size_t len) {
+    if (len == 0) {
+        _dispatch();
+        return;
+    }
+    if (line[0] == ':') { // comment, push stream sends them as keepalive
+        return;
+    }
+    const char *colon = (const char *) memchr(line, ':', len);
+    size_t name_len = colon ? colon - line : len;
+    const char *value = colon ? colon + 1 : line + len;
+    size_t value_len = line + len - value;
+    if (value_len > 0 && *value == ' ') {
+        value++;
+        value_len--;
+    }
+
+    if (name_len == 4 && memcmp(line, "data", 4) == 0) {
+        _data.append(value, value_len);
+        _data += '\n';
+    } else if (name_len == 5 && memcmp(line, "event", 5) == 0) {
+        _event_type.assign(value, value_len);
+    } else if (name_len == 2 && memcmp(line, "id", 2) == 0) {
+        if (!memchr(value, '\0', value_len)) {
+            _last_event_id.assign(value, value_len);
+        }
+    } else if (name_len == 5 && memcmp(line, "retry", 5) == 0) {
+        if (value_len > 0 && strspn(value, "0123456789") >= value_len) {
+            _retry_ms = atoi(std::string(value, value_len).c_str());
+        }
+    }
+}
+
+void CLSSEParser::_dispatch() {
+    if (_data.empty()) {
+        _event_type.clear();
+        return;
+    }
+    _data.pop_back(); // last \n
+    static const std::string default_type = "message";
+    CLSSEEvent ev = {_event_type.empty() ? default_type : _event_type, _last_event_id, _data.c_str(), _data.size()};
+    _events_count++;
+    _handler(ev);
+    _data.clear();
+    _event_type.clear();
+}
+
+void CLSSEParser::reset() {
+    if (_feeding) {
+        _reset_pending = true;
+        return;
+    }
+    _clear();
+}
+
+void CLSSEParser::_clear() {
+    _buf.clear();
+    _scan_pos = 0;
+    _skip_lf = false;
+    _data.clear();
+    _event_type.clear();
+}
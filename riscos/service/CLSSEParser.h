@@ -0,0 +1,45 @@
+//
+// Incremental parser of text/event-stream, chunks may be split at any byte
+//
+
+#ifndef ROCHAT_CLSSEPARSER_H
+#define ROCHAT_CLSSEPARSER_H
+
+#include <string>
+#include <functional>
+
+struct CLSSEEvent {
+    const std::string& type;    // "message" if no event: field
+    const std::string& id;      // last id: seen on the stream, kept between events as in spec
+    const char* data;           // data: lines joined with \n, NUL terminated
+    size_t data_len;
+};
+
+typedef std::function<void(const CLSSEEvent& event)> SSEEventHandlerType;
+
+class CLSSEParser {
+private:
+    std::string _buf;           // unparsed tail of stream, consumed lines are dropped in one go per chunk
+    size_t _scan_pos = 0;       // where search of line end continues from
+    bool _skip_lf = false;      // previous chunk ended with CR, LF of CRLF may come first
+    std::string _data;
+    std::string _event_type;
+    std::string _last_event_id;
+    int _retry_ms = -1;
+    unsigned long _events_count = 0;
+    bool _feeding = false;      // feed() holds pointers into _buf while handler runs
+    bool _reset_pending = false; // reset() called from handler, done when feed() returns
+    SSEEventHandlerType _handler;
+    void _process_line(const char* line, size_t len);
+    void _dispatch();
+    void _clear();
+public:
+    CLSSEParser(SSEEventHandlerType handler) : _handler(handler) {};
+    void feed(const char* c, size_t size);
+    void reset();                // new connection, last event id and retry are kept, may be called from handler
+    const std::string& get_last_event_id() { return _last_event_id; }
+    int get_retry_ms() { return _retry_ms; } // -1 if server did not send retry:
+    unsigned long get_events_count() { return _events_count; }
+};
+
+#endif //ROCHAT_CLSSEPARSER_H
@@ -0,0 +1,340 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <openssl/sha.h>
+#include <openssl/evp.h>
+#include <cloverleaf/Logger.h>
+#include "CLWebSocket.h"
+
+#define WEBSOCKET_OP_CONTINUATION 0x0
+#define WEBSOCKET_OP_TEXT 0x1
+#define WEBSOCKET_OP_BINARY 0x2
+#define WEBSOCKET_OP_CLOSE 0x8
+#define WEBSOCKET_OP_PING 0x9
+#define WEBSOCKET_OP_PONG 0xA
+
+static const char* _websocket_guid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+static std::string _base64(const unsigned char* data, size_t size) {
+    std::string out(((size + 2) / 3) * 4 + 1, '\0');
+    int len = EVP_EncodeBlock((unsigned char*) &out[0], data, size);
+    out.resize(len);
+    return out;
+}
+
+void CLWebSocket::connect(CURLM* multi, const std::string& url, const std::string& authorization,
+                          struct curl_slist* resolved_addrs, CURLSH* share) {
+    close();
+    _curl_multi = multi;
+    _url = url;
+    _authorization = authorization;
+    _in.clear();
+    _out.clear();
+    _message.clear();
+
+    _curl_handle = curl_easy_init();
+    curl_easy_setopt(_curl_handle, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(_curl_handle, CURLOPT_CONNECT_ONLY, 1L);
+    curl_easy_setopt(_curl_handle, CURLOPT_CONNECTTIMEOUT, 30L);
+    curl_easy_setopt(_curl_handle, CURLOPT_CAINFO, "<ChatCube$Dir>.ssl.chain");
+    curl_easy_setopt(_curl_handle, CURLOPT_SSL_VERIFYPEER, false);
+    if (share) {
+        curl_easy_setopt(_curl_handle, CURLOPT_SHARE, share);
+    }
+    if (resolved_addrs) {
+        curl_easy_setopt(_curl_handle, CURLOPT_RESOLVE, resolved_addrs);
+    }
+    _state = WEBSOCKET_STATE_CONNECTING;
+    _last_receive_time = time(NULL);
+    curl_multi_add_handle(_curl_multi, _curl_handle);
+    Logger::debug("CLWebSocket::connect %s", url.c_str());
+}
+
+void CLWebSocket::on_connected(CURLcode result) {
+    if (result != CURLE_OK) {
+        _fail(curl_easy_strerror(result));
+        return;
+    }
+    _state = WEBSOCKET_STATE_HANDSHAKE;
+    _send_handshake();
+}
+
+void CLWebSocket::_send_handshake() {
+    unsigned char key[16];
+    for (int i = 0; i < 16; i++) {
+        key[i] = (unsigned char) random();
+    }
+    _handshake_key = _base64(key, sizeof(key));
+
+    // http(s)://host[:port]/path?query
+    size_t host_start = _url.find("://");
+    host_start = (host_start == std::string::npos) ? 0 : host_start + 3;
+    size_t path_start = _url.find('/', host_start);
+    std::string host = _url.substr(host_start, path_start == std::string::npos ? std::string::npos : path_start - host_start);
+    std::string path = path_start == std::string::npos ? "/" : _url.substr(path_start);
+
+    _out = "GET " + path + " HTTP/1.1\r\n"
+           "Host: " + host + "\r\n"
+           "Upgrade: websocket\r\n"
+           "Connection: Upgrade\r\n"
+           "Sec-WebSocket-Key: " + _handshake_key + "\r\n"
+           "Sec-WebSocket-Version: 13\r\n";
+    if (!user_agent.empty()) {
+        _out += "User-Agent: " + user_agent + "\r\n";
+    }
+    if (!_authorization.empty()) {
+        _out += "Authorization: " + _authorization + "\r\n";
+    }
+    _out += "\r\n";
+    _flush();
+}
+
+bool CLWebSocket::_parse_handshake() {
+    size_t end = _in.find("\r\n\r\n");
+    if (end == std::string::npos) {
+        if (_in.size() > 16384) {
+            _fail("handshake response too long");
+        }
+        return false;
+    }
+    std::string head = _in.substr(0, end);
+    _in.erase(0, end + 4);
+
+    if (head.compare(0, 9, "HTTP/1.1 ") != 0 || head.compare(9, 3, "101") != 0) {
+        Logger::error("CLWebSocket %s upgrade refused: %s", _url.c_str(), head.substr(0, head.find('\r')).c_str());
+        _fail("upgrade refused");
+        return false;
+    }
+
+    std::string accept_src = _handshake_key + _websocket_guid;
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    SHA1((const unsigned char*) accept_src.data(), accept_src.size(), digest);
+    std::string expected = _base64(digest, sizeof(digest));
+    bool accepted = false;
+    size_t pos = 0;
+    while ((pos = head.find("\r\n", pos)) != std::string::npos) {
+        pos += 2;
+        size_t colon = head.find(':', pos);
+        size_t eol = head.find("\r\n", pos);
+        if (colon == std::string::npos || (eol != std::string::npos && colon > eol)) {
+            continue;
+        }
+        static const char* accept_header = "Sec-WebSocket-Accept";
+        if (colon - pos == strlen(accept_header) && strncasecmp(head.c_str() + pos, accept_header, colon - pos) == 0) {
+            size_t value_start = head.find_first_not_of(' ', colon + 1);
+            std::string value = head.substr(value_start, eol == std::string::npos ? std::string::npos : eol - value_start);
+            accepted = (value == expected);
+        }
+    }
+    if (!accepted) {
+        _fail("wrong Sec-WebSocket-Accept");
+        return false;
+    }
+
+    _state = WEBSOCKET_STATE_OPEN;
+    Logger::info("CLWebSocket %s open", _url.c_str());
+    if (on_open) {
+        on_open();
+    }
+    return true;
+}
+
+void CLWebSocket::_parse_frames() {
+    while (_state == WEBSOCKET_STATE_OPEN && _in.size() >= 2) {
+        const unsigned char *p = (const unsigned char*) _in.data();
+        bool fin = (p[0] & 0x80) != 0;
+        int opcode = p[0] & 0x0F;
+        bool masked = (p[1] & 0x80) != 0;
+        unsigned long long len = p[1] & 0x7F;
+        size_t pos = 2;
+        if (len == 126) {
+            if (_in.size() < 4) {
+                return;
+            }
+            len = ((unsigned long long) p[2] << 8) | p[3];
+            pos = 4;
+        } else if (len == 127) {
+            if (_in.size() < 10) {
+                return;
+            }
+            len = 0;
+            for (int i = 2; i < 10; i++) {
+                len = (len << 8) | p[i];
+            }
+            pos = 10;
+        }
+        if (len > WEBSOCKET_MAX_MESSAGE || _message.size() + len > WEBSOCKET_MAX_MESSAGE) {
+            _fail("message too big");
+            return;
+        }
+        size_t mask_pos = pos;
+        if (masked) {
+            pos += 4;
+        }
+        if (_in.size() < pos + len) {
+            return;
+        }
+        std::string payload = _in.substr(pos, len);
+        if (masked) {
+            for (size_t i = 0; i < payload.size(); i++) {
+                payload[i] ^= _in[mask_pos + (i % 4)];
+            }
+        }
+        _in.erase(0, pos + len);
+
+        switch (opcode) {
+            case WEBSOCKET_OP_TEXT:
+            case WEBSOCKET_OP_BINARY:
+            case WEBSOCKET_OP_CONTINUATION:
+                _message += payload;
+                if (fin) {
+                    messages_in++;
+                    std::string message;
+                    message.swap(_message);
+                    if (on_message) {
+                        on_message(message);
+                    }
+                }
+                break;
+            case WEBSOCKET_OP_PING:
+                _queue_frame(WEBSOCKET_OP_PONG, payload.data(), payload.size());
+                break;
+            case WEBSOCKET_OP_PONG:
+                break;
+            case WEBSOCKET_OP_CLOSE:
+                _fail("closed by server");
+                return;
+            default:
+                _fail("unknown frame");
+                return;
+        }
+    }
+}
+
+void CLWebSocket::_queue_frame(int opcode, const char* data, size_t size) {
+    unsigned char mask[4];
+    for (int i = 0; i < 4; i++) {
+        mask[i] = (unsigned char) random();
+    }
+    _out += (char) (0x80 | opcode);
+    if (size < 126) {
+        _out += (char) (0x80 | size);
+    } else if (size < 65536) {
+        _out += (char) (0x80 | 126);
+        _out += (char) ((size >> 8) & 0xFF);
+        _out += (char) (size & 0xFF);
+    } else {
+        _out += (char) (0x80 | 127);
+        for (int i = 7; i >= 0; i--) {
+            _out += (char) (((unsigned long long) size >> (i * 8)) & 0xFF);
+        }
+    }
+    _out.append((const char*) mask, 4);
+    size_t start = _out.size();
+    _out.append(data, size);
+    for (size_t i = 0; i < size; i++) {
+        _out[start + i] ^= mask[i % 4];
+    }
+    _last_send_time = time(NULL);
+}
+
+bool CLWebSocket::send_text(const std::string& text) {
+    if (_state != WEBSOCKET_STATE_OPEN) {
+        return false;
+    }
+    _queue_frame(WEBSOCKET_OP_TEXT, text.data(), text.size());
+    messages_out++;
+    return _flush();
+}
+
+bool CLWebSocket::_flush() {
+    while (!_out.empty() && _curl_handle) {
+        size_t sent = 0;
+        CURLcode res = curl_easy_send(_curl_handle, _out.data(), _out.size(), &sent);
+        if (res == CURLE_AGAIN) {
+            return true;
+        }
+        if (res != CURLE_OK) {
+            _fail(curl_easy_strerror(res));
+            return false;
+        }
+        bytes_out += sent;
+        _out.erase(0, sent);
+    }
+    return true;
+}
+
+void CLWebSocket::_read() {
+    char buf[4096];
+    while (_curl_handle) {
+        size_t received = 0;
+        CURLcode res = curl_easy_recv(_curl_handle, buf, sizeof(buf), &received);
+        if (res == CURLE_AGAIN) {
+            return;
+        }
+        if (res != CURLE_OK || received == 0) {
+            _fail(res != CURLE_OK ? curl_easy_strerror(res) : "connection closed");
+            return;
+        }
+        bytes_in += received;
+        _last_receive_time = time(NULL);
+        _in.append(buf, received);
+    }
+}
+
+void CLWebSocket::process() {
+    if (_state != WEBSOCKET_STATE_HANDSHAKE && _state != WEBSOCKET_STATE_OPEN) {
+        return;
+    }
+    if (!_flush()) {
+        return;
+    }
+    _read();
+    if (_state == WEBSOCKET_STATE_HANDSHAKE && !_parse_handshake()) {
+        return;
+    }
+    _parse_frames();
+    if (_state != WEBSOCKET_STATE_OPEN) {
+        return;
+    }
+    time_t now = time(NULL);
+    if (_last_receive_time + WEBSOCKET_RECEIVE_TIMEOUT <= now) {
+        _fail("receive timeout");
+        return;
+    }
+    if (_last_send_time + WEBSOCKET_PING_INTERVAL <= now) {
+        _queue_frame(WEBSOCKET_OP_PING, "", 0);
+    }
+    _flush();
+}
+
+void CLWebSocket::close() {
+    if (_curl_handle) {
+        if (_state == WEBSOCKET_STATE_OPEN) {
+            // status 1000, normal closure; best effort, socket is closed right after
+            const char status[2] = {(char) 0x03, (char) 0xE8};
+            _queue_frame(WEBSOCKET_OP_CLOSE, status, 2);
+            size_t sent;
+            curl_easy_send(_curl_handle, _out.data(), _out.size(), &sent);
+        }
+        curl_multi_remove_handle(_curl_multi, _curl_handle);
+        curl_easy_cleanup(_curl_handle);
+        _curl_handle = NULL;
+    }
+    _state = WEBSOCKET_STATE_CLOSED;
+    _out.clear();
+    _in.clear();
+    _message.clear();
+}
+
+void CLWebSocket::_fail(const char* reason) {
+    bool was_open = (_state == WEBSOCKET_STATE_OPEN);
+    Logger::warn("CLWebSocket %s closed: %s", _url.c_str(), reason);
+    // connection is broken, no close frame
+    _state = WEBSOCKET_STATE_CLOSED;
+    close();
+    if (on_close) {
+        on_close(was_open);
+    }
+}
@@ -0,0 +1,70 @@
+//
+// Minimal RFC 6455 websocket client. Curl makes TCP/TLS connection of CONNECT_ONLY handle in multi,
+// upgrade handshake and frames go by curl_easy_send/curl_easy_recv polled from CLHTTPService::process().
+// Only text messages are used. Client frames are masked, as RFC requires.
+//
+
+#ifndef ROCHAT_CLWEBSOCKET_H
+#define ROCHAT_CLWEBSOCKET_H
+
+#include <string>
+#include <functional>
+#include <curl/curl.h>
+
+#define WEBSOCKET_STATE_CLOSED 0
+#define WEBSOCKET_STATE_CONNECTING 1    // curl makes connection
+#define WEBSOCKET_STATE_HANDSHAKE 2     // upgrade request sent, waiting for 101
+#define WEBSOCKET_STATE_OPEN 3
+
+#define WEBSOCKET_PING_INTERVAL 20      // seconds without sending anything before ping
+#define WEBSOCKET_RECEIVE_TIMEOUT 60    // seconds without anything received (server pings too) before connection is dropped
+#define WEBSOCKET_MAX_MESSAGE (1024 * 1024)
+
+typedef std::function<void(const std::string& message)> WebSocketMessageHandlerType;
+typedef std::function<void(bool was_open)> WebSocketCloseHandlerType;
+
+class CLWebSocket {
+private:
+    CURLM *_curl_multi = NULL;
+    CURL *_curl_handle = NULL;
+    int _state = WEBSOCKET_STATE_CLOSED;
+    std::string _url;
+    std::string _authorization;
+    std::string _handshake_key;
+    std::string _in;            // received bytes not parsed yet
+    std::string _out;           // frames not taken by socket yet
+    std::string _message;       // fragments of message being received
+    time_t _last_receive_time = 0;
+    time_t _last_send_time = 0;
+    void _send_handshake();
+    bool _parse_handshake();
+    void _parse_frames();
+    void _queue_frame(int opcode, const char* data, size_t size);
+    bool _flush();
+    void _read();
+    void _fail(const char* reason);
+public:
+    std::string user_agent;
+    WebSocketMessageHandlerType on_message;
+    std::function<void()> on_open;
+    WebSocketCloseHandlerType on_close;
+    unsigned long long bytes_in = 0;
+    unsigned long long bytes_out = 0;
+    unsigned long messages_in = 0;
+    unsigned long messages_out = 0;
+
+    // adds CONNECT_ONLY handle to multi, handshake starts when on_connected() tells connection is made
+    void connect(CURLM* multi, const std::string& url, const std::string& authorization,
+                 struct curl_slist* resolved_addrs, CURLSH* share);
+    void on_connected(CURLcode result);     // CURLMSG_DONE of our handle
+    void process();
+    bool send_text(const std::string& text);
+    void close();
+    CURL* get_curl_handle() { return _curl_handle; }
+    const std::string& get_url() { return _url; }
+    int get_state() { return _state; }
+    bool is_open() { return _state == WEBSOCKET_STATE_OPEN; }
+    bool is_connected() { return is_open() && (_last_receive_time + WEBSOCKET_RECEIVE_TIMEOUT) > time(NULL); }
+};
+
+#endif //ROCHAT_CLWEBSOCKET_H
@@ -0,0 +1,182 @@
+//
+// Host benchmark of ChatMessages against the plain vector it replaced, where messages were found
+// by linear scan (ChatData::get_message) and the vector was put in order by sort_messages() after
+// each loaded page. Measures loading history page by page, lookups by id, new messages from events,
+// and rekey (confirmed instant message or "new_id" update) at chat size given.
+//
+// Build and run: see CMakeLists.txt, ./chat_messages_bench [messages] [operations]
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+#include <cloverleaf/Logger.h>
+#include "ChatData.h"
+#include "MessageData.h"
+#include "host/host_riscos.h"
+
+#define PAGE_SIZE 50    // messages in loaded page
+#define BASE_TIME 1700000000
+
+static void check(bool cond, const char* what) {
+    if (!cond) {
+        fprintf(stderr, "check failed: %s\n", what);
+        abort();
+    }
+}
+
+// messages of chat before ChatMessages: vector, linear lookups, full sort after changes
+class VectorMessages {
+public:
+    MessagesVector items;
+
+    MessageDataPtr find(int64_t msg_id) {
+        for (auto m : items) {
+            if (m->id == msg_id) {
+                return m;
+            }
+        }
+        return nullptr;
+    }
+
+    void sort_messages() {
+        std::sort(items.begin(), items.end(), [](const std::shared_ptr<MessageData> a, const std::shared_ptr<MessageData> b) {
+            if (a->sendtime == b->sendtime) {
+                return a->id < b->id;
+            }
+            return (a->sendtime < b->sendtime);
+        });
+    }
+};
+
+static MessageDataPtr make_message(int64_t id) {
+    MessageDataPtr msg = make_message_data();
+    msg->id = id;
+    msg->sendtime = BASE_TIME + id / 2; // two messages per second, equal times are ordered by id
+    return msg;
+}
+
+static unsigned int next_random(unsigned int& state) {
+    state = state * 1103515245 + 12345;
+    return state >> 8;
+}
+
+struct Timings {
+    double load_ms = 0;
+    double find_ms = 0;
+    double events_ms = 0;
+    double rekey_ms = 0;
+};
+
+// history loaded newest page first, as scrolling up does; each item is looked up before insert
+// as update_or_create_message_data does
+static Timings run_vector(int messages, int operations) {
+    Timings t;
+    VectorMessages chat;
+    double start = host_now_ms();
+    for (int page_end = messages; page_end > 0; page_end -= PAGE_SIZE) {
+        for (int64_t id = std::max(1, page_end - PAGE_SIZE + 1); id <= page_end; id++) {
+            if (chat.find(id) == nullptr) {
+                chat.items.push_back(make_message(id));
+            }
+        }
+        chat.sort_messages();
+    }
+    t.load_ms = host_now_ms() - start;
+
+    unsigned int state = 1;
+    start = host_now_ms();
+    for (int i = 0; i < operations; i++) {
+        check(chat.find(1 + next_random(state) % messages) != nullptr, "vector find");
+    }
+    t.find_ms = host_now_ms() - start;
+
+    start = host_now_ms();
+    for (int64_t id = messages + 1; id <= messages + operations; id++) {
+        if (chat.find(id) == nullptr) {
+            chat.items.push_back(make_message(id));
+        }
+    }
+    t.events_ms = host_now_ms() - start;
+
+    // instant message (id 0) confirmed by server, then put in place by sort
+    start = host_now_ms();
+    for (int i = 0; i < operations; i++) {
+        MessageDataPtr msg = make_message(0);
+        chat.items.push_back(msg);
+        int64_t new_id = messages + operations + 1 + i;
+        msg->id = new_id;
+        msg->sendtime = BASE_TIME + new_id / 2;
+        chat.sort_messages();
+    }
+    t.rekey_ms = host_now_ms() - start;
+    check(chat.items.size() == (size_t) messages + 2 * operations, "vector size");
+    return t;
+}
+
+static Timings run_chat_messages(int messages, int operations) {
+    Timings t;
+    ChatMessages chat;
+    double start = host_now_ms();
+    for (int page_end = messages; page_end > 0; page_end -= PAGE_SIZE) {
+        for (int64_t id = std::max(1, page_end - PAGE_SIZE + 1); id <= page_end; id++) {
+            if (chat.find(id) == nullptr) {
+                chat.insert(make_message(id));
+            }
+        }
+    }
+    t.load_ms = host_now_ms() - start;
+
+    unsigned int state = 1;
+    start = host_now_ms();
+    for (int i = 0; i < operations; i++) {
+        check(chat.find(1 + next_random(state) % messages) != nullptr, "ChatMessages find");
+    }
+    t.find_ms = host_now_ms() - start;
+
+    start = host_now_ms();
+    for (int64_t id = messages + 1; id <= messages + operations; id++) {
+        if (chat.find(id) == nullptr) {
+            chat.insert(make_message(id));
+        }
+    }
+    t.events_ms = host_now_ms() - start;
+
+    start = host_now_ms();
+    for (int i = 0; i < operations; i++) {
+        MessageDataPtr msg = make_message(0);
+        chat.insert(msg);
+        time_t old_sendtime = msg->sendtime;
+        int64_t new_id = messages + operations + 1 + i;
+        msg->id = new_id;
+        msg->sendtime = BASE_TIME + new_id / 2;
+        chat.rekey(msg, old_sendtime, 0);
+    }
+    t.rekey_ms = host_now_ms() - start;
+    check(chat.size() == (size_t) messages + 2 * operations, "ChatMessages size");
+    for (size_t i = 1; i < chat.size(); i++) {
+        check(chat[i - 1]->id < chat[i]->id, "ChatMessages in order");
+    }
+    check(chat.index_of(messages / 2) == messages / 2 - 1, "ChatMessages index");
+    return t;
+}
+
+static void report(const char* name, double vector_ms, double chat_messages_ms, int count) {
+    printf("  %-22s vector %9.2f ms %8.2f us/op   ChatMessages %7.2f ms %6.2f us/op   x%.0f\n", name, vector_ms,
+           vector_ms * 1000 / count, chat_messages_ms, chat_messages_ms * 1000 / count,
+           chat_messages_ms > 0 ? vector_ms / chat_messages_ms : 0);
+}
+
+int main(int argc, char** argv) {
+    int messages = argc > 1 ? atoi(argv[1]) : 10000;
+    int operations = argc > 2 ? atoi(argv[2]) : 1000;
+    Logger::init("/dev/null");
+    Timings v = run_vector(messages, operations);
+    Timings c = run_chat_messages(messages, operations);
+    printf("%d messages, %d operations of each kind:\n", messages, operations);
+    report("load pages of 50", v.load_ms, c.load_ms, messages);
+    report("find by id", v.find_ms, c.find_ms, operations);
+    report("new message event", v.events_ms, c.events_ms, operations);
+    report("confirm/rekey", v.rekey_ms, c.rekey_ms, operations);
+    return 0;
+}
@@ -0,0 +1,137 @@
+//
+// Host benchmark of chats list ordering when new message moves one chat: placing that chat again
+// by binary search on precomputed order keys (chat_order_less, AppDataModel::get_chats_list after
+// reorder_chat) against sorting whole list with utf8casecmp of titles as it was done before.
+//
+// Build and run: see CMakeLists.txt, ./chat_order_bench [chats] [new messages]
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+#include <cloverleaf/Logger.h>
+#include <cloverleaf/utf8.h>
+#include "ChatData.h"
+#include "MessageData.h"
+#include "host/host_riscos.h"
+
+#define BASE_TIME 1700000000
+
+static void check(bool cond, const char* what) {
+    if (!cond) {
+        fprintf(stderr, "check failed: %s\n", what);
+        abort();
+    }
+}
+
+// last message ordering before order keys
+static bool old_chat_less(const ChatDataPtr &a, const ChatDataPtr &b) {
+    MessageDataPtr &a_msg = a->last_message;
+    MessageDataPtr &b_msg = b->last_message;
+    bool has_a = (a_msg != nullptr);
+    bool has_b = (b_msg != nullptr);
+    if (has_a && has_b) {
+        return (a_msg->sendtime > b_msg->sendtime);
+    }
+    if (has_a) {
+        return true;
+    }
+    if (has_b) {
+        return false;
+    }
+    return (utf8casecmp(a->title.c_str(), b->title.c_str()) < 0);
+}
+
+// as AppDataModel::set_chat_order_key() for last message ordering
+static void set_order_key(ChatData* chat) {
+    chat->order_key.group = 0;
+    chat->order_key.has_last_message = chat->last_message != nullptr;
+    chat->order_key.last_message_time = chat->last_message ? chat->last_message->sendtime : 0;
+    chat->order_key.title_key = chat->title_key;
+}
+
+static unsigned int next_random(unsigned int& state) {
+    state = state * 1103515245 + 12345;
+    return state >> 8;
+}
+
+// every 10th chat has no messages and is ordered by title
+static std::vector<ChatDataPtr> make_chats(int count) {
+    std::vector<ChatDataPtr> chats;
+    for (int i = 0; i < count; i++) {
+        ChatDataPtr chat = std::make_shared<ChatData>();
+        char text[64];
+        snprintf(text, sizeof(text), "c%d", i);
+        chat->id = text;
+        snprintf(text, sizeof(text), "%s Chat %05d", i % 2 ? "group" : "Private", (i * 7919) % count);
+        chat->set_title(text);
+        if (i % 10 != 0) {
+            chat->last_message = make_message_data();
+            chat->last_message->sendtime = BASE_TIME + i;
+        }
+        set_order_key(chat.get());
+        chats.push_back(chat);
+    }
+    return chats;
+}
+
+static void new_message(ChatDataPtr& chat, time_t sendtime) {
+    chat->last_message = make_message_data();
+    chat->last_message->sendtime = sendtime;
+}
+
+static double run_sort(int count, int messages, std::vector<ChatDataPtr>& list) {
+    list = make_chats(count);
+    std::sort(list.begin(), list.end(), old_chat_less);
+    std::vector<ChatDataPtr> chats = list;
+    unsigned int state = 1;
+    double start = host_now_ms();
+    for (int i = 0; i < messages; i++) {
+        new_message(chats[next_random(state) % count], BASE_TIME + count + i);
+        std::sort(list.begin(), list.end(), old_chat_less);
+    }
+    return host_now_ms() - start;
+}
+
+static double run_reorder(int count, int messages, std::vector<ChatDataPtr>& list) {
+    list = make_chats(count);
+    std::sort(list.begin(), list.end(), chat_order_less);
+    std::vector<ChatDataPtr> chats = list;
+    unsigned int state = 1;
+    double start = host_now_ms();
+    for (int i = 0; i < messages; i++) {
+        ChatDataPtr &chat = chats[next_random(state) % count];
+        new_message(chat, BASE_TIME + count + i);
+        // key of chat is still the one it was placed by, so it is found by binary search
+        auto pos = std::lower_bound(list.begin(), list.end(), chat, chat_order_less);
+        check(pos != list.end() && *pos == chat, "chat found by its key");
+        list.erase(pos);
+        set_order_key(chat.get());
+        list.insert(std::upper_bound(list.begin(), list.end(), chat, chat_order_less), chat);
+    }
+    return host_now_ms() - start;
+}
+
+int main(int argc, char** argv) {
+    int messages = argc > 2 ? atoi(argv[2]) : 1000;
+    std::vector<int> sizes;
+    if (argc > 1) {
+        sizes.push_back(atoi(argv[1]));
+    } else {
+        sizes = {1000, 5000};
+    }
+    Logger::init("/dev/null");
+    for (int count : sizes) {
+        std::vector<ChatDataPtr> sorted, reordered;
+        double sort_ms = run_sort(count, messages, sorted);
+        double reorder_ms = run_reorder(count, messages, reordered);
+        check(sorted.size() == reordered.size(), "same list size");
+        for (size_t i = 0; i < sorted.size(); i++) {
+            check(sorted[i]->id == reordered[i]->id, "same order as full sort");
+        }
+        printf("%d chats, %d new messages:  full sort %8.1f us/message   reorder_chat %6.1f us/message   x%.0f\n",
+               count, messages, sort_ms * 1000 / messages, reorder_ms * 1000 / messages,
+               reorder_ms > 0 ? sort_ms / reorder_ms : 0);
+    }
+    return 0;
+}
@@ -0,0 +1,345 @@
+//
+// Host stand-ins of RISC OS calls and of the portable part of utils.cpp, so service and model
+// code links on Linux for tests and benchmarks. File names are used as given, RISC OS paths
+// like <Choices$Write>.ChatCube.x become plain names in the current directory.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <ftw.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include <zlib.h>
+#include <string>
+#include <vector>
+#include "oslib/os.h"
+#include "oslib/resolver.h"
+#include "../../utils.h"
+#include "../../global.h"
+#include "cloverleaf/CLException.h"
+#include "cloverleaf/utf8.h"
+#include "cloverleaf/CLUtf8.h"
+#include "host_riscos.h"
+
+AppState g_app_state;
+unsigned long host_poll_wakeups = 0;
+
+static long long _fake_time_cs = -1;
+
+os_t os_read_monotonic_time() {
+    if (_fake_time_cs >= 0) {
+        return (os_t) _fake_time_cs;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (os_t) (ts.tv_sec * 100 + ts.tv_nsec / 10000000);
+}
+
+void host_set_fake_time(long long cs) {
+    _fake_time_cs = cs;
+}
+
+os_error* xresolver_get_host(const char* host_name, int* err, resolver_host_details** details) {
+    static byte address[4];
+    static byte *addresses[2] = {address, NULL};
+    static resolver_host_details result = {NULL, NULL, AF_INET, 4, addresses};
+    struct addrinfo hints, *info = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    *err = getaddrinfo(host_name, NULL, &hints, &info);
+    if (*err != 0 || !info) {
+        *err = *err ? *err : EAI_NONAME;
+        return NULL;
+    }
+    memcpy(address, &((struct sockaddr_in *) info->ai_addr)->sin_addr, 4);
+    freeaddrinfo(info);
+    *details = &result;
+    return NULL;
+}
+
+void set_app_poll_period(int period) {
+    g_app_state.app_poll_period = period;
+}
+
+void app_poll_wakeup() {
+    host_poll_wakeups++;
+}
+
+void g_hourglass_on() {}
+void g_hourglass_off() {}
+void g_hourglass_percentage(int percent) {}
+
+void show_alert_error(const char *message) {
+    fprintf(stderr, "alert: %s\n", message);
+}
+
+void show_alert_info(const char *message) {
+    fprintf(stderr, "info: %s\n", message);
+}
+
+void show_alert_info(const char *message, const char *title) {
+    fprintf(stderr, "info: %s: %s\n", title, message);
+}
+
+std::string lookup_token(const char *t) {
+    return t;
+}
+
+std::string to_string(int num) {
+    return std::to_string(num);
+}
+
+std::string to_string(long num) {
+    return std::to_string(num);
+}
+
+#if __SIZEOF_LONG__ != 8
+std::string to_string(int64_t num) {
+    return std::to_string((long long) num);
+}
+#endif
+
+int string_to_int(std::string s) {
+    int res = 0;
+    sscanf(s.c_str(), "%d", &res);
+    return res;
+}
+
+size_t split(const std::string &txt, std::vector<std::string> &strs, char ch) {
+    size_t pos = txt.find(ch);
+    size_t initial_pos = 0;
+    strs.clear();
+    while (pos != std::string::npos) {
+        strs.push_back(txt.substr(initial_pos, pos - initial_pos));
+        initial_pos = pos + 1;
+        pos = txt.find(ch, initial_pos);
+    }
+    strs.push_back(txt.substr(initial_pos, std::min(pos, txt.size()) - initial_pos + 1));
+    return strs.size();
+}
+
+std::string str_join(const std::vector<std::string>& vec, const char *delim) {
+    std::string result;
+    for (size_t i = 0; i < vec.size(); i++) {
+        if (i != 0) {
+            result.append(delim);
+        }
+        result.append(vec[i]);
+    }
+    return result;
+}
+
+time_t str_to_timet(const char* str) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf(str, "%d-%d-%dT%d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) < 6) {
+        return 0;
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    return timegm(&tm);
+}
+
+bool is_file_exist(const std::string& name) {
+    struct stat buffer;
+    return stat(name.c_str(), &buffer) == 0;
+}
+
+bool is_directory_exist(const std::string& name) {
+    struct stat buffer;
+    return stat(name.c_str(), &buffer) == 0 && S_ISDIR(buffer.st_mode);
+}
+
+long get_filesize(const char *filename) {
+    struct stat buffer;
+    return stat(filename, &buffer) == 0 ? buffer.st_size : -1;
+}
+
+// RISC OS separator is '.', host one is '/'
+void create_directories_for_file(const std::string& file_name) {
+    for (size_t i = 1; i < file_name.size(); i++) {
+        if (file_name[i] == '/') {
+            mkdir(file_name.substr(0, i).c_str(), 0777);
+        }
+    }
+}
+
+std::string get_file_contents(const char *filename) {
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        throw_exception(std::string("Error open/create file. ") + strerror(errno));
+    }
+    std::string contents;
+    fseek(fp, 0, SEEK_END);
+    contents.resize(ftell(fp));
+    rewind(fp);
+    if (fread(&contents[0], 1, contents.size(), fp) != contents.size()) {
+        contents.clear();
+    }
+    fclose(fp);
+    return contents;
+}
+
+void copy_file(const char *from, const char *to) {
+    std::string contents = get_file_contents(from);
+    FILE *fp = fopen(to, "wb");
+    if (!fp) {
+        throw_exception(std::string("Error open/create file ") + to + " " + strerror(errno));
+    }
+    fwrite(contents.data(), 1, contents.size(), fp);
+    fclose(fp);
+}
+
+std::string file_basename_append_ext(const std::string& file_full_path) {
+    size_t slash = file_full_path.rfind('/');
+    return slash == std::string::npos ? file_full_path : file_full_path.substr(slash + 1);
+}
+
+std::string file_basename(const std::string& file_full_path) {
+    return file_basename_append_ext(file_full_path);
+}
+
+std::string& ltrim(std::string& str, const std::string& chars) {
+    str.erase(0, str.find_first_not_of(chars));
+    return str;
+}
+
+std::string& rtrim(std::string& str, const std::string& chars) {
+    str.erase(str.find_last_not_of(chars) + 1);
+    return str;
+}
+
+std::string& trim(std::string& str, const std::string& chars) {
+    return ltrim(rtrim(str, chars), chars);
+}
+
+std::string trim_prefix(const std::string& s, const std::string& prefix) {
+    return s.find(prefix) == 0 ? s.substr(prefix.length()) : s;
+}
+
+std::string str_replace_all(std::string str, const std::string& from, const std::string& to) {
+    size_t start_pos = 0;
+    while ((start_pos = str.find(from, start_pos)) != std::string::npos) {
+        str.replace(start_pos, from.length(), to);
+        start_pos += to.length();
+    }
+    return str;
+}
+
+std::string str_hash_hex(const std::string& s) {
+    unsigned int h = 2166136261u;
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 16777619u;
+    }
+    char buf[9];
+    snprintf(buf, sizeof(buf), "%08x", h);
+    return std::string(buf);
+}
+
+std::string utf8_casefold_key(const std::string& s) {
+    std::string key;
+    key.reserve(s.size());
+    char buf[4];
+    utf8_int32_t cp;
+    const void *p = utf8codepoint(s.c_str(), &cp);
+    while (cp != 0) {
+        cp = utf8lwrcodepoint(cp);
+        size_t size = utf8codepointsize(cp);
+        utf8catcodepoint(buf, cp, size);
+        key.append(buf, size);
+        p = utf8codepoint(p, &cp);
+    }
+    return key;
+}
+
+bool gzip_compress(const char* data, size_t size, std::string& out) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    out.resize(deflateBound(&zs, size) + 32);
+    zs.next_in = (Bytef *) data;
+    zs.avail_in = size;
+    zs.next_out = (Bytef *) &out[0];
+    zs.avail_out = out.size();
+    int ret = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
+
+// byte offset of codepoint idx, str.size() if string is shorter
+static size_t _utf8_offset(const std::string& str, size_t idx) {
+    size_t pos = 0;
+    while (idx > 0 && pos < str.size()) {
+        pos++;
+        while (pos < str.size() && ((unsigned char) str[pos] & 0xC0) == 0x80) {
+            pos++;
+        }
+        idx--;
+    }
+    return pos;
+}
+
+unsigned int utf8_len_bytes_substr(const std::string& str, unsigned int start, unsigned int leng) {
+    size_t from = _utf8_offset(str, start);
+    return leng == (unsigned int) std::string::npos ? str.size() - from : _utf8_offset(str, start + leng) - from;
+}
+
+std::string utf8_substr(const std::string& str, unsigned int start, unsigned int leng) {
+    return str.substr(_utf8_offset(str, start), utf8_len_bytes_substr(str, start, leng));
+}
+
+static int _remove_entry(const char *path, const struct stat *sb, int flag, struct FTW *ftwbuf) {
+    return remove(path);
+}
+
+void remove_recursive(const std::string& src) {
+    nftw(src.c_str(), _remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+std::string host_make_temp_dir(const char* name) {
+    char path[256];
+    snprintf(path, sizeof(path), "/tmp/%s.XXXXXX", name);
+    if (!mkdtemp(path)) {
+        perror("mkdtemp");
+        exit(1);
+    }
+    return path;
+}
+
+double host_now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+long host_peak_rss_kb() {
+    FILE *f = fopen("/proc/self/status", "r");
+    long kb = -1;
+    char line[256];
+    while (f && fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "VmHWM:", 6) == 0) {
+            kb = atol(line + 6);
+        }
+    }
+    if (f) {
+        fclose(f);
+    }
+    return kb;
+}
+
+void host_reset_peak_rss() {
+    // writing 5 to clear_refs resets VmHWM to current RSS
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+    if (f) {
+        fputs("5", f);
+        fclose(f);
+    }
+}
@@ -0,0 +1,17 @@
+//
+// Helpers of host tests and benchmarks, see host_riscos.cpp
+//
+#ifndef HOST_RISCOS_H
+#define HOST_RISCOS_H
+
+#include <string>
+
+extern unsigned long host_poll_wakeups;        // app_poll_wakeup() calls
+
+void host_set_fake_time(long long cs);          // os_read_monotonic_time() returns it, -1 - real clock again
+std::string host_make_temp_dir(const char* name);
+double host_now_ms();
+long host_peak_rss_kb();                        // VmHWM
+void host_reset_peak_rss();
+
+#endif
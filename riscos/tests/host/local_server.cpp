@@ -0,0 +1,176 @@
+//
+// Minimal HTTP/1.1 server for host tests, see local_server.h
+//
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include "local_server.h"
+
+static const char* status_text(int code) {
+    switch (code) {
+        case 200: return "OK";
+        case 206: return "Partial Content";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 416: return "Range Not Satisfiable";
+        case 429: return "Too Many Requests";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+        default: return "Status";
+    }
+}
+
+bool LocalConnection::write(const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = ::send(_fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+bool LocalConnection::send_headers(int code, const std::string& extra_headers) {
+    char status[100];
+    snprintf(status, sizeof(status), "HTTP/1.1 %d %s\r\n", code, status_text(code));
+    return write(std::string(status) + extra_headers + "Connection: close\r\n\r\n");
+}
+
+bool LocalConnection::send_response(int code, const std::string& body, const std::string& content_type) {
+    char headers[200];
+    snprintf(headers, sizeof(headers), "Content-Type: %s\r\nContent-Length: %lu\r\n", content_type.c_str(), (unsigned long) body.size());
+    return send_headers(code, headers) && write(body);
+}
+
+bool LocalServer::start(int port) {
+    _listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(_listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(_listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(_listen_fd, 64) != 0) {
+        perror("LocalServer bind");
+        close(_listen_fd);
+        _listen_fd = -1;
+        return false;
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(_listen_fd, (struct sockaddr *) &addr, &len);
+    _port = ntohs(addr.sin_port);
+    _stopping = false;
+    _accept_thread = std::thread([this]() { _accept_loop(); });
+    return true;
+}
+
+void LocalServer::stop() {
+    if (_listen_fd < 0) {
+        return;
+    }
+    _stopping = true;
+    shutdown(_listen_fd, SHUT_RDWR);
+    _accept_thread.join();
+    close(_listen_fd);
+    _listen_fd = -1;
+    for (auto &t : _connection_threads) {
+        t.join();
+    }
+    _connection_threads.clear();
+}
+
+std::string LocalServer::base_url() {
+    return "http://127.0.0.1:" + std::to_string(_port) + "/";
+}
+
+unsigned long LocalServer::hits(const std::string& path_prefix) {
+    std::lock_guard<std::mutex> guard(_lock);
+    unsigned long count = 0;
+    for (auto &item : _hits) {
+        if (item.first.compare(0, path_prefix.size(), path_prefix) == 0) {
+            count += item.second;
+        }
+    }
+    return count;
+}
+
+unsigned long LocalServer::total_hits() {
+    return hits("");
+}
+
+void LocalServer::_accept_loop() {
+    while (!_stopping) {
+        struct pollfd pfd = {_listen_fd, POLLIN, 0};
+        if (poll(&pfd, 1, 50) <= 0) {
+            continue;
+        }
+        int fd = accept(_listen_fd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        std::lock_guard<std::mutex> guard(_lock);
+        _connection_threads.emplace_back([this, fd]() { _serve(fd); });
+    }
+}
+
+void LocalServer::_serve(int fd) {
+    std::string data;
+    char buf[4096];
+    size_t header_end;
+    while ((header_end = data.find("\r\n\r\n")) == std::string::npos) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            close(fd);
+            return;
+        }
+        data.append(buf, n);
+    }
+    LocalRequest req;
+    size_t line_end = data.find("\r\n");
+    std::string request_line = data.substr(0, line_end);
+    size_t sp1 = request_line.find(' '), sp2 = request_line.rfind(' ');
+    req.method = request_line.substr(0, sp1);
+    req.path = request_line.substr(sp1 + 1, sp2 - sp1 - 1);
+    size_t pos = line_end + 2;
+    while (pos < header_end) {
+        size_t eol = data.find("\r\n", pos);
+        std::string line = data.substr(pos, eol - pos);
+        size_t colon = line.find(':');
+        if (colon != std::string::npos) {
+            std::string name = line.substr(0, colon);
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+            size_t value_start = line.find_first_not_of(' ', colon + 1);
+            req.headers[name] = value_start == std::string::npos ? "" : line.substr(value_start);
+        }
+        pos = eol + 2;
+    }
+    req.body = data.substr(header_end + 4);
+    size_t content_length = req.headers.count("content-length") ? strtoul(req.headers["content-length"].c_str(), NULL, 10) : 0;
+    while (req.body.size() < content_length) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            break;
+        }
+        req.body.append(buf, n);
+    }
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _hits[req.path]++;
+    }
+    LocalConnection conn(fd, _stopping);
+    _handler(conn, req);
+    shutdown(fd, SHUT_WR);
+    close(fd);
+}
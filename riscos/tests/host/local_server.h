@@ -0,0 +1,60 @@
+//
+// Minimal HTTP/1.1 server on 127.0.0.1 for host tests, stand-in of the API server.
+// Every connection gets own thread, handler writes the whole response and connection is closed.
+//
+#ifndef HOST_LOCAL_SERVER_H
+#define HOST_LOCAL_SERVER_H
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <functional>
+
+struct LocalRequest {
+    std::string method;
+    std::string path;           // with query string
+    std::map<std::string, std::string> headers; // names lowered
+    std::string body;
+};
+
+class LocalConnection {
+private:
+    int _fd;
+    std::atomic<bool>& _stopping;
+public:
+    LocalConnection(int fd, std::atomic<bool>& stopping) : _fd(fd), _stopping(stopping) {};
+    bool write(const std::string& data);    // false when client went away
+    bool send_response(int code, const std::string& body, const std::string& content_type = "application/json");
+    bool send_headers(int code, const std::string& extra_headers); // for bodies written piece by piece
+    bool stopping() { return _stopping; }
+};
+
+typedef std::function<void(LocalConnection& conn, const LocalRequest& req)> LocalHandlerType;
+
+class LocalServer {
+private:
+    int _listen_fd = -1;
+    int _port = 0;
+    std::atomic<bool> _stopping{false};
+    std::thread _accept_thread;
+    std::vector<std::thread> _connection_threads;
+    std::mutex _lock;
+    std::map<std::string, unsigned long> _hits;
+    LocalHandlerType _handler;
+    void _accept_loop();
+    void _serve(int fd);
+public:
+    LocalServer(LocalHandlerType handler) : _handler(handler) {};
+    ~LocalServer() { stop(); }
+    bool start(int port = 0);   // 0 - any free port
+    void stop();                // listening socket is closed, next connects are refused
+    int get_port() { return _port; }
+    std::string base_url();     // http://127.0.0.1:port/
+    unsigned long hits(const std::string& path_prefix);
+    unsigned long total_hits();
+};
+
+#endif
@@ -0,0 +1,6 @@
+// Host stand-in of OSLib Systypes.h
+#ifndef HOST_OSLIB_SYSTYPES_H
+#define HOST_OSLIB_SYSTYPES_H
+typedef struct os_error _kernel_oserror;
+#include "os.h"
+#endif
@@ -0,0 +1 @@
+// Host stand-in of OSLib Toolboxtypes.h
@@ -0,0 +1 @@
+// Host stand-in of OSLib hourglass.h, hourglass calls are no-ops on host
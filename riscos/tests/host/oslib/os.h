@@ -0,0 +1,20 @@
+//
+// Host stand-in of OSLib os.h, only what the service and model code uses
+//
+#ifndef HOST_OSLIB_OS_H
+#define HOST_OSLIB_OS_H
+
+#include <stdint.h>
+
+typedef unsigned int os_t;      // monotonic time in centiseconds
+typedef unsigned int bits;
+typedef unsigned char byte;
+
+struct os_error {
+    int errnum;
+    char errmess[252];
+};
+
+os_t os_read_monotonic_time();
+
+#endif
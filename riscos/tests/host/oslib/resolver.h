@@ -0,0 +1,19 @@
+//
+// Host stand-in of OSLib resolver.h, looked up by getaddrinfo
+//
+#ifndef HOST_OSLIB_RESOLVER_H
+#define HOST_OSLIB_RESOLVER_H
+
+#include "os.h"
+
+struct resolver_host_details {
+    char *name;
+    char **aliases;
+    int addrtype;
+    int length;
+    byte **addresses;
+};
+
+os_error* xresolver_get_host(const char* host_name, int* err, resolver_host_details** details);
+
+#endif
@@ -0,0 +1,5 @@
+// Host stand-in of OSLib toolbox.h
+#ifndef HOST_OSLIB_TOOLBOX_H
+#define HOST_OSLIB_TOOLBOX_H
+typedef int ObjectId;
+#endif
@@ -0,0 +1 @@
+// Host stand-in of tbx hourglass.h
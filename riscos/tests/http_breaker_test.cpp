@@ -0,0 +1,131 @@
+//
+// Host test of CLHTTPService offline detection against a failing stand-in server:
+// only the API server being unreachable turns the service offline, failures of other hosts and
+// errors on an established connection stay with the request, error text set by request is kept.
+//
+// Build and run: see CMakeLists.txt, ./http_breaker_test
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <cloverleaf/Logger.h>
+#include "CLHTTPService_v2.h"
+#include "IKConfig.h"
+#include "host/host_riscos.h"
+#include "host/local_server.h"
+
+#define REQUEST_TIMEOUT_MS 10000
+
+static void check(bool cond, const char* what) {
+    if (!cond) {
+        fprintf(stderr, "check failed: %s\n", what);
+        abort();
+    }
+    printf("ok: %s\n", what);
+}
+
+static void serve(LocalConnection& conn, const LocalRequest& req) {
+    if (req.path == "/en/api/stall") {
+        // headers then nothing, as a stalled upload chunk response
+        conn.send_headers(200, "Content-Length: 100\r\n");
+        for (int i = 0; i < 300 && !conn.stopping(); i++) {
+            usleep(10000);
+        }
+    } else {
+        conn.send_response(200, "{\"status\":\"ok\"}");
+    }
+}
+
+// request is deleted by service when finished, outcome is copied out before that
+struct Outcome {
+    bool done = false;
+    bool failed = false;
+    std::string text;
+};
+
+class TestRequest : public CLHTTPRequest {
+public:
+    Outcome *outcome;
+    std::string reject_body;    // set error_text and fail the write
+    TestRequest(const std::string& url, Outcome* an_outcome) : CLHTTPRequest("GET", url), outcome(an_outcome) {
+        retry_policy.max_attempts = 1;
+    }
+    unsigned long on_append_content(char* c, unsigned long size) override {
+        if (!reject_body.empty()) {
+            error_text = reject_body;
+            return 0;
+        }
+        return CLHTTPRequest::on_append_content(c, size);
+    }
+    void on_fail() override {
+        outcome->failed = true;
+        outcome->text = response_text;
+    }
+    void on_finally() override {
+        outcome->done = true;
+    }
+};
+
+static void run_until_done(CLHTTPService& service, Outcome& outcome) {
+    double end = host_now_ms() + REQUEST_TIMEOUT_MS;
+    while (!outcome.done && host_now_ms() < end) {
+        service.process();
+        usleep(10000);
+    }
+}
+
+int main() {
+    std::string dir = host_make_temp_dir("http_breaker_test");
+    if (chdir(dir.c_str()) != 0) {
+        return 1;
+    }
+    Logger::init("/dev/null");
+    IKConfig::start(dir + "/config.ini");
+    LocalServer server(serve);
+    LocalServer media(serve);
+    check(server.start() && media.start(), "servers started");
+    std::string refused_url = media.base_url() + "media/1.png";
+    media.stop();
+
+    CLHTTPService service;
+    service.init(server.base_url(), "en", "test");
+    service.resolve_server_hostname(false);
+    check(service.is_online, "online after resolve");
+
+    Outcome api_ok;
+    service.submit(new TestRequest("/ok", &api_ok));
+    run_until_done(service, api_ok);
+    check(api_ok.done && !api_ok.failed && service.is_online, "api request succeeds");
+
+    Outcome media_refused;
+    service.submit(new TestRequest(refused_url, &media_refused));
+    run_until_done(service, media_refused);
+    check(media_refused.failed, "refused media fetch fails");
+    check(service.is_online, "refused media host does not turn service offline");
+
+    Outcome stalled;
+    TestRequest *stall = new TestRequest("/stall", &stalled);
+    stall->set_lowspeed_limit(1, 1000);
+    service.submit(stall);
+    run_until_done(service, stalled);
+    check(stalled.failed, "stalled transfer times out");
+    check(service.is_online, "timeout on connected transfer does not turn service offline");
+
+    Outcome rejected;
+    TestRequest *reject = new TestRequest("/ok", &rejected);
+    reject->reject_body = "Unexpected Content-Range in response";
+    service.submit(reject);
+    run_until_done(service, rejected);
+    check(rejected.failed && rejected.text == "Unexpected Content-Range in response", "error text of request is kept");
+    check(service.is_online, "local write error does not turn service offline");
+
+    server.stop();
+    Outcome api_refused;
+    service.submit(new TestRequest("/ok", &api_refused));
+    run_until_done(service, api_refused);
+    check(api_refused.failed, "request to stopped api server fails");
+    check(!service.is_online, "refused api server turns service offline");
+
+    remove_recursive(dir);
+    return 0;
+}
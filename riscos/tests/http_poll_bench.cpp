@@ -0,0 +1,178 @@
+//
+// Host benchmark of CLHTTPService poll modes: wakeups, curl calls, client CPU and event latency
+// with the event stream open, idle and under download load. Poll timer is emulated as main.cpp
+// runs it, server is LocalServer in other threads.
+//
+// Modes:
+//   fixed+perform   period fixed at 3 cs and curl_multi_perform every tick (before socket_action)
+//   planned+perform period from next_process_delay_cs, curl_multi_perform (socket_action=0)
+//   planned+socket  period from next_process_delay_cs, curl_multi_socket_action (default)
+//
+// Build and run: see CMakeLists.txt, ./http_poll_bench [seconds per run]
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+#include <atomic>
+#include <cloverleaf/Logger.h>
+#include "CLHTTPService_v2.h"
+#include "IKConfig.h"
+#include "PollScheduler.h"
+#include "host/host_riscos.h"
+#include "host/local_server.h"
+
+#define EVENT_INTERVAL_MS_IDLE  500
+#define EVENT_INTERVAL_MS_LOAD  100
+#define DOWNLOADS_RUNNING       4
+#define DOWNLOAD_BYTES          (256 * 1024)
+#define DOWNLOAD_PIECE          4096
+#define DOWNLOAD_PIECE_MS       5
+
+static std::atomic<int> event_interval_ms{EVENT_INTERVAL_MS_IDLE};
+
+static void serve(LocalConnection& conn, const LocalRequest& req) {
+    if (req.path.compare(0, 5, "/ev/m") == 0) {
+        conn.send_headers(200, "Content-Type: text/event-stream\r\nCache-Control: no-cache\r\n");
+        for (int id = 1; !conn.stopping(); id++) {
+            usleep(event_interval_ms * 1000);
+            char event[200];
+            snprintf(event, sizeof(event), "data: {\"id\":%d,\"time\":\"2026-10-16T10:00:00Z\",\"text\":{\"sent_ms\":\"%.3f\"}}\n\n",
+                     id, host_now_ms());
+            if (!conn.write(event)) {
+                return;
+            }
+        }
+    } else if (req.path.compare(0, 9, "/download") == 0) {
+        conn.send_headers(200, "Content-Type: application/octet-stream\r\nContent-Length: " + std::to_string(DOWNLOAD_BYTES) + "\r\n");
+        std::string piece(DOWNLOAD_PIECE, 'x');
+        for (int sent = 0; sent < DOWNLOAD_BYTES && !conn.stopping(); sent += DOWNLOAD_PIECE) {
+            if (!conn.write(piece)) {
+                return;
+            }
+            usleep(DOWNLOAD_PIECE_MS * 1000);
+        }
+    } else {
+        conn.send_response(404, "{}");
+    }
+}
+
+struct RunResult {
+    unsigned long ticks = 0;
+    unsigned long idle = 0;
+    unsigned long curl_calls = 0;
+    double cpu_ms = 0;
+    unsigned long downloads = 0;
+    unsigned long long download_bytes = 0;
+    std::vector<double> latencies_ms;
+};
+
+class BenchDownload : public CLHTTPRequest {
+public:
+    RunResult *result;
+    BenchDownload(const std::string& url, RunResult* a_result) : CLHTTPRequest("GET", url), result(a_result) {
+        set_priority(HTTP_PRIORITY_BACKGROUND);
+        timing_class = HTTP_TIMING_DOWNLOAD;
+    }
+    unsigned long on_append_content(char* c, unsigned long size) override {
+        result->download_bytes += size;
+        return size;
+    }
+    void on_success() override {
+        result->downloads++;
+    }
+};
+
+static double thread_cpu_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static RunResult run(const std::string& base_url, bool socket_action, bool fixed_period, bool load, int seconds) {
+    RunResult result;
+    IKConfig::set_value("network", "socket_action", socket_action ? 1 : 0);
+    event_interval_ms = load ? EVENT_INTERVAL_MS_LOAD : EVENT_INTERVAL_MS_IDLE;
+
+    CLHTTPService *service = new CLHTTPService();
+    service->init(base_url, "en", "bench");
+    service->set_events_handler([&result](const cJSON* text) {
+        const cJSON *sent = cJSON_GetObjectItemCaseSensitive(text, "sent_ms");
+        if (sent && cJSON_IsString(sent)) {
+            result.latencies_ms.push_back(host_now_ms() - atof(sent->valuestring));
+        }
+    });
+    service->resolve_server_hostname(false);
+    service->start_event_stream("1", "");
+
+    int period = POLL_LISTEN_CS;
+    PollScheduler scheduler([&period](int p) { period = p; });
+    int download_seq = 0;
+    double end = host_now_ms() + seconds * 1000.0;
+    while (host_now_ms() < end) {
+        usleep((fixed_period ? 3 : period) * 10000);
+        if (load) {
+            while (service->get_priority_stats(HTTP_PRIORITY_BACKGROUND).running +
+                   service->get_priority_stats(HTTP_PRIORITY_BACKGROUND).queued < DOWNLOADS_RUNNING) {
+                service->submit(new BenchDownload(base_url + "download/" + std::to_string(download_seq++), &result));
+            }
+        }
+        scheduler.tick_started();
+        double cpu = thread_cpu_ms();
+        service->process();
+        scheduler.begin(POLL_LISTEN_CS);
+        scheduler.offer(service->next_process_delay_cs(POLL_LISTEN_CS), POLL_REASON_HTTP);
+        scheduler.commit();
+        result.cpu_ms += thread_cpu_ms() - cpu;
+    }
+    const CLHTTPServiceCounters &counters = service->get_counters();
+    result.ticks = counters.process_calls;
+    result.idle = counters.idle_calls;
+    result.curl_calls = counters.perform_calls + counters.socket_actions + counters.timer_actions;
+    service->stop_event_stream();
+    delete service;
+    return result;
+}
+
+static void report(const char* name, const RunResult& r, int seconds) {
+    std::vector<double> lat = r.latencies_ms;
+    std::sort(lat.begin(), lat.end());
+    double avg = 0;
+    for (double l : lat) {
+        avg += l;
+    }
+    avg = lat.empty() ? 0 : avg / lat.size();
+    printf("  %-16s ticks/s:%6.1f idle_ticks:%5lu curl_calls:%6lu cpu_ms:%7.1f events:%4lu latency_ms avg:%5.1f p95:%5.1f max:%5.1f",
+           name, (double) r.ticks / seconds, r.idle, r.curl_calls, r.cpu_ms, (unsigned long) lat.size(), avg,
+           lat.empty() ? 0 : lat[lat.size() * 95 / 100], lat.empty() ? 0 : lat.back());
+    if (r.downloads || r.download_bytes) {
+        printf(" downloads:%lu KB/s:%.0f", r.downloads, r.download_bytes / 1024.0 / seconds);
+    }
+    printf("\n");
+}
+
+int main(int argc, char** argv) {
+    int seconds = argc > 1 ? atoi(argv[1]) : 5;
+    std::string dir = host_make_temp_dir("http_poll_bench");
+    if (chdir(dir.c_str()) != 0) {
+        return 1;
+    }
+    Logger::init("/dev/null");
+    IKConfig::start(dir + "/config.ini");
+    LocalServer server(serve);
+    if (!server.start()) {
+        return 1;
+    }
+    const bool loads[] = {false, true};
+    for (bool load : loads) {
+        printf("%s, %d s per mode:\n", load ? "event stream + 4 downloads" : "event stream idle", seconds);
+        report("fixed+perform", run(server.base_url(), false, true, load, seconds), seconds);
+        report("planned+perform", run(server.base_url(), false, false, load, seconds), seconds);
+        report("planned+socket", run(server.base_url(), true, false, load, seconds), seconds);
+    }
+    server.stop();
+    remove_recursive(dir);
+    return 0;
+}
@@ -0,0 +1,124 @@
+//
+// Host test of CLHTTPService bandwidth shaping with foreground, background and bulk downloads
+// running together from a local server: caps of shaped classes must add up to no more than the
+// shaped budget, and a class is not given more transfers than its budget can carry at floor rate.
+//
+// Build and run: see CMakeLists.txt, ./http_shaping_test
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <cloverleaf/Logger.h>
+#include "CLHTTPService_v2.h"
+#include "IKConfig.h"
+#include "host/host_riscos.h"
+#include "host/local_server.h"
+
+#define DOWNLOAD_BYTES  (8 * 1024 * 1024)
+#define RESERVE_PCT     25
+
+static void check(bool cond, const char* what) {
+    if (!cond) {
+        fprintf(stderr, "check failed: %s\n", what);
+        abort();
+    }
+    printf("ok: %s\n", what);
+    fflush(stdout);
+}
+
+static void serve(LocalConnection& conn, const LocalRequest& req) {
+    conn.send_headers(200, "Content-Type: application/octet-stream\r\nContent-Length: " + std::to_string(DOWNLOAD_BYTES) + "\r\n");
+    // 80 KB/s per connection (4 KB/s for /slow/), link estimate then follows served traffic instead of loopback speed
+    std::string piece(req.path.compare(0, 6, "/slow/") == 0 ? 100 : 2048, 'x');
+    for (int sent = 0; sent < DOWNLOAD_BYTES && !conn.stopping(); sent += piece.size()) {
+        if (!conn.write(piece)) {
+            return;
+        }
+        usleep(25000);
+    }
+}
+
+class Download : public CLHTTPRequest {
+public:
+    Download(const std::string& url, int a_priority) : CLHTTPRequest("GET", url) {
+        set_priority(a_priority);
+        timing_class = HTTP_TIMING_DOWNLOAD;
+    }
+    unsigned long on_append_content(char* c, unsigned long size) override {
+        return size;
+    }
+};
+
+static void run_for(CLHTTPService& service, int ms) {
+    double end = host_now_ms() + ms;
+    while (host_now_ms() < end) {
+        service.process();
+        usleep(10000);
+    }
+}
+
+static void submit(CLHTTPService& service, const std::string& base_url, int priority, int count) {
+    static int seq = 0;
+    for (int i = 0; i < count; i++) {
+        service.submit(new Download(base_url + std::to_string(seq++), priority));
+    }
+}
+
+static unsigned long shaped_caps_total(CLHTTPService& service, int dir) {
+    const CLHTTPShapingStats &sh = service.get_shaping_stats(dir);
+    unsigned long total = 0;
+    for (int priority = 0; priority < HTTP_PRIORITY_CLASSES; priority++) {
+        total += sh.cap[priority] * service.get_priority_stats(priority).running;
+    }
+    return total;
+}
+
+int main() {
+    std::string dir = host_make_temp_dir("http_shaping_test");
+    if (chdir(dir.c_str()) != 0) {
+        return 1;
+    }
+    Logger::init("/dev/null");
+    IKConfig::start(dir + "/config.ini");
+    IKConfig::set_value("network", "shaping_reserve_pct", RESERVE_PCT);
+    LocalServer server(serve);
+    check(server.start(), "server started");
+
+    {
+        IKConfig::set_value("network", "shaping_recv_rate", 65536);
+        CLHTTPService service;
+        service.init(server.base_url(), "en", "test");
+        service.resolve_server_hostname(false);
+        submit(service, server.base_url() + "dl/", HTTP_PRIORITY_FOREGROUND_MEDIA, 2);
+        submit(service, server.base_url() + "dl/", HTTP_PRIORITY_BACKGROUND, 3);
+        submit(service, server.base_url() + "dl/", HTTP_PRIORITY_BULK, 1);
+        run_for(service, 2500);
+        check(service.get_priority_stats(HTTP_PRIORITY_FOREGROUND_MEDIA).running == 2 &&
+              service.get_priority_stats(HTTP_PRIORITY_BACKGROUND).running == 3 &&
+              service.get_priority_stats(HTTP_PRIORITY_BULK).running == 1, "all classes running");
+        const CLHTTPShapingStats &sh = service.get_shaping_stats(HTTP_SHAPING_RECV);
+        unsigned long budget = sh.link_rate / 100 * (100 - RESERVE_PCT);
+        printf("link_rate:%lu budget:%lu caps fg:%lu bg:%lu bulk:%lu total:%lu last_shaped_rate:%lu\n", sh.link_rate, budget,
+               sh.cap[HTTP_PRIORITY_FOREGROUND_MEDIA], sh.cap[HTTP_PRIORITY_BACKGROUND], sh.cap[HTTP_PRIORITY_BULK],
+               shaped_caps_total(service, HTTP_SHAPING_RECV), sh.last_shaped_rate);
+        check(shaped_caps_total(service, HTTP_SHAPING_RECV) <= budget, "caps of running transfers add up to at most budget");
+        check(sh.cap[HTTP_PRIORITY_FOREGROUND_MEDIA] > sh.cap[HTTP_PRIORITY_BACKGROUND], "foreground gets more than background");
+    }
+    {
+        // 6144 bytes/s budget or less on slow link, background weight with foreground running
+        // leaves less than floor rate for two
+        IKConfig::set_value("network", "shaping_recv_rate", 8192);
+        CLHTTPService service;
+        service.init(server.base_url(), "en", "test");
+        service.resolve_server_hostname(false);
+        submit(service, server.base_url() + "slow/", HTTP_PRIORITY_FOREGROUND_MEDIA, 1);
+        run_for(service, 200);
+        submit(service, server.base_url() + "slow/", HTTP_PRIORITY_BACKGROUND, 3);
+        run_for(service, 1500);
+        check(service.get_priority_stats(HTTP_PRIORITY_BACKGROUND).running == 1, "background held to what its budget carries at floor rate");
+        check(service.get_priority_stats(HTTP_PRIORITY_BACKGROUND).queued == 2, "rest of background stays queued");
+    }
+    server.stop();
+    remove_recursive(dir);
+    return 0;
+}
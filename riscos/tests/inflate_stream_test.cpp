@@ -0,0 +1,75 @@
+//
+// Host test of CLInflateStream: gzip, zlib "deflate" and raw "deflate" bodies fed in chunks
+// of many sizes, including first chunks bigger than INFLATE_STREAM_BUFFER_SIZE, must all
+// decode to the original data.
+//
+// Build and run: see CMakeLists.txt, ./inflate_stream_test
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <zlib.h>
+#include "CLInflateStream.h"
+
+static void check(bool cond, const char* what) {
+    if (!cond) {
+        fprintf(stderr, "check failed: %s\n", what);
+        abort();
+    }
+}
+
+// window_bits as for deflateInit2: 15 + 16 gzip, 15 zlib, -15 raw
+static std::string compress(const std::string& data, int window_bits) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    check(deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) == Z_OK, "deflateInit2");
+    std::string out(deflateBound(&zs, data.size()) + 32, '\0');
+    zs.next_in = (Bytef *) data.data();
+    zs.avail_in = data.size();
+    zs.next_out = (Bytef *) &out[0];
+    zs.avail_out = out.size();
+    check(deflate(&zs, Z_FINISH) == Z_STREAM_END, "deflate");
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return out;
+}
+
+int main() {
+    std::string data;
+    unsigned int state = 1;
+    while (data.size() < 200000) {
+        state = state * 1103515245 + 12345;
+        char word[32];
+        snprintf(word, sizeof(word), "w%u ", (state >> 16) % 5000);
+        data += word;
+    }
+    struct {
+        const char *encoding;
+        int window_bits;
+    } cases[] = {{"gzip", 15 + 16}, {"deflate", 15}, {"deflate", -15}};
+    const size_t chunk_sizes[] = {1, 2, 3, 7, 1000, 4096, 4097, 5000, 65536, 1 << 30};
+    int runs = 0;
+    for (auto &c : cases) {
+        std::string body = compress(data, c.window_bits);
+        for (size_t chunk : chunk_sizes) {
+            std::string out;
+            CLInflateStream stream([&out](const char* d, size_t size) { out.append(d, size); });
+            check(stream.start(c.encoding), "encoding supported");
+            for (size_t pos = 0; pos < body.size(); pos += chunk) {
+                check(stream.feed(body.data() + pos, std::min(chunk, body.size() - pos)), "chunk accepted");
+            }
+            if (out != data) {
+                fprintf(stderr, "%s window_bits:%d chunk:%lu decoded %lu of %lu bytes\n", c.encoding, c.window_bits,
+                        (unsigned long) chunk, (unsigned long) out.size(), (unsigned long) data.size());
+                check(false, "decoded data matches");
+            }
+            check(stream.get_bytes_in() == body.size(), "all input counted");
+            runs++;
+        }
+    }
+    CLInflateStream broken([](const char* d, size_t size) {});
+    check(broken.start("gzip") && !broken.feed("\x1f\x8b\x08\x00garbage garbage garbage", 27), "broken gzip rejected");
+    printf("%d runs ok\n", runs);
+    return 0;
+}
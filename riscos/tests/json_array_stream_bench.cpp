@@ -0,0 +1,162 @@
+//
+// Host benchmark of CLJsonArrayStream against buffering the body and cJSON_Parse:
+// peak memory while a large message list is received and time until the first item can be used.
+// Each mode runs in own child process so peak RSS of one does not hide the other.
+//
+// Build and run: see CMakeLists.txt, ./json_array_stream_bench [items] [link KB/s]
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <string>
+#include <cloverleaf/Logger.h>
+#include "CLJsonArrayStream.h"
+#include "host/host_riscos.h"
+
+#define CHUNK_SIZE 16384    // curl write callback size
+
+static void check(bool cond, const char* what) {
+    if (!cond) {
+        fprintf(stderr, "check failed: %s\n", what);
+        abort();
+    }
+}
+
+// response body produced piece by piece as it would arrive: {"messages":[...],"next":"..."}
+class BodyGenerator {
+private:
+    int _items;
+    int _next = 0;
+    std::string _pending;
+public:
+    unsigned long total = 0;
+    BodyGenerator(int items) : _items(items) {
+        _pending = "{\"messages\":[";
+    }
+    // false when whole body was returned
+    bool next_chunk(std::string& chunk) {
+        while (_pending.size() < CHUNK_SIZE && _next <= _items) {
+            if (_next == _items) {
+                _pending += "],\"next\":\"/chats/1/messages/?before=1\"}";
+            } else {
+                char item[600];
+                snprintf(item, sizeof(item), "%s{\"id\":%d,\"chat\":1,\"user\":{\"id\":%d,\"name\":\"User %d\"},"
+                         "\"text\":\"Message %d, lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor "
+                         "incididunt ut labore et dolore magna aliqua \\\"quoted\\\" [brackets] {braces}\","
+                         "\"time\":\"2026-10-16T10:%02d:%02dZ\",\"files\":[],\"reactions\":{}}",
+                         _next ? "," : "", 1000000 - _next, _next % 7, _next % 7, _next, (_next / 60) % 60, _next % 60);
+                _pending += item;
+            }
+            _next++;
+        }
+        if (_pending.empty()) {
+            return false;
+        }
+        size_t size = std::min(_pending.size(), (size_t) CHUNK_SIZE);
+        chunk.assign(_pending, 0, size);
+        _pending.erase(0, size);
+        total += size;
+        return true;
+    }
+};
+
+struct ModeResult {
+    long peak_kb;
+    unsigned long first_item_bytes;
+    double cpu_ms;
+    double first_item_cpu_ms;
+    int items;
+};
+
+static ModeResult run_stream(int items) {
+    ModeResult r = {0, 0, 0, 0, 0};
+    BodyGenerator body(items);
+    double start = host_now_ms();
+    CLJsonArrayStream stream("messages", [&](cJSON* item, int index) {
+        const cJSON *id = cJSON_GetObjectItemCaseSensitive(item, "id");
+        check(id && cJSON_IsInt(id) && id->valueint == 1000000 - index, "item in order");
+        if (index == 0) {
+            r.first_item_bytes = body.total;
+            r.first_item_cpu_ms = host_now_ms() - start;
+        }
+        r.items++;
+    });
+    std::string chunk;
+    while (body.next_chunk(chunk)) {
+        stream.feed(chunk.data(), chunk.size());
+    }
+    stream.finish();
+    r.cpu_ms = host_now_ms() - start;
+    cJSON *envelope = cJSON_Parse(stream.get_envelope().c_str());
+    check(envelope && cJSON_GetArraySize(cJSON_GetObjectItemCaseSensitive(envelope, "messages")) == 0, "envelope has empty array");
+    cJSON_Delete(envelope);
+    return r;
+}
+
+static ModeResult run_parse(int items) {
+    ModeResult r = {0, 0, 0, 0, 0};
+    BodyGenerator body(items);
+    double start = host_now_ms();
+    std::string response_text, chunk;
+    while (body.next_chunk(chunk)) {
+        response_text.append(chunk);
+    }
+    cJSON *json = cJSON_Parse(response_text.c_str());
+    const cJSON *messages = cJSON_GetObjectItemCaseSensitive(json, "messages");
+    const cJSON *item;
+    cJSON_ArrayForEach(item, messages) {
+        if (r.items == 0) {
+            r.first_item_bytes = body.total;
+            r.first_item_cpu_ms = host_now_ms() - start;
+        }
+        r.items++;
+    }
+    cJSON_Delete(json);
+    r.cpu_ms = host_now_ms() - start;
+    return r;
+}
+
+// child process does the run, result comes back through pipe
+static ModeResult run_isolated(bool stream, int items) {
+    int fds[2];
+    check(pipe(fds) == 0, "pipe");
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        host_reset_peak_rss();
+        long base_kb = host_peak_rss_kb();
+        ModeResult r = stream ? run_stream(items) : run_parse(items);
+        r.peak_kb = host_peak_rss_kb() - base_kb;
+        check(write(fds[1], &r, sizeof(r)) == sizeof(r), "write result");
+        _exit(0);
+    }
+    close(fds[1]);
+    ModeResult r;
+    check(read(fds[0], &r, sizeof(r)) == sizeof(r), "read result");
+    close(fds[0]);
+    waitpid(pid, NULL, 0);
+    check(r.items == items, "all items seen");
+    return r;
+}
+
+static void report(const char* name, const ModeResult& r, double link_kbs) {
+    double first_ms = r.first_item_bytes / 1024.0 / link_kbs * 1000 + r.first_item_cpu_ms;
+    printf("  %-14s peak +%6ld KB  cpu %7.1f ms  first item after %9lu bytes, %8.1f ms at %.0f KB/s\n",
+           name, r.peak_kb, r.cpu_ms, r.first_item_bytes, first_ms, link_kbs);
+}
+
+int main(int argc, char** argv) {
+    int items = argc > 1 ? atoi(argv[1]) : 20000;
+    double link_kbs = argc > 2 ? atof(argv[2]) : 500;
+    Logger::init("/dev/null");
+    BodyGenerator size_probe(items);
+    std::string chunk;
+    while (size_probe.next_chunk(chunk)) {
+    }
+    printf("%d messages, body %lu KB:\n", items, size_probe.total / 1024);
+    report("stream", run_isolated(true, items), link_kbs);
+    report("cJSON_Parse", run_isolated(false, items), link_kbs);
+    return 0;
+}
@@ -0,0 +1,94 @@
+//
+// Host benchmark of heap taken by loaded messages (malloc in-use bytes): all messages of a session
+// loaded, then half of them freed in random order as closed chats and deletes do, then all freed.
+// Messages are parsed from JSON as they come from server, some with attachment, reply, entities.
+//
+// Build and run: see CMakeLists.txt, ./message_memory_bench [messages]
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cloverleaf/Logger.h>
+#include "MessageData.h"
+#include "host/host_riscos.h"
+
+static void check(bool cond, const char* what) {
+    if (!cond) {
+        fprintf(stderr, "check failed: %s\n", what);
+        abort();
+    }
+}
+
+static size_t heap_in_use() {
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks;
+}
+
+static size_t heap_free() {
+    struct mallinfo2 mi = mallinfo2();
+    return mi.fordblks;
+}
+
+// 1 in 3 with photo, 1 in 10 reply, 1 in 5 with link entity
+static std::string message_json(int id) {
+    std::string json = "{\"id\":" + std::to_string(id) + ",\"type\":" + (id % 3 == 0 ? "3" : "1") +
+            ",\"flags\":0,\"author_id\":\"tg" + std::to_string(100000 + id % 17) + "\",\"sendtime\":" +
+            std::to_string(1700000000 + id * 30) + ",\"text\":\"Message " + std::to_string(id) +
+            std::string(20 + id * 37 % 200, 'x') + "\"";
+    if (id % 3 == 0) {
+        json += ",\"attachment_image\":{\"url\":\"https://files.example.com/photo/" + std::to_string(id) +
+                ".jpg\",\"thumb_url\":\"https://files.example.com/thumb/" + std::to_string(id) +
+                ".jpg\",\"size\":183000,\"thumb_width\":120,\"thumb_height\":90,\"width\":1280,\"height\":960}";
+    }
+    if (id % 10 == 0) {
+        json += ",\"reply_info\":{\"id\":" + std::to_string(id - 1) + ",\"type\":1,\"author_id\":\"tg100001\","
+                "\"text\":\"Earlier message quoted in reply\"}";
+    }
+    if (id % 5 == 0) {
+        json += ",\"entities\":[{\"t\":10,\"s\":0,\"l\":7,\"v\":\"\"},{\"t\":11,\"s\":8,\"l\":4,"
+                "\"v\":\"https://example.com/some/longer/link/target\"}]";
+    }
+    return json + "}";
+}
+
+int main(int argc, char** argv) {
+    int count = argc > 1 ? atoi(argv[1]) : 5000;
+    Logger::init("/dev/null");
+    std::vector<std::string> bodies;
+    for (int id = 1; id <= count; id++) {
+        bodies.push_back(message_json(id));
+    }
+    std::vector<MessageDataPtr> messages;
+    messages.reserve(count);
+    size_t base = heap_in_use();
+    size_t counted = 0;
+    for (auto &body : bodies) {
+        cJSON *json = cJSON_Parse(body.c_str());
+        check(json != NULL, "message json");
+        messages.push_back(make_message_data(json, nullptr));
+        cJSON_Delete(json);
+        counted += messages.back()->get_memory_size();
+    }
+    size_t loaded = heap_in_use() - base;
+
+    unsigned int state = 1;
+    for (size_t i = messages.size() - 1; i > 0; i--) {
+        state = state * 1103515245 + 12345;
+        std::swap(messages[i], messages[(state >> 8) % (i + 1)]);
+    }
+    messages.resize(count / 2);
+    size_t half = heap_in_use() - base;
+    size_t half_free = heap_free();
+    messages.clear();
+    size_t none = heap_in_use() - base;
+
+    printf("%d messages, get_memory_size %lu bytes/message:\n", count, (unsigned long) (counted / count));
+    printf("  loaded       in use %6lu KB  %5lu bytes/message\n", (unsigned long) loaded / 1024, (unsigned long) (loaded / count));
+    printf("  half freed   in use %6lu KB  %5lu bytes/message left, heap free %lu KB\n", (unsigned long) half / 1024,
+           (unsigned long) (half / (count - count / 2)), (unsigned long) half_free / 1024);
+    printf("  all freed    in use %6ld KB\n", (long) none / 1024);
+    return 0;
+}
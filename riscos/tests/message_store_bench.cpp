@@ -0,0 +1,157 @@
+//
+// Host benchmark of chat open to first paint: cold open downloads first page of messages from
+// local server with link latency and rate given, warm open reads them from MessageStore.
+// Also checks that update records of messages not in memory are merged on load and dropped
+// for messages the store does not have.
+//
+// Build and run: see CMakeLists.txt, ./message_store_bench [rtt ms] [link KB/s] [stored messages]
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <cloverleaf/Logger.h>
+#include "CLHTTPService_v2.h"
+#include "IKConfig.h"
+#include "ChatData.h"
+#include "MessageData.h"
+#include "MessageStore.h"
+#include "host/host_riscos.h"
+#include "host/local_server.h"
+
+#define PAGE_SIZE       50      // messages in first page sent by server
+#define PIECE_SIZE      1024
+#define CHAT_ID         "c1"
+
+static int g_rtt_ms = 150;
+static int g_link_kbs = 100;
+
+static void check(bool cond, const char* what) {
+    if (!cond) {
+        fprintf(stderr, "check failed: %s\n", what);
+        abort();
+    }
+}
+
+static std::string message_json(int id) {
+    char item[700];
+    snprintf(item, sizeof(item), "{\"id\":%d,\"chat_id\":\"" CHAT_ID "\",\"type\":1,\"flags\":0,\"author_id\":\"m%d\","
+             "\"sendtime\":%d,\"changedtime\":0,\"sending_state\":0,\"text\":\"Message %d, lorem ipsum dolor sit amet, "
+             "see https://example.com/page/%d for details\",\"entities\":[{\"t\":4,\"s\":46,\"l\":30,\"v\":\"\"}],"
+             "\"reply_info\":{\"id\":%d,\"title\":\"Message %d\",\"user_id\":\"m%d\",\"chat_id\":\"" CHAT_ID "\"}}",
+             id, id % 7, 1700000000 + id * 30, id, id, id - 1, id - 1, (id - 1) % 7);
+    return item;
+}
+
+static std::string page_body(int newest_id, int count) {
+    std::string body = "{\"items\":[";
+    for (int id = newest_id - count + 1; id <= newest_id; id++) {
+        body += message_json(id);
+        if (id < newest_id) {
+            body += ",";
+        }
+    }
+    return body + "],\"first\":1,\"next\":\"\",\"prev\":\"\"}";
+}
+
+// first page after round trip, written at link rate
+static void serve(LocalConnection& conn, const LocalRequest& req) {
+    std::string body = page_body(1000, PAGE_SIZE);
+    usleep(g_rtt_ms * 1000);
+    conn.send_headers(200, "Content-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) + "\r\n");
+    for (size_t pos = 0; pos < body.size() && !conn.stopping(); pos += PIECE_SIZE) {
+        if (!conn.write(body.substr(pos, PIECE_SIZE))) {
+            return;
+        }
+        usleep(PIECE_SIZE * 1000000LL / (g_link_kbs * 1024));
+    }
+}
+
+class PageRequest : public CLHTTPRequest {
+public:
+    bool *done;
+    PageRequest(const std::string& url, ChatDataPtr chat, bool* a_done) : CLHTTPRequest("GET", url), done(a_done) {
+        set_json_stream("items", [chat](cJSON* json, int index) {
+            chat->messages.insert(make_message_data(json, chat));
+        });
+    }
+    void on_finally() override {
+        *done = true;
+    }
+};
+
+static double open_cold(CLHTTPService& service, ChatDataPtr chat) {
+    bool done = false;
+    double start = host_now_ms();
+    service.submit(new PageRequest("/chat/" CHAT_ID "/messages/?first_load=1&open=1", chat, &done));
+    while (!done && host_now_ms() - start < 30000) {
+        service.process();
+        usleep(1000);
+    }
+    check(done, "page loaded");
+    return host_now_ms() - start;
+}
+
+static double open_warm(MessageStore& store, ChatDataPtr chat) {
+    double start = host_now_ms();
+    store.load(CHAT_ID, [chat](const cJSON* json) {
+        chat->messages.insert(make_message_data(json, chat));
+    });
+    return host_now_ms() - start;
+}
+
+int main(int argc, char** argv) {
+    g_rtt_ms = argc > 1 ? atoi(argv[1]) : g_rtt_ms;
+    g_link_kbs = argc > 2 ? atoi(argv[2]) : g_link_kbs;
+    int stored = argc > 3 ? atoi(argv[3]) : MESSAGE_STORE_MAX_MESSAGES;
+    std::string dir = host_make_temp_dir("message_store_bench");
+    if (chdir(dir.c_str()) != 0) {
+        return 1;
+    }
+    Logger::init("/dev/null");
+    IKConfig::start(dir + "/config.ini");
+    LocalServer server(serve);
+    check(server.start(), "server started");
+    CLHTTPService service;
+    service.init(server.base_url(), "en", "test");
+    service.resolve_server_hostname(false);
+
+    ChatDataPtr cold_chat = std::make_shared<ChatData>();
+    cold_chat->id = CHAT_ID;
+    double cold_ms = open_cold(service, cold_chat);
+    check(cold_chat->messages.size() == PAGE_SIZE, "cold open has first page");
+
+    // store filled as loaded pages and events fill it, then edits of stored and of unknown messages
+    MessageStore store;
+    store.open("u1");
+    cJSON *page = cJSON_Parse(page_body(1000, stored).c_str());
+    const cJSON *item;
+    cJSON_ArrayForEach(item, cJSON_GetObjectItemCaseSensitive(page, "items")) {
+        store.put(CHAT_ID, item);
+    }
+    cJSON_Delete(page);
+    cJSON *edit = cJSON_Parse("{\"id\":1000,\"text\":\"Edited while chat was closed\",\"changedtime\":1700040000}");
+    store.update(CHAT_ID, edit);
+    cJSON_ReplaceItemInObjectCaseSensitive(edit, "id", cJSON_CreateInt(5));
+    store.update(CHAT_ID, edit);
+    store.update("not_stored", edit);
+    cJSON_Delete(edit);
+    check(!store.has_chat("not_stored"), "update does not start store of chat");
+    store.flush();
+
+    ChatDataPtr warm_chat = std::make_shared<ChatData>();
+    warm_chat->id = CHAT_ID;
+    double warm_ms = open_warm(store, warm_chat);
+    size_t expected = stored < MESSAGE_STORE_MAX_MESSAGES ? stored : MESSAGE_STORE_MAX_MESSAGES;
+    check(warm_chat->messages.size() == expected, "warm open has stored messages");
+    check(warm_chat->messages.back()->text == "Edited while chat was closed", "update merged over stored message");
+    check(warm_chat->messages.back()->author_id == "m6", "fields not in update kept");
+    check(warm_chat->messages.find(5) == nullptr, "update of message not stored is dropped");
+
+    printf("chat open to first paint, rtt %d ms, link %d KB/s:\n", g_rtt_ms, g_link_kbs);
+    printf("  cold (server page of %d)   %8.1f ms\n", PAGE_SIZE, cold_ms);
+    printf("  warm (store, %u messages) %8.1f ms\n", (unsigned) warm_chat->messages.size(), warm_ms);
+    server.stop();
+    remove_recursive(dir);
+    return 0;
+}
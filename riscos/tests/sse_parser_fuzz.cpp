@@ -0,0 +1,157 @@
+//
+// Host fuzz and throughput harness of CLSSEParser, not part of RISC OS build
+//
+// libFuzzer:
+//   clang++ -std=c++11 -g -O1 -fsanitize=fuzzer,address -DSSE_LIBFUZZER -I../service sse_parser_fuzz.cpp ../service/CLSSEParser.cpp
+//   ./a.out
+// standalone, random streams then throughput:
+//   g++ -std=c++11 -g -O2 -fsanitize=address -I../service sse_parser_fuzz.cpp ../service/CLSSEParser.cpp
+//   ./a.out [iterations]
+//
+// Input is fed whole and then split at pseudo random points, both must give the same events.
+// A third pass resets the parser from inside the handler, as a stream restart does.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include "CLSSEParser.h"
+
+struct RecordedEvent {
+    std::string type;
+    std::string id;
+    std::string data;
+    bool operator==(const RecordedEvent& o) const { return type == o.type && id == o.id && data == o.data; }
+};
+
+static void check(bool cond, const char* what) {
+    if (!cond) {
+        fprintf(stderr, "check failed: %s\n", what);
+        abort();
+    }
+}
+
+static void record(std::vector<RecordedEvent>& events, const CLSSEEvent& ev) {
+    check(ev.data[ev.data_len] == '\0', "data is NUL terminated");
+    events.push_back({ev.type, ev.id, std::string(ev.data, ev.data_len)});
+}
+
+static uint32_t next_rand(uint32_t& state) {
+    state = state * 1103515245 + 12345;
+    return state >> 16;
+}
+
+static void run_one(const uint8_t* data, size_t size) {
+    const char *input = (const char *) data;
+    std::vector<RecordedEvent> whole_events;
+    CLSSEParser whole([&](const CLSSEEvent& ev) { record(whole_events, ev); });
+    whole.feed(input, size);
+
+    uint32_t seed = size;
+    for (size_t i = 0; i < size && i < 8; i++) {
+        seed = seed * 31 + data[i];
+    }
+    std::vector<RecordedEvent> split_events;
+    CLSSEParser split([&](const CLSSEEvent& ev) { record(split_events, ev); });
+    uint32_t state = seed;
+    for (size_t pos = 0; pos < size; ) {
+        size_t len = next_rand(state) % 17;
+        if (len > size - pos) {
+            len = size - pos;
+        }
+        split.feed(input + pos, len); // zero length feeds are allowed too
+        pos += len;
+    }
+    check(split_events == whole_events, "split feed gives same events");
+    check(split.get_last_event_id() == whole.get_last_event_id(), "split feed gives same last id");
+    check(split.get_retry_ms() == whole.get_retry_ms(), "split feed gives same retry");
+
+    // handler restarts the stream, the rest of chunk must be dropped without touching freed buffer
+    unsigned long handled = 0;
+    CLSSEParser *restarting_ptr = nullptr;
+    CLSSEParser restarting([&](const CLSSEEvent& ev) {
+        std::string copy(ev.data, ev.data_len);
+        if (++handled % 2 == 1) {
+            restarting_ptr->reset();
+        }
+        check(copy == std::string(ev.data, ev.data_len), "event stays valid after reset in handler");
+    });
+    restarting_ptr = &restarting;
+    state = seed;
+    for (size_t pos = 0; pos < size; ) {
+        size_t len = 1 + next_rand(state) % 64;
+        if (len > size - pos) {
+            len = size - pos;
+        }
+        restarting.feed(input + pos, len);
+        pos += len;
+    }
+}
+
+#ifdef SSE_LIBFUZZER
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    run_one(data, size);
+    return 0;
+}
+
+#else
+
+static const char* const fragments[] = {
+    "data:", "data: ", "event: ", "id: ", "retry: ", ": keepalive", "\n", "\r", "\r\n", "\n\n",
+    "{\"type\":\"message\"}", "x", "5000", "abc\0def", ":", " ", "dat", "a",
+};
+
+static void fuzz_random(unsigned long iterations) {
+    uint32_t state = 1;
+    std::string input;
+    for (unsigned long i = 0; i < iterations; i++) {
+        input.clear();
+        size_t count = next_rand(state) % 40;
+        for (size_t j = 0; j < count; j++) {
+            size_t k = next_rand(state) % (sizeof(fragments) / sizeof(fragments[0]));
+            // "abc\0def" is the only fragment with NUL inside
+            input.append(fragments[k], strcmp(fragments[k], "abc") == 0 ? 7 : strlen(fragments[k]));
+        }
+        if (next_rand(state) % 8 == 0) {
+            input += (char) next_rand(state);
+        }
+        run_one((const uint8_t *) input.data(), input.size());
+    }
+    printf("fuzz: %lu random streams ok\n", iterations);
+}
+
+static void throughput() {
+    std::string stream;
+    for (int i = 0; stream.size() < 16 * 1024 * 1024; i++) {
+        char event[400];
+        snprintf(event, sizeof(event),
+                 "id: %d\r\nevent: message\r\ndata: {\"type\":\"message\",\"chat_id\":12,\"id\":%d,"
+                 "\"text\":\"Lorem ipsum dolor sit amet, consectetur adipiscing elit\"}\r\n\r\n: keepalive\r\n\r\n", i, i);
+        stream += event;
+    }
+    static const size_t chunk_sizes[] = {1, 64, 1460, 16384};
+    for (size_t chunk : chunk_sizes) {
+        unsigned long bytes = 0;
+        CLSSEParser parser([&](const CLSSEEvent& ev) { bytes += ev.data_len; });
+        auto t0 = std::chrono::steady_clock::now();
+        for (size_t pos = 0; pos < stream.size(); pos += chunk) {
+            parser.feed(stream.data() + pos, std::min(chunk, stream.size() - pos));
+        }
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        printf("throughput: chunk %5lu bytes: %7.1f MB/s, %8.0f events/s (%lu events, %lu data bytes)\n",
+               (unsigned long) chunk, stream.size() / secs / (1024 * 1024), parser.get_events_count() / secs,
+               parser.get_events_count(), bytes);
+    }
+}
+
+int main(int argc, char** argv) {
+    fuzz_random(argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000);
+    throughput();
+    return 0;
+}
+
+#endif
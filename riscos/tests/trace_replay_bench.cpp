@@ -0,0 +1,267 @@
+//
+// Host driver of recorded HTTP traces (CLHTTPTrace, network.trace_record in config): chat list and
+// message pages of the trace are fed through CLJsonArrayStream and events through CLSSEParser
+// into ChatData/MessageData as AppDataModel does, and throughput of each phase is measured.
+// Without trace file a synthetic one is recorded first, so the run works on any machine.
+//
+// Build and run: see CMakeLists.txt, ./trace_replay_bench [trace file] [repeats]
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <cloverleaf/Logger.h>
+#include "CLHTTPTrace.h"
+#include "CLJsonArrayStream.h"
+#include "CLSSEParser.h"
+#include "ChatData.h"
+#include "MessageData.h"
+#include "host/host_riscos.h"
+#include "utils.h"
+
+#define CHUNK_SIZE      16384   // curl write callback size
+#define SYNTH_CHATS     200
+#define SYNTH_PAGE      50      // messages in page of each chat
+#define SYNTH_EVENTS    5000
+
+static void check(bool cond, const char* what) {
+    if (!cond) {
+        fprintf(stderr, "check failed: %s\n", what);
+        abort();
+    }
+}
+
+struct PhaseStats {
+    unsigned long long bytes = 0;
+    unsigned long items = 0;
+    double ms = 0;
+};
+
+// chats and messages as AppDataModel keeps them, without UI events and member lookups
+class ReplayModel {
+public:
+    std::map<std::string, ChatDataPtr> chats;
+    unsigned long skipped_events = 0;
+
+    void chat_item(const cJSON* json) {
+        std::string id = JsonData::get_string_value(json, "id", "");
+        auto found = chats.find(id);
+        if (found == chats.end()) {
+            chats[id] = std::make_shared<ChatData>(json);
+        } else {
+            found->second->update_from_json(json);
+        }
+    }
+
+    void message_item(ChatDataPtr chat, const cJSON* json, bool only_update_existing) {
+        int64_t id = JsonData::get_int64_value(json, "id", 0);
+        if (chat == nullptr) {
+            auto found = chats.find(JsonData::get_string_value(json, "chat_id", ""));
+            if (found == chats.end()) {
+                skipped_events++;
+                return;
+            }
+            chat = found->second;
+        }
+        MessageDataPtr msg = chat->get_message(id);
+        if (msg == nullptr) {
+            if (!only_update_existing) {
+                chat->messages.insert(make_message_data(json, chat));
+            }
+        } else {
+            time_t old_sendtime = msg->sendtime;
+            int64_t old_id = msg->id;
+            msg->update_from_json(json);
+            chat->messages.rekey(msg, old_sendtime, old_id);
+        }
+    }
+
+    void event(const cJSON* json) {
+        std::string evtype = JsonData::get_string_value(json, "type", "");
+        const cJSON *json_data = cJSON_GetObjectItemCaseSensitive(json, "data");
+        if (evtype == "MESSAGE_CREATED") {
+            message_item(nullptr, json_data, false);
+        } else if (evtype == "MESSAGE_UPDATED") {
+            message_item(nullptr, json_data, true);
+        } else if (evtype == "CHAT_CREATED" || evtype == "CHAT_UPDATED") {
+            chat_item(json_data);
+        } else {
+            skipped_events++;
+        }
+    }
+
+    unsigned long messages_count() {
+        unsigned long count = 0;
+        for (auto &chat : chats) {
+            count += chat.second->messages.size();
+        }
+        return count;
+    }
+};
+
+static void feed_in_chunks(const std::string& body, std::function<void(const char*, size_t)> feed) {
+    for (size_t pos = 0; pos < body.size(); pos += CHUNK_SIZE) {
+        feed(body.data() + pos, std::min((size_t) CHUNK_SIZE, body.size() - pos));
+    }
+}
+
+// "/chat/<id>/messages/..." -> id
+static std::string messages_page_chat_id(const std::string& key) {
+    size_t start = key.find("/chat/");
+    size_t end = key.find("/messages/");
+    if (start == std::string::npos || end == std::string::npos || end < start + 6) {
+        return "";
+    }
+    return key.substr(start + 6, end - start - 6);
+}
+
+static bool is_chat_list(const std::string& key) {
+    return key.compare(0, 4, "GET ") == 0 && key.size() >= 6 && key.compare(key.size() - 6, 6, "/chat/") == 0;
+}
+
+static void replay(CLHTTPTrace& trace, ReplayModel& model, PhaseStats& chat_list, PhaseStats& pages, PhaseStats& events) {
+    double start = host_now_ms();
+    for (auto &item : trace.get_responses()) {
+        if (!is_chat_list(item.first)) {
+            continue;
+        }
+        for (auto &response : item.second) {
+            CLJsonArrayStream stream("", [&](cJSON* json, int index) {
+                model.chat_item(json);
+                chat_list.items++;
+            });
+            feed_in_chunks(response.body, [&](const char* c, size_t size) { stream.feed(c, size); });
+            stream.finish();
+            chat_list.bytes += response.body.size();
+        }
+    }
+    chat_list.ms += host_now_ms() - start;
+
+    start = host_now_ms();
+    for (auto &item : trace.get_responses()) {
+        auto found = model.chats.find(messages_page_chat_id(item.first));
+        if (found == model.chats.end()) {
+            continue;
+        }
+        ChatDataPtr chat = found->second;
+        for (auto &response : item.second) {
+            CLJsonArrayStream stream("items", [&](cJSON* json, int index) {
+                model.message_item(chat, json, false);
+                pages.items++;
+            });
+            feed_in_chunks(response.body, [&](const char* c, size_t size) { stream.feed(c, size); });
+            stream.finish();
+            pages.bytes += response.body.size();
+        }
+    }
+    pages.ms += host_now_ms() - start;
+
+    // events come as SSE stream, envelope carries app event in "text" as CLHTTPEventStream passes it on
+    std::string sse;
+    for (auto &ev : trace.get_events()) {
+        sse += "data: " + ev.json + "\n\n";
+    }
+    start = host_now_ms();
+    CLSSEParser parser([&](const CLSSEEvent& ev) {
+        cJSON *envelope = cJSON_Parse(ev.data);
+        const cJSON *text = cJSON_GetObjectItemCaseSensitive(envelope, "text");
+        if (text) {
+            model.event(text);
+            events.items++;
+        }
+        cJSON_Delete(envelope);
+    });
+    feed_in_chunks(sse, [&](const char* c, size_t size) { parser.feed(c, size); });
+    events.bytes += sse.size();
+    events.ms += host_now_ms() - start;
+}
+
+static std::string synth_message(int chat, int id, const char* text) {
+    char item[400];
+    snprintf(item, sizeof(item), "{\"id\":%d,\"chat_id\":\"c%d\",\"type\":1,\"flags\":0,\"author_id\":\"m%d\","
+             "\"sendtime\":%d,\"changedtime\":0,\"text\":\"%s %d, lorem ipsum dolor sit amet, consectetur adipiscing elit\"}",
+             id, chat, id % 13, 1700000000 + id, text, id);
+    return item;
+}
+
+// chat list, first page of each chat and event storm of new and edited messages
+static void record_synthetic(const std::string& file_name) {
+    CLHTTPTrace trace;
+    check(trace.start_record(file_name), "trace recorded");
+    const std::string headers = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n";
+    std::string chats = "[";
+    for (int c = 0; c < SYNTH_CHATS; c++) {
+        char item[300];
+        snprintf(item, sizeof(item), "%s{\"id\":\"c%d\",\"type\":50,\"title\":\"Chat number %d\",\"pic_small\":\"\","
+                 "\"members_count\":%d,\"unread_count\":%d,\"my_status\":1}", c ? "," : "", c, c, 2 + c % 40, c % 5);
+        chats += item;
+    }
+    chats += "]";
+    trace.record_request("GET", "https://api.test/api/chat/", "", 200, headers, chats, os_read_monotonic_time());
+    int next_id = 1;
+    for (int c = 0; c < SYNTH_CHATS; c++) {
+        std::string page = "{\"items\":[";
+        for (int i = 0; i < SYNTH_PAGE; i++) {
+            page += (i ? "," : "") + synth_message(c, next_id++, "Message");
+        }
+        page += "],\"next\":\"\"}";
+        char url[100];
+        snprintf(url, sizeof(url), "https://api.test/api/chat/c%d/messages/?first_load=1", c);
+        trace.record_request("GET", url, "", 200, headers, page, os_read_monotonic_time());
+    }
+    for (int e = 0; e < SYNTH_EVENTS; e++) {
+        int chat = (e * 7) % SYNTH_CHATS;
+        bool edit = e % 4 == 3;
+        std::string data = edit ? synth_message(chat, chat * SYNTH_PAGE + 1 + e % SYNTH_PAGE, "Edited")
+                                : synth_message(chat, next_id++, "New");
+        std::string envelope = "{\"id\":" + std::to_string(e + 1) + ",\"channel\":\"ROCHAT.m1\",\"text\":{\"type\":\"" +
+                               (edit ? "MESSAGE_UPDATED" : "MESSAGE_CREATED") + "\",\"data\":" + data +
+                               "},\"tag\":\"1\",\"time\":\"Fri, 16 Oct 2026 10:00:00 GMT\",\"eventid\":\"\"}";
+        trace.record_event(envelope.c_str());
+    }
+    trace.close();
+}
+
+static void report(const char* name, const PhaseStats& s) {
+    double ms = s.ms > 0 ? s.ms : 0.001;
+    printf("  %-14s %8lu items %9llu KB %8.1f ms  %9.0f items/s %7.1f MB/s\n", name, s.items, s.bytes / 1024, s.ms,
+           s.items * 1000.0 / ms, s.bytes / 1024.0 / 1024.0 * 1000.0 / ms);
+}
+
+int main(int argc, char** argv) {
+    std::string trace_file = argc > 1 ? argv[1] : "";
+    int repeats = argc > 2 ? atoi(argv[2]) : 3;
+    std::string dir = host_make_temp_dir("trace_replay_bench");
+    Logger::init("/dev/null");
+    bool synthetic = trace_file.empty();
+    if (synthetic) {
+        trace_file = dir + "/synthetic.trace";
+        record_synthetic(trace_file);
+    }
+    PhaseStats chat_list, pages, events;
+    unsigned long chats = 0, messages = 0, skipped = 0;
+    for (int run = 0; run < repeats; run++) {
+        CLHTTPTrace trace;
+        check(trace.start_replay(trace_file, 0), "trace loaded");
+        ReplayModel model;
+        replay(trace, model, chat_list, pages, events);
+        chats = model.chats.size();
+        messages = model.messages_count();
+        skipped = model.skipped_events;
+    }
+    printf("%s, %d runs, model has %lu chats %lu messages, %lu events skipped:\n", trace_file.c_str(), repeats, chats,
+           messages, skipped);
+    report("chat list", chat_list);
+    report("message pages", pages);
+    report("events", events);
+    if (synthetic) {
+        check(chats == SYNTH_CHATS, "all chats replayed");
+        check(messages == SYNTH_CHATS * SYNTH_PAGE + SYNTH_EVENTS - SYNTH_EVENTS / 4, "pages and new messages replayed");
+        check(skipped == 0, "all events applied");
+    }
+    remove_recursive(dir);
+    return 0;
+}
@@ -1028,7 +1028,7 @@ void ChatMainUI::open() {
         }
     }
 
-    set_app_poll_period(3);
+    app_poll_wakeup();
     if (!instance->is_windows_set_up) {
         instance->messages_view.win.show_centered();
 
@@ -1478,6 +1478,14 @@ void ChatMainUI::check_typing_notify_timeout() {
     }
 }
 
+int ChatMainUI::typing_notify_timeout_cs() {
+    if (!last_type_time) {
+        return -1;
+    }
+    int left = (int) (last_type_time + TYPING_NOTIFY_TIMEOUT - tbx::monotonic_time());
+    return left < 0 ? 0 : left + 1;
+}
+
 void ChatMainUI::submit_message() {
     if (g_app_data_model.get_currently_opened_chat() != nullptr) {
         messages_view.maintain_scroll_position(ScrollPosition::GO_TO_BOTTOM);
@@ -85,6 +85,7 @@ public:
 
     void typing_notify(bool start);
     void check_typing_notify_timeout();
+    int typing_notify_timeout_cs(); // until typing is cancelled by timeout, -1 if not typing
 
     void submit_message();
 
@@ -5,6 +5,7 @@
 #include <list>
 #include <cstdio>
 #include <cerrno>
+#include <zlib.h>
 #include <tbx/sprite.h>
 #include <tbx/application.h>
 #include <tbx/uri.h>
@@ -27,6 +28,7 @@
 #include "global.h"
 #include "cloverleaf/CLException.h"
 #include "cloverleaf/Logger.h"
+#include "cloverleaf/utf8.h"
 
 
 time_t local_tzoffset = 0x7fffffff;
@@ -579,6 +581,53 @@ std::string str_replace_all(std::string str, const std::string& from, const std:
     return str;
 }
 
+// FNV-1a
+std::string str_hash_hex(const std::string& s) {
+    unsigned int h = 2166136261u;
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 16777619u;
+    }
+    char buf[9];
+    sprintf(buf, "%08x", h);
+    return std::string(buf);
+}
+
+// UTF-8 of lowered codepoints, UTF-8 keeps codepoint order when compared bytewise
+std::string utf8_casefold_key(const std::string& s) {
+    std::string key;
+    key.reserve(s.size());
+    char buf[4];
+    utf8_int32_t cp;
+    const void *p = utf8codepoint(s.c_str(), &cp);
+    while (cp != 0) {
+        cp = utf8lwrcodepoint(cp);
+        size_t size = utf8codepointsize(cp);
+        utf8catcodepoint(buf, cp, size);
+        key.append(buf, size);
+        p = utf8codepoint(p, &cp);
+    }
+    return key;
+}
+
+// gzip format (deflate with gzip header), to be sent with Content-Encoding: gzip
+bool gzip_compress(const char* data, size_t size, std::string& out) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    out.resize(deflateBound(&zs, size) + 32);
+    zs.next_in = (Bytef *) data;
+    zs.avail_in = size;
+    zs.next_out = (Bytef *) &out[0];
+    zs.avail_out = out.size();
+    int ret = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
+
 void open_browser_url(const std::string& url) {
     Logger::info("Open URL: %s", url.c_str());
     if (!tbx::URI::dispatch(url)) {
@@ -76,6 +76,9 @@ std::string trim_prefix(const std::string& s, const std::string& prefix);
 size_t split(const std::string &txt, std::vector<std::string> &strs, char ch);
 std::string str_join(const std::vector<std::string>& vec, const char *delim);
 std::string str_replace_all(std::string str, const std::string& from, const std::string& to);
+std::string str_hash_hex(const std::string& s); // 8 hex digits, good for short file names
+std::string utf8_casefold_key(const std::string& s); // bytewise compare of keys orders as utf8casecmp
+bool gzip_compress(const char* data, size_t size, std::string& out);
 
 //void set_yscroll_to_bottom(toolbox_o window_handler);
 //void set_yscroll_to_pos(toolbox_o window_handler, int pos);